@@ -1,5 +1,21 @@
 
 
+/** Specifies dormancy state of an actor, i.e. whether its channels are parked instead of being replicated */
+UENUM()
+enum ENetDormancy
+{
+	/** This actor can never go network dormant. */
+	DORM_Never,
+	/** This actor can go dormant, but is not currently dormant. Game code will tell it when it go dormant. */
+	DORM_Awake,
+	/** This actor wants to go fully dormant for all connections. */
+	DORM_DormantAll,
+	/** This actor is initially dormant for all connection if it was placed in map. */
+	DORM_Initial,
+
+	DORM_MAX,
+};
+
 UCLASS(BlueprintType, Blueprintable, config=Engine, meta=(ShortTooltip="An Actor is an object that can be placed or spawned in the world."))
 class ENGINE_API AActor : public UObject
 {
@@ -15,6 +31,144 @@ class ENGINE_API AActor : public UObject
 	UPROPERTY(ReplicatedUsing=OnRep_Owner)
 	TObjectPtr<AActor> Owner;
 
+	/** Actors whose Owner is this one. Kept by SetOwner, so an owner change can reach everything below it. */
+	UPROPERTY(Transient)
+	TArray<TObjectPtr<AActor>> Children;
+
+	/**
+	 * Drops the owner chain cache of this actor and of everything it owns, directly or not: the only owner chains a
+	 * change of this actor's Owner (or of a PlayerController's Player) can affect. The net driver re-indexes the
+	 * owner-only actors among them, see UNetDriver::NotifyActorOwnerChainChanged.
+	 */
+	void InvalidateOwnerChainCache()
+	{
+		bOwnerChainCacheValid = false;
+
+		if (UNetDriver* NetDriver = GetNetDriver())
+		{
+			NetDriver->NotifyActorOwnerChainChanged(this);
+		}
+
+		for (AActor* Child : Children)
+		{
+			if (Child)
+			{
+				Child->InvalidateOwnerChainCache();
+			}
+		}
+	}
+
+	virtual void SetOwner(AActor* NewOwner)
+	{
+		if (Owner != NewOwner)
+		{
+			if (Owner)
+			{
+				Owner->Children.Remove(this);
+			}
+
+			Owner = NewOwner;
+
+			if (Owner)
+			{
+				Owner->Children.Add(this);
+			}
+
+			InvalidateOwnerChainCache();
+			ForceNetUpdate();
+		}
+	}
+
+	UFUNCTION()
+	virtual void OnRep_Owner()
+	{
+		InvalidateOwnerChainCache();
+	}
+
+	/**
+	 * Refreshes the cached root owner and owning player if the owner chain changed since they were computed.
+	 * Only called from serial code (the net driver, before connections replicate); everything else just reads the cache.
+	 */
+	void UpdateOwnerChainCache()
+	{
+		if (bOwnerChainCacheValid)
+		{
+			return;
+		}
+
+		CachedRootOwner = FindRootOwner();
+		CachedNetOwningPlayer = GetNetOwningPlayer();
+		bOwnerChainCacheValid = true;
+	}
+
+	bool HasValidOwnerChainCache() const
+	{
+		return bOwnerChainCacheValid;
+	}
+
+	/** Last actor of the Owner chain (this if unowned). Walks the chain if the cache is stale, without updating it. */
+	const AActor* GetOwnerChainRoot() const
+	{
+		return HasValidOwnerChainCache() ? CachedRootOwner : FindRootOwner();
+	}
+
+	/** GetNetOwningPlayer without the recursive walk, when the cache is current */
+	UPlayer* GetCachedNetOwningPlayer()
+	{
+		return HasValidOwnerChainCache() ? CachedNetOwningPlayer : GetNetOwningPlayer();
+	}
+
+	bool IsOwnedBy(const AActor* TestOwner) const
+	{
+		// Actors with different roots can't be on each other's owner chain, which settles most checks without a walk
+		if (TestOwner && HasValidOwnerChainCache() && TestOwner->HasValidOwnerChainCache() && CachedRootOwner != TestOwner->CachedRootOwner)
+		{
+			return false;
+		}
+
+		for (const AActor* Arg = this; Arg; Arg = Arg->Owner)
+		{
+			if (Arg == TestOwner)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * Dense index used as key by FActorChannelMap, INDEX_NONE until a net driver first adds the actor.
+	 * Shared by every driver and kept until the actor is garbage collected, so channels that outlive
+	 * RemoveNetworkActor (SetReplicates(false), closing channels) can still be found and removed.
+	 */
+	int32 NetIndex = INDEX_NONE;
+
+	/** Indices of collected actors, handed out again before growing NextNetIndex. Process-wide, so no two live actors share one. */
+	static inline TArray<int32> FreeNetIndices;
+	static inline int32 NextNetIndex = 0;
+
+	/** Called by every UNetDriver::AddNetworkActor, only the first call assigns */
+	void AssignNetIndex()
+	{
+		check(IsInGameThread());
+		if (NetIndex == INDEX_NONE)
+		{
+			NetIndex = FreeNetIndices.Num() > 0 ? FreeNetIndices.Pop(false) : NextNetIndex++;
+		}
+	}
+
+	virtual void BeginDestroy() override
+	{
+		// Weak pointers to the actor no longer resolve here, so map entries still keyed on the index are seen as stale
+		if (NetIndex != INDEX_NONE)
+		{
+			FreeNetIndices.Add(NetIndex);
+			NetIndex = INDEX_NONE;
+		}
+
+		Super::BeginDestroy();
+	}
+
 	/** If actor has valid Owner, call Owner's IsNetRelevantFor and GetNetPriority */
 	UPROPERTY(Category=Replication, EditDefaultsOnly, BlueprintReadWrite)
 	uint8 bNetUseOwnerRelevancy:1;
@@ -31,6 +185,76 @@ class ENGINE_API AActor : public UObject
 	UPROPERTY(Category=Replication, EditDefaultsOnly, BlueprintReadWrite)
 	float NetPriority;
 
+	/** Dormancy setting for actor to take itself off of the replication list without being destroyed on clients. */
+	UPROPERTY(Category=Replication, EditAnywhere, BlueprintReadOnly)
+	TEnumAsByte<enum ENetDormancy> NetDormancy;
+
+	/** Puts the actor to sleep on every connection once its current state is out, or wakes it with DORM_Awake / DORM_Never */
+	void SetNetDormancy(ENetDormancy NewDormancy)
+	{
+		if (NetDormancy == NewDormancy)
+		{
+			return;
+		}
+
+		NetDormancy = NewDormancy;
+		if (UNetDriver* NetDriver = GetNetDriver())
+		{
+			NetDriver->NotifyActorDormancyChanged(this);
+		}
+	}
+
+	/** Replicated state changed while dormant: replicate it once to the connections the actor is dormant on, then sleep again */
+	void FlushNetDormancy()
+	{
+		if (NetDormancy <= DORM_Awake)
+		{
+			return;
+		}
+
+		// A placed actor that was flushed has state the map doesn't, and must now be sent to new connections too
+		if (NetDormancy == DORM_Initial)
+		{
+			NetDormancy = DORM_DormantAll;
+		}
+
+		if (UNetDriver* NetDriver = GetNetDriver())
+		{
+			NetDriver->FlushActorDormancy(this);
+		}
+	}
+
+	/** Use these instead of writing NetUpdateFrequency / NetPriority directly at runtime, so the connections' priority schedulers get re-keyed */
+	void SetNetUpdateFrequency(float InNetUpdateFrequency)
+	{
+		NetUpdateFrequency = InNetUpdateFrequency;
+		if (UNetDriver* NetDriver = GetNetDriver())
+		{
+			NetDriver->NotifyActorPriorityInputsChanged(this);
+		}
+	}
+
+	void SetNetPriority(float InNetPriority)
+	{
+		NetPriority = InNetPriority;
+		if (UNetDriver* NetDriver = GetNetDriver())
+		{
+			NetDriver->NotifyActorPriorityInputsChanged(this);
+		}
+	}
+
+
+	/**
+	 * Force actor to be updated to clients. Called when a replicated property is dirtied (push model) or an RPC is queued,
+	 * so an actor that was throttled down towards MinNetUpdateFrequency goes back to NetUpdateFrequency right away.
+	 */
+	virtual void ForceNetUpdate()
+	{
+		if (UNetDriver* NetDriver = GetNetDriver())
+		{
+			NetDriver->ForceNetUpdate(this);
+		}
+	}
 
 
 	/** Return the owning UPlayer (if any) of this actor. This will be a local player, a net connection, or nullptr. */
@@ -74,4 +298,21 @@ class ENGINE_API AActor : public UObject
 	{
 		return FVector::DistSquared(SrcLocation, GetActorLocation()) < NetCullDistanceSquared;
 	}
+
+private:
+
+	const AActor* FindRootOwner() const
+	{
+		const AActor* Root = this;
+		while (Root->Owner)
+		{
+			Root = Root->Owner;
+		}
+		return Root;
+	}
+
+	/** See UpdateOwnerChainCache */
+	const AActor* CachedRootOwner = nullptr;
+	UPlayer* CachedNetOwningPlayer = nullptr;
+	bool bOwnerChainCacheValid = false;
 };
@@ -10,4 +10,12 @@ class ENGINE_API APlayerController : public AController, public IWorldPartitionS
 	{
 		return Player;
 	}
+
+	void SetPlayer(UPlayer* InPlayer)
+	{
+		Player = InPlayer;
+
+		// Ends the owner chain of everything this controller owns
+		InvalidateOwnerChainCache();
+	}
 };
\ No newline at end of file
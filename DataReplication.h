@@ -0,0 +1,221 @@
+
+
+/**
+ * Property payload for one object, compared and serialized once per frame and shared by every connection that can use it.
+ *
+ * A payload is only valid for connections whose replicator last sent BaseHistory, whose replication conditions
+ * (COND_OwnerOnly, COND_SkipOwner...) evaluate the same, and who don't have any lost (NAKed) properties to resend.
+ * Payloads that reference objects are never shared: NetGUIDs are exported per connection, through its own PackageMap.
+ * Everyone else gets a custom delta built from their own FRepState.
+ */
+struct FSharedReplicationPayload
+{
+	/** Changelist history index the payload is a delta from */
+	int32 BaseHistory = INDEX_NONE;
+
+	/** Changelist history index the receiver will be at once it gets the payload */
+	int32 TargetHistory = INDEX_NONE;
+
+	/** Bit per ELifetimeCondition that holds for the connections using this payload, see MakeConditionMask */
+	uint64 ConditionMask = 0;
+
+	/** False if the changed properties include object references; connections then build their own delta */
+	bool bShareable = true;
+
+	/** Property handles written to Bits. Stored in each connection's send history so NAKs can still be resolved per connection. */
+	TArray<uint16> ChangedHandles;
+
+	TArray<uint8> Bits;
+	int64 NumBits = 0;
+};
+
+/** Refcounted, so a bunch still being written on one connection keeps the bytes alive after the cache moved to the next frame */
+typedef TSharedRef<const FSharedReplicationPayload, ESPMode::ThreadSafe> FSharedReplicationPayloadRef;
+
+/**
+ * Per-driver cache of FSharedReplicationPayloads for the current replication frame.
+ * Game thread only: connections replicate one after another, even with bParallelConnectionReplication.
+ */
+class FSharedReplicationPayloadCache
+{
+public:
+
+	/** Called once per ServerReplicateActors. Payloads from older frames are dropped, connections that still hold them keep them alive. */
+	void BeginFrame(uint32 InReplicationFrame)
+	{
+		ReplicationFrame = InReplicationFrame;
+		Entries.Reset();
+	}
+
+	/** The replication conditions that hold for a connection with RepFlags, as the key FindOrBuild shares payloads on */
+	static uint64 MakeConditionMask(const FReplicationFlags& RepFlags)
+	{
+		static_assert(COND_Max <= 64, "ELifetimeCondition doesn't fit the condition mask");
+
+		const TStaticBitArray<COND_Max> ConditionMap = UE::Net::BuildConditionMapFromRepFlags(RepFlags);
+
+		uint64 ConditionMask = 0;
+		for (int32 Condition = 0; Condition < COND_Max; Condition++)
+		{
+			ConditionMask |= ConditionMap[Condition] ? uint64(1) << Condition : 0;
+		}
+		return ConditionMask;
+	}
+
+	/**
+	 * Returns the payload for Object going from BaseHistory to TargetHistory under ConditionMask, calling Build to serialize
+	 * it if nobody did yet this frame. The caller must fall back to its own delta if the payload isn't bShareable.
+	 */
+	template<typename BuildFunc>
+	FSharedReplicationPayloadRef FindOrBuild(const UObject* Object, int32 BaseHistory, int32 TargetHistory, uint64 ConditionMask, BuildFunc&& Build)
+	{
+		TArray<FSharedReplicationPayloadRef, TInlineAllocator<2>>& Payloads = Entries.FindOrAdd(Object);
+		for (const FSharedReplicationPayloadRef& Payload : Payloads)
+		{
+			if (Payload->BaseHistory == BaseHistory && Payload->TargetHistory == TargetHistory && Payload->ConditionMask == ConditionMask)
+			{
+				NumShared += Payload->bShareable ? 1 : 0;
+				return Payload;
+			}
+		}
+
+		TSharedRef<FSharedReplicationPayload, ESPMode::ThreadSafe> NewPayload = MakeShared<FSharedReplicationPayload, ESPMode::ThreadSafe>();
+		NewPayload->BaseHistory = BaseHistory;
+		NewPayload->TargetHistory = TargetHistory;
+		NewPayload->ConditionMask = ConditionMask;
+		Build(*NewPayload);
+
+		NumSerialized++;
+		Payloads.Add(NewPayload);
+		return NewPayload;
+	}
+
+	/** How many payloads were serialized, and how many times one was reused instead of serializing again */
+	uint32 NumSerialized = 0;
+	uint32 NumShared = 0;
+
+private:
+
+	uint32 ReplicationFrame = 0;
+
+	/** Object -> payloads built this frame. Usually one, more if connections are at different base histories or conditions. */
+	TMap<const UObject*, TArray<FSharedReplicationPayloadRef, TInlineAllocator<2>>> Entries;
+};
+
+
+/** Replicates the properties of one object (actor or subobject) over one UActorChannel. Owned by UActorChannel::ReplicationMap. */
+class FObjectReplicator
+{
+	TWeakObjectPtr<UObject> ObjectPtr;
+
+	UNetConnection* Connection;
+
+	/** Property layout of the object's class, shared by every replicator of that class */
+	TSharedPtr<FRepLayout> RepLayout;
+
+	/** What this connection has been sent and has acknowledged */
+	TUniquePtr<FRepState> RepState;
+
+	void InitWithObject(UObject* InObject, UNetConnection* InConnection, bool bUseDefaultState)
+	{
+		ObjectPtr = InObject;
+		Connection = InConnection;
+
+		// Always a fresh FRepState: its shadow buffers, changelist history and retirement state all describe the previous
+		// object and connection, and FRepLayout has no way to reset them in place
+		RepLayout = Connection->Driver->GetObjectClassRepLayout(InObject->GetClass());
+		RepState = RepLayout->CreateRepState(bUseDefaultState ? InObject->GetArchetype() : InObject, Connection);
+	}
+
+	/** Called before going back to UNetDriver::ReplicatorPool. Nothing of the previous object's replication state is kept. */
+	void ResetForPool()
+	{
+		ObjectPtr.Reset();
+		Connection = nullptr;
+		RepState.Reset();
+		RepLayout.Reset();
+	}
+
+	bool ReplicateProperties(FOutBunch& Bunch, FReplicationFlags RepFlags)
+	{
+		UObject* Object = ObjectPtr.Get();
+		UNetDriver* Driver = Connection->Driver;
+
+		// The compare against the shadow state happens once per frame for all connections, in the changelist manager
+		FRepChangelistState* ChangelistState = Driver->GetReplicationChangeListMgr(Object)->GetRepChangelistState();
+		RepLayout->UpdateChangelistMgr(*ChangelistState, Object, Driver->ReplicationFrame, RepFlags);
+
+		FSendingRepState* SendingRepState = RepState->GetSendingRepState();
+		const int32 BaseHistory = SendingRepState->LastChangelistIndex;
+		const int32 TargetHistory = ChangelistState->HistoryEnd;
+
+		if (BaseHistory == TargetHistory && !SendingRepState->HasLostChanges())
+		{
+			return false;
+		}
+
+		// Initial bunches and connections that have something to resend need a delta nobody else can use
+		const bool bCanShare = Driver->bShareReplicationPayloads && !RepFlags.bNetInitial && !SendingRepState->HasLostChanges();
+		if (!bCanShare)
+		{
+			return RepLayout->ReplicateProperties(SendingRepState, ChangelistState, Object, Connection, Bunch, RepFlags);
+		}
+
+		const uint64 ConditionMask = FSharedReplicationPayloadCache::MakeConditionMask(RepFlags);
+		FSharedReplicationPayloadRef Payload = Driver->SharedReplicationPayloads.FindOrBuild(Object, BaseHistory, TargetHistory, ConditionMask,
+			[this, ChangelistState, BaseHistory, TargetHistory, RepFlags](FSharedReplicationPayload& OutPayload)
+			{
+				TArray<uint16> MergedHandles;
+				RepLayout->MergeChangelistRange(*ChangelistState, BaseHistory, TargetHistory, MergedHandles);
+
+				// Same filtering ReplicateProperties does with the connection's own conditions
+				const TStaticBitArray<COND_Max> ConditionMap = UE::Net::BuildConditionMapFromRepFlags(RepFlags);
+				RepLayout->FilterChangeListToActive(MergedHandles, ConditionMap, OutPayload.ChangedHandles);
+
+				if (RepLayout->DoChangedHandlesReferenceObjects(OutPayload.ChangedHandles))
+				{
+					OutPayload.bShareable = false;
+					return;
+				}
+
+				// No object references, so nothing in the bits depends on which connection's PackageMap wrote them
+				FNetBitWriter Writer(0);
+				RepLayout->SendProperties(*ChangelistState, OutPayload.ChangedHandles, Writer);
+
+				OutPayload.NumBits = Writer.GetNumBits();
+				OutPayload.Bits = MoveTemp(*Writer.GetBuffer());
+			});
+
+		if (!Payload->bShareable)
+		{
+			return RepLayout->ReplicateProperties(SendingRepState, ChangelistState, Object, Connection, Bunch, RepFlags);
+		}
+
+		Bunch.SerializeBits((void*)Payload->Bits.GetData(), Payload->NumBits);
+
+		// Ack / NAK bookkeeping stays per connection, so a lost packet only makes *this* connection fall back to a custom delta.
+		// The bunch isn't sent yet and may go out in a later packet, or several: PostSendBunch sets the range.
+		const int32 HistoryIndex = SendingRepState->HistoryEnd % FSendingRepState::MAX_CHANGE_HISTORY;
+		FRepChangedHistory& NewHistoryItem = SendingRepState->ChangeHistory[HistoryIndex];
+		NewHistoryItem.Reset();
+		NewHistoryItem.Changed = Payload->ChangedHandles;
+		SendingRepState->HistoryEnd++;
+
+		SendingRepState->LastChangelistIndex = TargetHistory;
+		return Payload->NumBits > 0;
+	}
+
+	/** Called by UActorChannel::ReplicateActor once the bunch is sent: history entries added for it learn their packets */
+	void PostSendBunch(const FPacketIdRange& PacketRange, uint8 bReliable)
+	{
+		FSendingRepState* SendingRepState = RepState->GetSendingRepState();
+		for (int32 i = SendingRepState->HistoryStart; i < SendingRepState->HistoryEnd; i++)
+		{
+			FRepChangedHistory& HistoryItem = SendingRepState->ChangeHistory[i % FSendingRepState::MAX_CHANGE_HISTORY];
+			if (HistoryItem.OutPacketIdRange.First == INDEX_NONE)
+			{
+				HistoryItem.OutPacketIdRange = PacketRange;
+			}
+		}
+	}
+};
@@ -0,0 +1,243 @@
+
+
+/**
+ * Actor -> UActorChannel map for a connection, looked up for every prioritized actor every tick.
+ *
+ * Open addressing with linear probing over structure-of-arrays storage, keyed on AActor::NetIndex (unique among live
+ * actors across every net driver, stable for the actor's lifetime). A probe only touches the packed NetIndices array until it hits the key.
+ * Removal uses backward shift, so there are no tombstones and probe lengths stay short under churn.
+ *
+ * Net indices are reused once an actor is garbage collected, so every hit is confirmed against the weak actor pointer.
+ * Entries whose actor was destroyed without closing its channel are not cleaned up on lookup; PurgeStaleEntries
+ * removes them a few slots at a time.
+ */
+class FActorChannelMap
+{
+public:
+
+	FActorChannelMap()
+	{
+		Rehash(16);
+	}
+
+	void Add(AActor* Actor, UActorChannel* Channel)
+	{
+		check(Actor->NetIndex != INDEX_NONE);
+
+		if ((NumEntries + 1) * 4 > Capacity * 3)
+		{
+			Rehash(Capacity * 2);
+		}
+
+		const uint32 Key = MakeKey(Actor);
+		uint32 Slot = GetHomeSlot(Key);
+		while (NetIndices[Slot] != EmptyKey && NetIndices[Slot] != Key)
+		{
+			Slot = (Slot + 1) & (Capacity - 1);
+		}
+
+		if (NetIndices[Slot] == EmptyKey)
+		{
+			NumEntries++;
+		}
+
+		// Overwrites a stale entry left by a previous actor with the same net index
+		NetIndices[Slot] = Key;
+		Channels[Slot] = Channel;
+		Actors[Slot] = Actor;
+	}
+
+	UActorChannel* FindRef(const AActor* Actor) const
+	{
+		const int32 Slot = FindSlot(Actor);
+		return Slot != INDEX_NONE ? Channels[Slot] : nullptr;
+	}
+
+	UActorChannel** Find(const AActor* Actor)
+	{
+		const int32 Slot = FindSlot(Actor);
+		return Slot != INDEX_NONE ? &Channels[Slot] : nullptr;
+	}
+
+	bool Contains(const AActor* Actor) const
+	{
+		return FindSlot(Actor) != INDEX_NONE;
+	}
+
+	int32 Remove(const AActor* Actor)
+	{
+		const int32 Slot = FindSlot(Actor);
+		if (Slot == INDEX_NONE)
+		{
+			return 0;
+		}
+
+		RemoveAtSlot(Slot);
+		return 1;
+	}
+
+	/**
+	 * Removes entries whose actor is gone from the next MaxSlots slots, carrying on where the previous call stopped.
+	 * Call every tick rather than paying for the weak pointer check on every lookup; a full sweep takes Capacity / MaxSlots calls.
+	 */
+	int32 PurgeStaleEntries(uint32 MaxSlots)
+	{
+		if (NumEntries == 0)
+		{
+			return 0;
+		}
+
+		int32 NumPurged = 0;
+		const uint32 NumSlots = FMath::Min(MaxSlots, Capacity);
+		for (uint32 Visited = 0; Visited < NumSlots; Visited++)
+		{
+			const uint32 Slot = PurgeCursor;
+			if (NetIndices[Slot] != EmptyKey && !Actors[Slot].IsValid())
+			{
+				// Backward shift may move a not yet visited entry into Slot, so the cursor stays to look at it again
+				RemoveAtSlot(Slot);
+				NumPurged++;
+			}
+			else
+			{
+				PurgeCursor = (PurgeCursor + 1) & (Capacity - 1);
+			}
+		}
+		return NumPurged;
+	}
+
+	int32 Num() const
+	{
+		return NumEntries;
+	}
+
+	template<typename FuncType>
+	void ForEach(FuncType&& Func) const
+	{
+		for (uint32 Slot = 0; Slot < Capacity; Slot++)
+		{
+			if (NetIndices[Slot] != EmptyKey)
+			{
+				Func(Actors[Slot], Channels[Slot]);
+			}
+		}
+	}
+
+	void Reserve(int32 Number)
+	{
+		uint32 NewCapacity = Capacity;
+		while (uint32(Number) * 4 > NewCapacity * 3)
+		{
+			NewCapacity *= 2;
+		}
+
+		if (NewCapacity != Capacity)
+		{
+			Rehash(NewCapacity);
+		}
+	}
+
+private:
+
+	static constexpr uint32 EmptyKey = 0;
+
+	/** NetIndex + 1, so zero can mean empty */
+	static uint32 MakeKey(const AActor* Actor)
+	{
+		return uint32(Actor->NetIndex) + 1;
+	}
+
+	uint32 GetHomeSlot(uint32 Key) const
+	{
+		// Fibonacci hashing, net indices are dense so we need to spread them
+		return uint32((Key * 2654435769u) >> (32 - CapacityLog2));
+	}
+
+	int32 FindSlot(const AActor* Actor) const
+	{
+		if (Actor->NetIndex == INDEX_NONE)
+		{
+			return INDEX_NONE;
+		}
+
+		const uint32 Key = MakeKey(Actor);
+		for (uint32 Slot = GetHomeSlot(Key); NetIndices[Slot] != EmptyKey; Slot = (Slot + 1) & (Capacity - 1))
+		{
+			if (NetIndices[Slot] == Key)
+			{
+				// Same net index but a different (destroyed) actor means the entry is stale
+				return Actors[Slot] == Actor ? int32(Slot) : INDEX_NONE;
+			}
+		}
+		return INDEX_NONE;
+	}
+
+	void RemoveAtSlot(uint32 Slot)
+	{
+		NumEntries--;
+
+		// Backward shift deletion: pull following entries of the cluster into the hole if that doesn't move them before their home slot
+		uint32 Hole = Slot;
+		for (uint32 Next = (Hole + 1) & (Capacity - 1); NetIndices[Next] != EmptyKey; Next = (Next + 1) & (Capacity - 1))
+		{
+			const uint32 Home = GetHomeSlot(NetIndices[Next]);
+			const uint32 DistNext = (Next - Home) & (Capacity - 1);
+			const uint32 DistHole = (Hole - Home) & (Capacity - 1);
+			if (DistHole < DistNext)
+			{
+				NetIndices[Hole] = NetIndices[Next];
+				Channels[Hole] = Channels[Next];
+				Actors[Hole] = Actors[Next];
+				Hole = Next;
+			}
+		}
+
+		NetIndices[Hole] = EmptyKey;
+		Channels[Hole] = nullptr;
+		Actors[Hole].Reset();
+	}
+
+	void Rehash(uint32 NewCapacity)
+	{
+		check(FMath::IsPowerOfTwo(NewCapacity));
+
+		TArray<uint32> OldNetIndices = MoveTemp(NetIndices);
+		TArray<UActorChannel*> OldChannels = MoveTemp(Channels);
+		TArray<TWeakObjectPtr<AActor>> OldActors = MoveTemp(Actors);
+
+		Capacity = NewCapacity;
+		CapacityLog2 = FMath::FloorLog2(NewCapacity);
+		PurgeCursor = 0;
+		NetIndices.SetNumZeroed(Capacity);
+		Channels.SetNumZeroed(Capacity);
+		Actors.SetNum(Capacity);
+
+		for (int32 OldSlot = 0; OldSlot < OldNetIndices.Num(); OldSlot++)
+		{
+			if (OldNetIndices[OldSlot] != EmptyKey)
+			{
+				uint32 Slot = GetHomeSlot(OldNetIndices[OldSlot]);
+				while (NetIndices[Slot] != EmptyKey)
+				{
+					Slot = (Slot + 1) & (Capacity - 1);
+				}
+
+				NetIndices[Slot] = OldNetIndices[OldSlot];
+				Channels[Slot] = OldChannels[OldSlot];
+				Actors[Slot] = OldActors[OldSlot];
+			}
+		}
+	}
+
+	/** Structure of arrays, all Capacity long. Probing only reads NetIndices. */
+	TArray<uint32> NetIndices;
+	TArray<UActorChannel*> Channels;
+	TArray<TWeakObjectPtr<AActor>> Actors;
+
+	uint32 Capacity = 0;
+	uint32 CapacityLog2 = 0;
+	int32 NumEntries = 0;
+
+	/** Next slot PurgeStaleEntries looks at */
+	uint32 PurgeCursor = 0;
+};
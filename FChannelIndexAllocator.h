@@ -0,0 +1,128 @@
+
+
+/**
+ * Hands out channel indices for a UNetConnection in O(1).
+ *
+ * Four bitmaps (used, reserved, ignored, in free list) and a LIFO free list of indices.
+ * An index is in the free list at most once. Indices that become unusable while in the list (claimed explicitly by the
+ * remote side, reserved, ignored for a delta checkpoint) stay there and are skipped when popped, so every operation is O(1)
+ * amortized and nothing ever scans Channels.
+ * Indices below FirstDynamicIndex belong to static channels (control, voice) and are only ever claimed.
+ */
+class FChannelIndexAllocator
+{
+public:
+
+	void Init(int32 InMaxChannels, int32 InFirstDynamicIndex)
+	{
+		MaxChannels = InMaxChannels;
+		FirstDynamicIndex = FMath::Clamp(InFirstDynamicIndex, 0, MaxChannels);
+		Used.Init(false, MaxChannels);
+		Reserved.Init(false, MaxChannels);
+		Ignored.Init(false, MaxChannels);
+		InFreeList.Init(false, MaxChannels);
+
+		// Lowest indices are popped first, matching the old linear scan
+		FreeList.Reset(MaxChannels);
+		for (int32 Index = MaxChannels - 1; Index >= FirstDynamicIndex; Index--)
+		{
+			InFreeList[Index] = true;
+			FreeList.Add(Index);
+		}
+	}
+
+	/** Returns a free, unreserved index, or INDEX_NONE if the connection is out of channels */
+	int32 Allocate()
+	{
+		while (FreeList.Num() > 0)
+		{
+			const int32 Index = FreeList.Pop(false);
+			InFreeList[Index] = false;
+
+			if (IsAllocatable(Index))
+			{
+				Used[Index] = true;
+				return Index;
+			}
+		}
+
+		return INDEX_NONE;
+	}
+
+	/** Marks a specific index as used, for channels opened by the remote side or created with an explicit ChannelIndex */
+	bool Claim(int32 Index)
+	{
+		if (!Used.IsValidIndex(Index) || Used[Index])
+		{
+			return false;
+		}
+
+		// Left in the free list if it's there, Allocate will skip it
+		Used[Index] = true;
+		return true;
+	}
+
+	void Release(int32 Index)
+	{
+		check(Used[Index]);
+		Used[Index] = false;
+		PushFree(Index);
+	}
+
+	/** Reserved indices are never returned by Allocate, but can still be claimed explicitly */
+	void SetReserved(int32 FirstIndex, int32 Count, bool bReserved)
+	{
+		for (int32 Index = FMath::Max(FirstIndex, 0); Index < FirstIndex + Count && Index < MaxChannels; Index++)
+		{
+			Reserved[Index] = bReserved;
+			PushFree(Index);
+		}
+	}
+
+	/** Same as reserved, but tracked apart so ending a delta checkpoint ignore never drops a reservation */
+	void SetIgnored(int32 Index, bool bIgnored)
+	{
+		if (Ignored.IsValidIndex(Index))
+		{
+			Ignored[Index] = bIgnored;
+			PushFree(Index);
+		}
+	}
+
+	bool IsReserved(int32 Index) const
+	{
+		return Reserved.IsValidIndex(Index) && Reserved[Index];
+	}
+
+	bool IsUsed(int32 Index) const
+	{
+		return Used.IsValidIndex(Index) && Used[Index];
+	}
+
+private:
+
+	bool IsAllocatable(int32 Index) const
+	{
+		return Index >= FirstDynamicIndex && !Used[Index] && !Reserved[Index] && !Ignored[Index];
+	}
+
+	/** No-op unless Index can be allocated right now */
+	void PushFree(int32 Index)
+	{
+		if (!InFreeList[Index] && IsAllocatable(Index))
+		{
+			InFreeList[Index] = true;
+			FreeList.Add(Index);
+		}
+	}
+
+	int32 MaxChannels = 0;
+	int32 FirstDynamicIndex = 0;
+
+	TBitArray<> Used;
+	TBitArray<> Reserved;
+	TBitArray<> Ignored;
+	TBitArray<> InFreeList;
+
+	TArray<int32> FreeList;
+};
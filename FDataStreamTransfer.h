@@ -0,0 +1,264 @@
+
+/**
+ * Bulk transfers over UDataStreamChannel (custom maps, user content, save states).
+ *
+ * A file is sent as fixed size blocks in unreliable bunches, retransmitted one by one like fragments (see FFragmentedBunch.h):
+ *	- The sender remembers the packet each block last went out in. A NAK queues the blocks of that packet for resending.
+ *	- At most WindowBlocks blocks, counted from the oldest unACKed one, are outstanding. The receiver buffers out of order
+ *	  blocks within that window and writes the file strictly in order, so what's on disk is always a complete prefix.
+ *	- Blocks only go out with the bandwidth actor replication left this frame, see UNetDriver::TickFlushComplete.
+ *
+ * Transfers are identified by a content id chosen by the caller. When a transfer begins, the receiver answers with how much
+ * of that content it already has on disk, from an interrupted earlier transfer, and the sender starts from there.
+ */
+
+/** First byte of every data stream bunch */
+enum class EDataStreamMessage : uint8
+{
+	/** Sender -> receiver, reliable: content id, total size, name */
+	Begin,
+
+	/** Receiver -> sender, reliable: content id, first block to send, receive window */
+	Resume,
+
+	/** Sender -> receiver, unreliable: block index, block bytes */
+	Block,
+};
+
+/** Block payload per bunch, the same size as a fragment so a block fits a packet next to other bunches */
+static constexpr int32 DataStreamBlockBytes = MAX_PARTIAL_BUNCH_SIZE_BYTES;
+
+struct FDataStreamTransferStats
+{
+	uint64 BytesSent = 0;
+	uint64 BytesResent = 0;
+	uint64 BytesReceived = 0;
+
+	/** Bytes skipped thanks to a resumed transfer */
+	uint64 BytesResumed = 0;
+
+	uint32 NumTransfersCompleted = 0;
+};
+
+/** Sending side of one file, read in place from a memory mapping */
+struct FDataStreamOutTransfer
+{
+	FGuid ContentId;
+	FString Name;
+
+	TUniquePtr<IMappedFileHandle> MappedFile;
+	TUniquePtr<IMappedFileRegion> MappedRegion;
+	int64 TotalSize = 0;
+	uint32 NumBlocks = 0;
+
+	/** Nothing is sent before the receiver's Resume tells where to start */
+	bool bResumeReceived = false;
+
+	/** Oldest block not ACKed yet, and the next block never sent */
+	uint32 BaseBlock = 0;
+	uint32 NextBlock = 0;
+
+	/** Indexed by block % WindowBlocks, for blocks in [BaseBlock, NextBlock) */
+	struct FBlockSlot
+	{
+		int32 PacketId = INDEX_NONE;
+		bool bAcked = false;
+	};
+	TArray<FBlockSlot> Slots;
+
+	/** NAKed blocks, sent before any new one */
+	TArray<uint32> ResendQueue;
+
+	bool Open(const FString& Filename, const FGuid& InContentId)
+	{
+		MappedFile.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*Filename));
+		if (!MappedFile)
+		{
+			return false;
+		}
+
+		TotalSize = MappedFile->GetFileSize();
+		if (TotalSize > 0)
+		{
+			MappedRegion.Reset(MappedFile->MapRegion(0, TotalSize));
+			if (!MappedRegion)
+			{
+				return false;
+			}
+		}
+
+		ContentId = InContentId;
+		Name = FPaths::GetCleanFilename(Filename);
+		NumBlocks = uint32(FMath::DivideAndRoundUp<int64>(TotalSize, DataStreamBlockBytes));
+		return true;
+	}
+
+	/** Receiver's answer to Begin */
+	void Resume(uint32 FirstBlock, int32 WindowBlocks)
+	{
+		BaseBlock = NextBlock = FMath::Min(FirstBlock, NumBlocks);
+		Slots.Reset();
+		Slots.SetNum(FMath::Max(WindowBlocks, 1));
+		bResumeReceived = true;
+	}
+
+	bool IsComplete() const
+	{
+		return bResumeReceived && BaseBlock == NumBlocks;
+	}
+
+	bool CanSendNewBlock() const
+	{
+		return bResumeReceived && NextBlock < NumBlocks && NextBlock - BaseBlock < uint32(Slots.Num());
+	}
+
+	const uint8* GetBlockData(uint32 Block) const
+	{
+		return MappedRegion->GetMappedPtr() + int64(Block) * DataStreamBlockBytes;
+	}
+
+	int32 GetBlockSize(uint32 Block) const
+	{
+		return int32(FMath::Min<int64>(DataStreamBlockBytes, TotalSize - int64(Block) * DataStreamBlockBytes));
+	}
+
+	FBlockSlot& GetSlot(uint32 Block)
+	{
+		return Slots[Block % Slots.Num()];
+	}
+
+	void ReceivedAck(int32 AckPacketId)
+	{
+		for (uint32 Block = BaseBlock; Block < NextBlock; Block++)
+		{
+			FBlockSlot& Slot = GetSlot(Block);
+			if (!Slot.bAcked && Slot.PacketId == AckPacketId)
+			{
+				Slot.bAcked = true;
+			}
+		}
+
+		while (BaseBlock < NextBlock && GetSlot(BaseBlock).bAcked)
+		{
+			GetSlot(BaseBlock) = FBlockSlot();
+			BaseBlock++;
+		}
+	}
+
+	void ReceivedNak(int32 NakPacketId)
+	{
+		for (uint32 Block = BaseBlock; Block < NextBlock; Block++)
+		{
+			FBlockSlot& Slot = GetSlot(Block);
+			if (!Slot.bAcked && Slot.PacketId == NakPacketId)
+			{
+				// Not in any packet anymore until resent
+				Slot.PacketId = INDEX_NONE;
+				ResendQueue.Add(Block);
+			}
+		}
+	}
+};
+
+/** Receiving side of one file, written in block order to <DataStreamDirectory>/<ContentId>.partial */
+struct FDataStreamInTransfer
+{
+	FGuid ContentId;
+	FString Name;
+	int64 TotalSize = 0;
+	uint32 NumBlocks = 0;
+
+	FString PartialFilename;
+	TUniquePtr<IFileHandle> FileHandle;
+
+	/** Blocks on disk, all of them before this one */
+	uint32 WrittenBlocks = 0;
+
+	/** Blocks that arrived ahead of WrittenBlocks, at most a window's worth */
+	TMap<uint32, TArray<uint8>> PendingBlocks;
+	int32 WindowBlocks = 0;
+
+	/** Opens (or reopens, to resume) the partial file. The sender then starts at WrittenBlocks. */
+	bool Begin(const FString& Directory, const FGuid& InContentId, int64 InTotalSize, const FString& InName, int32 InWindowBlocks)
+	{
+		ContentId = InContentId;
+		TotalSize = InTotalSize;
+
+		// The name comes from the remote side: never more than a file name in Directory
+		Name = FPaths::GetCleanFilename(InName);
+		if (Name.IsEmpty() || Name.StartsWith(TEXT(".")))
+		{
+			Name = ContentId.ToString();
+		}
+
+		NumBlocks = uint32(FMath::DivideAndRoundUp<int64>(TotalSize, DataStreamBlockBytes));
+		WindowBlocks = InWindowBlocks;
+		PendingBlocks.Reset();
+
+		IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+		PlatformFile.CreateDirectoryTree(*Directory);
+		PartialFilename = FPaths::Combine(Directory, ContentId.ToString() + TEXT(".partial"));
+
+		// Only whole blocks count: a block cut short by the interruption is simply written again
+		const int64 ExistingSize = FMath::Clamp<int64>(PlatformFile.FileSize(*PartialFilename), 0, TotalSize);
+		WrittenBlocks = uint32(ExistingSize / DataStreamBlockBytes);
+
+		FileHandle.Reset(PlatformFile.OpenWrite(*PartialFilename, true));
+		return FileHandle && FileHandle->Seek(int64(WrittenBlocks) * DataStreamBlockBytes);
+	}
+
+	bool IsComplete() const
+	{
+		return WrittenBlocks == NumBlocks;
+	}
+
+	/** Returns false if the block can't be part of this transfer */
+	bool ReceivedBlock(uint32 Block, const uint8* Data, int32 Size)
+	{
+		const int32 ExpectedSize = int32(FMath::Min<int64>(DataStreamBlockBytes, TotalSize - int64(Block) * DataStreamBlockBytes));
+		if (Block >= NumBlocks || Size != ExpectedSize || Block >= WrittenBlocks + uint32(WindowBlocks))
+		{
+			return false;
+		}
+
+		if (Block < WrittenBlocks || PendingBlocks.Contains(Block))
+		{
+			// Resent after the first copy made it after all
+			return true;
+		}
+
+		if (Block != WrittenBlocks)
+		{
+			PendingBlocks.Add(Block, TArray<uint8>(Data, Size));
+			return true;
+		}
+
+		if (!FileHandle->Write(Data, Size))
+		{
+			return false;
+		}
+		WrittenBlocks++;
+
+		TArray<uint8> Pending;
+		while (PendingBlocks.RemoveAndCopyValue(WrittenBlocks, Pending))
+		{
+			if (!FileHandle->Write(Pending.GetData(), Pending.Num()))
+			{
+				return false;
+			}
+			WrittenBlocks++;
+		}
+		return true;
+	}
+
+	/** Moves the finished file to <Directory>/<Name>. Returns its path, or an empty string on failure. */
+	FString Finish(const FString& Directory)
+	{
+		FileHandle.Reset();
+
+		IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+		const FString Filename = FPaths::Combine(Directory, Name);
+		PlatformFile.DeleteFile(*Filename);
+		return PlatformFile.MoveFile(*Filename, *PartialFilename) ? Filename : FString();
+	}
+};
@@ -0,0 +1,151 @@
+
+
+/**
+ * Selective retransmission of large reliable bunches.
+ *
+ * The regular partial bunch path (PartialInitial / Partial / PartialFinal) retransmits the whole bunch when any packet
+ * carrying one of its pieces is NAKed. With fragments, every piece is tracked by itself:
+ *	- The sender remembers which packet each fragment last went out in, and on a NAK resends only the fragments of that packet.
+ *	- The receiver copies each fragment straight into a buffer sized for the whole bunch, in whatever order fragments arrive,
+ *	  and hands the bunch to the channel once every fragment is in.
+ *
+ * Fragments of one bunch share a TransferId. The reassembled bunch carries the original ChSequence, so reliable ordering
+ * between bunches works exactly as before.
+ */
+
+/** Fragment header, written after the regular bunch header when FOutBunch::bFragment is set */
+struct FBunchFragmentHeader
+{
+	uint16 TransferId = 0;
+	uint32 FragmentIndex = 0;
+	uint32 FragmentCount = 0;
+
+	/**
+	 * Size of the whole bunch, so the receiver can allocate the reassembly buffer from any fragment. In bits: the reassembled
+	 * bunch must end where the original did, not on the byte boundary, or ReceivedBunch reads the padding as more content.
+	 */
+	uint32 TotalBits = 0;
+
+	/** What fragments and the reassembly buffer are sized and validated in */
+	uint32 GetTotalBytes() const
+	{
+		return FMath::DivideAndRoundUp<uint32>(TotalBits, 8);
+	}
+
+	void Serialize(FArchive& Ar)
+	{
+		Ar << TransferId;
+		Ar.SerializeIntPacked(FragmentIndex);
+		Ar.SerializeIntPacked(FragmentCount);
+		Ar.SerializeIntPacked(TotalBits);
+	}
+};
+
+/** Sender side of one fragmented bunch, kept until every fragment is ACKed */
+struct FOutgoingFragmentedBunch
+{
+	FBunchFragmentHeader Header;
+	int32 ChSequence = 0;
+
+	/** The whole bunch, fragments are slices of it */
+	TArray<uint8> Payload;
+
+	/** Packet each fragment was last sent in */
+	TArray<int32> FragmentPacketIds;
+
+	TBitArray<> AckedFragments;
+	int32 NumAcked = 0;
+
+	int32 GetFragmentOffset(int32 FragmentIndex, int32 FragmentBytes) const
+	{
+		return FragmentIndex * FragmentBytes;
+	}
+
+	int32 GetFragmentSize(int32 FragmentIndex, int32 FragmentBytes) const
+	{
+		return FMath::Min(FragmentBytes, Payload.Num() - FragmentIndex * FragmentBytes);
+	}
+
+	bool IsComplete() const
+	{
+		return NumAcked == Header.FragmentCount;
+	}
+};
+
+/** Receiver side of one fragmented bunch */
+struct FIncomingFragmentedBunch
+{
+	FBunchFragmentHeader Header;
+	int32 ChSequence = 0;
+
+	/** Sized to Header.GetTotalBytes() when the first fragment (any index) arrives */
+	TArray<uint8> Buffer;
+
+	TBitArray<> ReceivedFragments;
+	uint32 NumReceived = 0;
+
+	/** When the last new fragment came in, to give up on transfers the sender stopped sending */
+	double LastFragmentTime = 0.0;
+
+	void Init(const FBunchFragmentHeader& InHeader, int32 InChSequence, double Now)
+	{
+		Header = InHeader;
+		ChSequence = InChSequence;
+		Buffer.SetNumUninitialized(Header.GetTotalBytes());
+		ReceivedFragments.Init(false, Header.FragmentCount);
+		NumReceived = 0;
+		LastFragmentTime = Now;
+	}
+
+	enum class EAddResult : uint8
+	{
+		Incomplete,
+		Complete,
+
+		/** The fragment contradicts the transfer (header, size or position): the sender is broken or malicious */
+		Invalid,
+	};
+
+	/**
+	 * Every fragment but the last must be exactly FragmentBytes and the last one must end the bunch, so a complete set of
+	 * fragments always covers the whole buffer.
+	 */
+	EAddResult AddFragment(const FBunchFragmentHeader& FragmentHeader, int32 InChSequence, const uint8* Data, int32 Size, int32 FragmentBytes, double Now)
+	{
+		if (FragmentHeader.TotalBits != Header.TotalBits || FragmentHeader.FragmentCount != Header.FragmentCount || InChSequence != ChSequence)
+		{
+			return EAddResult::Invalid;
+		}
+
+		const uint32 FragmentIndex = FragmentHeader.FragmentIndex;
+		if (FragmentIndex >= Header.FragmentCount)
+		{
+			return EAddResult::Invalid;
+		}
+
+		const uint32 Offset = FragmentIndex * uint32(FragmentBytes);
+		const uint32 ExpectedSize = FMath::Min(uint32(FragmentBytes), Header.GetTotalBytes() - Offset);
+		if (Size < 0 || uint32(Size) != ExpectedSize)
+		{
+			return EAddResult::Invalid;
+		}
+
+		if (ReceivedFragments[FragmentIndex])
+		{
+			// Resent after the first copy made it after all
+			return EAddResult::Incomplete;
+		}
+
+		FMemory::Memcpy(Buffer.GetData() + Offset, Data, Size);
+		ReceivedFragments[FragmentIndex] = true;
+		LastFragmentTime = Now;
+		return ++NumReceived == Header.FragmentCount ? EAddResult::Complete : EAddResult::Incomplete;
+	}
+};
+
+/** Bytes resent because of NAKs, and what the whole-bunch scheme would have resent for the same losses */
+struct FFragmentRetransmitStats
+{
+	uint64 FragmentBytesResent = 0;
+	uint64 WholeBunchBytesEquivalent = 0;
+};
@@ -0,0 +1,245 @@
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Net Buffer Slices"), STAT_NetBufferSlices, STATGROUP_Net);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Net Buffer Slab Allocs"), STAT_NetBufferSlabAllocs, STATGROUP_Net);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Net Buffer Slabs Recycled"), STAT_NetBufferSlabsRecycled, STATGROUP_Net);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Net Buffer Pinned Bytes"), STAT_NetBufferPinnedBytes, STATGROUP_Net);
+
+/** Fixed-size block the pool bump-allocates slices from. Recycled as a whole once no slice references it. */
+struct FNetBufferSlab
+{
+	/** A few packets' worth: a slab pinned by one un-ACKed reliable bunch holds little else with it. Slices never exceed a packet. */
+	static constexpr int32 SlabSize = 16 * 1024;
+
+	uint8 Memory[SlabSize];
+	int32 Used = 0;
+
+	/** Live slices pointing into Memory. Only touched by the owning connection, on the game thread. */
+	int32 RefCount = 0;
+
+	/** The pool was destroyed while slices still referenced the slab: the last slice deletes it */
+	bool bOrphaned = false;
+};
+
+/**
+ * Refcounted view of bytes in a slab. Copying a slice shares the bytes, so a bunch payload can be packed into a packet and
+ * kept in the un-ACKed reliable list without being copied again.
+ */
+class FNetBufferSlice
+{
+public:
+
+	FNetBufferSlice() = default;
+
+	FNetBufferSlice(FNetBufferSlab* InSlab, uint8* InData, int32 InSize)
+		: Slab(InSlab), Data(InData), Size(InSize)
+	{
+		Slab->RefCount++;
+	}
+
+	FNetBufferSlice(const FNetBufferSlice& Other)
+		: Slab(Other.Slab), Data(Other.Data), Size(Other.Size)
+	{
+		if (Slab)
+		{
+			Slab->RefCount++;
+		}
+	}
+
+	FNetBufferSlice(FNetBufferSlice&& Other)
+		: Slab(Other.Slab), Data(Other.Data), Size(Other.Size)
+	{
+		Other.Slab = nullptr;
+		Other.Data = nullptr;
+		Other.Size = 0;
+	}
+
+	FNetBufferSlice& operator=(FNetBufferSlice Other)
+	{
+		Swap(Slab, Other.Slab);
+		Swap(Data, Other.Data);
+		Swap(Size, Other.Size);
+		return *this;
+	}
+
+	~FNetBufferSlice()
+	{
+		if (Slab && --Slab->RefCount == 0 && Slab->bOrphaned)
+		{
+			delete Slab;
+		}
+	}
+
+	uint8* GetData() const
+	{
+		return Data;
+	}
+
+	int32 Num() const
+	{
+		return Size;
+	}
+
+	bool IsValid() const
+	{
+		return Slab != nullptr;
+	}
+
+private:
+
+	FNetBufferSlab* Slab = nullptr;
+	uint8* Data = nullptr;
+	int32 Size = 0;
+};
+
+/**
+ * Per-connection arena for outgoing bunch and packet bytes.
+ *
+ * Slices are bump-allocated from the current slab, which keeps being filled across ticks (and starts over once nothing
+ * references it), so a connection sending little doesn't start a slab every tick. Full slabs are retired: at the end of
+ * TickFlush those nothing references anymore go back to the free list, those still holding un-ACKed reliable data wait
+ * until their last slice is released. Steady state makes no allocator calls at all.
+ */
+class FNetBufferPool
+{
+public:
+
+	/** Most free slabs kept around, anything above is given back to the allocator */
+	int32 MaxFreeSlabs = 8;
+
+	~FNetBufferPool()
+	{
+		for (FNetBufferSlab* Slab : FreeSlabs)
+		{
+			delete Slab;
+		}
+
+		// Channels release their slices in CleanUp, so anything still referenced here outlived its connection's channels
+		for (TArray<FNetBufferSlab*>* Slabs : { &RetiredSlabs, &ActiveSlabs })
+		{
+			for (FNetBufferSlab* Slab : *Slabs)
+			{
+				if (Slab->RefCount == 0)
+				{
+					delete Slab;
+				}
+				else
+				{
+					ensureMsgf(false, TEXT("FNetBufferPool destroyed with %d live slices in a slab"), Slab->RefCount);
+					Slab->bOrphaned = true;
+				}
+			}
+		}
+	}
+
+	FNetBufferSlice Allocate(int32 Size)
+	{
+		check(Size <= FNetBufferSlab::SlabSize);
+
+		FNetBufferSlab* Slab = ActiveSlabs.Num() > 0 ? ActiveSlabs.Last() : nullptr;
+		if (!Slab || Slab->Used + Size > FNetBufferSlab::SlabSize)
+		{
+			Slab = GetFreeSlab();
+			ActiveSlabs.Add(Slab);
+		}
+
+		uint8* Data = Slab->Memory + Slab->Used;
+		Slab->Used += Align(Size, 8);
+
+		TickStats.NumSlices++;
+		return FNetBufferSlice(Slab, Data, Size);
+	}
+
+	FNetBufferSlice AllocateAndCopy(const uint8* Src, int32 Size)
+	{
+		FNetBufferSlice Slice = Allocate(Size);
+		FMemory::Memcpy(Slice.GetData(), Src, Size);
+		return Slice;
+	}
+
+	/** Called after TickFlush: releases the tick's working set in bulk */
+	void EndTick()
+	{
+		// The current slab is kept for the next tick, from the start if nothing in it is referenced anymore
+		FNetBufferSlab* CurrentSlab = ActiveSlabs.Num() > 0 ? ActiveSlabs.Pop(false) : nullptr;
+		if (CurrentSlab && CurrentSlab->RefCount == 0)
+		{
+			CurrentSlab->Used = 0;
+		}
+
+		RetiredSlabs.Append(ActiveSlabs);
+		ActiveSlabs.Reset();
+		if (CurrentSlab)
+		{
+			ActiveSlabs.Add(CurrentSlab);
+		}
+
+		for (int32 i = RetiredSlabs.Num() - 1; i >= 0; i--)
+		{
+			FNetBufferSlab* Slab = RetiredSlabs[i];
+			if (Slab->RefCount == 0)
+			{
+				RetiredSlabs.RemoveAtSwap(i, 1, false);
+				TickStats.NumSlabsRecycled++;
+
+				if (FreeSlabs.Num() < MaxFreeSlabs)
+				{
+					Slab->Used = 0;
+					FreeSlabs.Add(Slab);
+				}
+				else
+				{
+					delete Slab;
+				}
+			}
+		}
+
+		// Whole slabs kept alive only by un-ACKed slices in them
+		TickStats.PinnedBytes = RetiredSlabs.Num() * FNetBufferSlab::SlabSize;
+
+		INC_DWORD_STAT_BY(STAT_NetBufferSlices, TickStats.NumSlices);
+		INC_DWORD_STAT_BY(STAT_NetBufferSlabAllocs, TickStats.NumSlabAllocs);
+		INC_DWORD_STAT_BY(STAT_NetBufferSlabsRecycled, TickStats.NumSlabsRecycled);
+		INC_DWORD_STAT_BY(STAT_NetBufferPinnedBytes, TickStats.PinnedBytes);
+		LastTickStats = TickStats;
+		TickStats = FStats();
+	}
+
+	struct FStats
+	{
+		/** Slices handed out (no allocator call) */
+		uint32 NumSlices = 0;
+
+		/** Actual allocator calls */
+		uint32 NumSlabAllocs = 0;
+
+		uint32 NumSlabsRecycled = 0;
+
+		/** Bytes of retired slabs still referenced by un-ACKed reliable bunches, at the end of the tick */
+		uint32 PinnedBytes = 0;
+	};
+
+	FStats LastTickStats;
+
+private:
+
+	FNetBufferSlab* GetFreeSlab()
+	{
+		if (FreeSlabs.Num() > 0)
+		{
+			return FreeSlabs.Pop(false);
+		}
+
+		TickStats.NumSlabAllocs++;
+		return new FNetBufferSlab();
+	}
+
+	FStats TickStats;
+
+	/** Slabs allocated from this tick, the last one is the current slab and carries over to the next */
+	TArray<FNetBufferSlab*> ActiveSlabs;
+
+	/** Slabs from earlier ticks still referenced (un-ACKed reliable bunches) */
+	TArray<FNetBufferSlab*> RetiredSlabs;
+
+	TArray<FNetBufferSlab*> FreeSlabs;
+};
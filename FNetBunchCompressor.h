@@ -0,0 +1,372 @@
+
+/** Carries a new compression model to the remote side: model id, then the 256 normalized symbol frequencies */
+DEFINE_CONTROL_CHANNEL_MESSAGE(BunchCompressionModel, 30, uint8, TArray<uint16>);
+
+/** Receiver installed the model with this id; the sender may encode with it from now on */
+DEFINE_CONTROL_CHANNEL_MESSAGE(BunchCompressionModelAck, 32, uint8);
+
+/**
+ * Entropy coding of actor bunch payloads, per connection.
+ *
+ * Payload bytes are rANS coded with an order-0 byte model. Models adapt to the connection's own traffic, and both sides
+ * must decode with exactly the model the bunch was encoded with, whatever got lost on the way:
+ *	- Every compressed bunch names its model id (one of NumModelSlots).
+ *	- The sender counts the bytes it sends. Every ModelUpdateBytes it builds a new model and sends it reliably
+ *	  (NMT_BunchCompressionModel), but keeps encoding with the old one until the receiver answers with
+ *	  NMT_BunchCompressionModelAck, sent once it installed the model. A packet ACK isn't enough: the control bunch
+ *	  may still be waiting in the receiver's InRec behind a lost one.
+ *	- Only bunches that go out whole are compressed, and they are decoded as they come off the packet, before any
+ *	  reordering. Packets are processed in order, so a bunch is always decoded with the models as they were when it was sent.
+ *	- A slot isn't rebuilt while un-ACKed reliable bunches encoded with it may still be resent (see AddSendModelRef).
+ *	- So a bunch never references a model the receiver doesn't have, or no longer has, reliable or not.
+ *
+ * Model 0 can be trained offline on recorded traffic and shipped in config, so a connection compresses from its first bunch.
+ * Without it nothing is compressed until the first adaptive model is acknowledged.
+ */
+class FNetBunchCompressor
+{
+public:
+
+	static constexpr int32 ProbBits = 12;
+	static constexpr uint32 ProbScale = 1 << ProbBits;
+	static constexpr int32 NumModelSlots = 4;
+
+	/** Bytes sent between two model updates */
+	int32 ModelUpdateBytes = 64 * 1024;
+
+	struct FModel
+	{
+		uint16 Freqs[256];
+		uint16 CumFreqs[257];
+		uint8 SlotToSymbol[ProbScale];
+		bool bValid = false;
+
+		/** Normalizes byte counts so they sum to ProbScale, every symbol keeping a non-zero frequency */
+		void BuildFromCounts(const uint32 (&Counts)[256])
+		{
+			uint64 Total = 0;
+			for (uint32 Count : Counts)
+			{
+				Total += Count;
+			}
+
+			uint32 Sum = 0;
+			for (int32 Symbol = 0; Symbol < 256; Symbol++)
+			{
+				Freqs[Symbol] = uint16(FMath::Max<uint64>(1, Total > 0 ? uint64(Counts[Symbol]) * ProbScale / Total : ProbScale / 256));
+				Sum += Freqs[Symbol];
+			}
+
+			// Rounding (and the symbols raised to 1) leave Sum slightly off, take it from / give it to the most frequent symbols
+			while (Sum != ProbScale)
+			{
+				int32 MaxSymbol = 0;
+				for (int32 Symbol = 1; Symbol < 256; Symbol++)
+				{
+					MaxSymbol = Freqs[Symbol] > Freqs[MaxSymbol] ? Symbol : MaxSymbol;
+				}
+
+				if (Sum > ProbScale)
+				{
+					Freqs[MaxSymbol]--;
+					Sum--;
+				}
+				else
+				{
+					Freqs[MaxSymbol] += ProbScale - Sum;
+					Sum = ProbScale;
+				}
+			}
+
+			BuildTables();
+		}
+
+		/** Receiver side, from NMT_BunchCompressionModel. Returns false for a malformed model. */
+		bool InitFromFreqs(const TArray<uint16>& InFreqs)
+		{
+			uint32 Sum = 0;
+			for (uint16 Freq : InFreqs)
+			{
+				Sum += Freq;
+				if (Freq == 0)
+				{
+					return false;
+				}
+			}
+
+			if (InFreqs.Num() != 256 || Sum != ProbScale)
+			{
+				return false;
+			}
+
+			FMemory::Memcpy(Freqs, InFreqs.GetData(), sizeof(Freqs));
+			BuildTables();
+			return true;
+		}
+
+		void BuildTables()
+		{
+			CumFreqs[0] = 0;
+			for (int32 Symbol = 0; Symbol < 256; Symbol++)
+			{
+				CumFreqs[Symbol + 1] = CumFreqs[Symbol] + Freqs[Symbol];
+				FMemory::Memset(SlotToSymbol + CumFreqs[Symbol], uint8(Symbol), Freqs[Symbol]);
+			}
+			bValid = true;
+		}
+	};
+
+	struct FStats
+	{
+		uint64 RawBytes = 0;
+		uint64 CompressedBytes = 0;
+		uint64 EncodeCycles = 0;
+		uint64 DecodedBytes = 0;
+		uint64 DecodeCycles = 0;
+
+		/** Bunches sent raw because coding didn't make them smaller */
+		uint32 NumIncompressible = 0;
+
+		/** Bunches that failed to decode (corrupt, or a model we never got) */
+		uint32 NumDecodeErrors = 0;
+
+		double GetCompressionRatio() const
+		{
+			return RawBytes > 0 ? double(CompressedBytes) / double(RawBytes) : 1.0;
+		}
+
+		double GetEncodeNsPerByte() const
+		{
+			return RawBytes > 0 ? FPlatformTime::ToSeconds64(EncodeCycles) * 1e9 / double(RawBytes) : 0.0;
+		}
+
+		double GetDecodeNsPerByte() const
+		{
+			return DecodedBytes > 0 ? FPlatformTime::ToSeconds64(DecodeCycles) * 1e9 / double(DecodedBytes) : 0.0;
+		}
+	};
+
+	FStats Stats;
+
+	/** Model 0 on both sides, from frequencies trained offline. Must be identical on client and server. */
+	void InitPretrainedModel(const TArray<uint16>& PretrainedFreqs)
+	{
+		if (PretrainedFreqs.Num() > 0 && SendModels[0].InitFromFreqs(PretrainedFreqs))
+		{
+			ReceiveModels[0] = SendModels[0];
+			ActiveSendModel = 0;
+		}
+	}
+
+	/**
+	 * Encodes Data with the active model into OutCompressed (model id, then the rANS stream).
+	 * Returns false if there is no usable model yet, or the result isn't smaller or exceeds MaxCompressedBytes, in which
+	 * case the bunch goes out raw.
+	 */
+	bool Compress(const uint8* Data, int32 NumBytes, int32 MaxCompressedBytes, TArray<uint8>& OutCompressed)
+	{
+		for (int32 i = 0; i < NumBytes; i++)
+		{
+			TrainingCounts[Data[i]]++;
+		}
+		BytesSinceModelUpdate += NumBytes;
+
+		if (ActiveSendModel == INDEX_NONE || NumBytes == 0)
+		{
+			return false;
+		}
+
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+		const FModel& Model = SendModels[ActiveSendModel];
+
+		// Worst case is 12 bits per byte, plus the final state
+		EncodeScratch.SetNumUninitialized(NumBytes * 3 / 2 + 8, false);
+		uint8* const End = EncodeScratch.GetData() + EncodeScratch.Num();
+		uint8* Ptr = End;
+
+		// rANS encodes back to front, so the decoder reads front to back
+		uint32 State = RansLowerBound;
+		for (int32 i = NumBytes - 1; i >= 0; i--)
+		{
+			const uint32 Freq = Model.Freqs[Data[i]];
+			const uint32 StateMax = ((RansLowerBound >> ProbBits) << 8) * Freq;
+			while (State >= StateMax)
+			{
+				*--Ptr = uint8(State & 0xff);
+				State >>= 8;
+			}
+			State = ((State / Freq) << ProbBits) + (State % Freq) + Model.CumFreqs[Data[i]];
+		}
+
+		Ptr -= 4;
+		Ptr[0] = uint8(State);
+		Ptr[1] = uint8(State >> 8);
+		Ptr[2] = uint8(State >> 16);
+		Ptr[3] = uint8(State >> 24);
+
+		const int32 CompressedSize = int32(End - Ptr);
+		Stats.EncodeCycles += FPlatformTime::Cycles64() - StartCycles;
+
+		if (CompressedSize + 1 >= NumBytes || CompressedSize + 1 > MaxCompressedBytes)
+		{
+			Stats.NumIncompressible++;
+			Stats.RawBytes += NumBytes;
+			Stats.CompressedBytes += NumBytes;
+			return false;
+		}
+
+		OutCompressed.Reset(CompressedSize + 1);
+		OutCompressed.Add(uint8(ActiveSendModel));
+		OutCompressed.Append(Ptr, CompressedSize);
+
+		Stats.RawBytes += NumBytes;
+		Stats.CompressedBytes += OutCompressed.Num();
+		return true;
+	}
+
+	/** Decodes a payload written by the remote's Compress into OutData (NumBytes, known from the bunch). */
+	bool Decompress(const uint8* Compressed, int32 CompressedSize, uint8* OutData, int32 NumBytes)
+	{
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+
+		if (CompressedSize < 5 || Compressed[0] >= NumModelSlots || !ReceiveModels[Compressed[0]].bValid)
+		{
+			Stats.NumDecodeErrors++;
+			return false;
+		}
+
+		const FModel& Model = ReceiveModels[Compressed[0]];
+		const uint8* Ptr = Compressed + 1;
+		const uint8* const End = Compressed + CompressedSize;
+
+		uint32 State = uint32(Ptr[0]) | (uint32(Ptr[1]) << 8) | (uint32(Ptr[2]) << 16) | (uint32(Ptr[3]) << 24);
+		Ptr += 4;
+
+		for (int32 i = 0; i < NumBytes; i++)
+		{
+			const uint32 Slot = State & (ProbScale - 1);
+			const uint8 Symbol = Model.SlotToSymbol[Slot];
+			OutData[i] = Symbol;
+
+			State = Model.Freqs[Symbol] * (State >> ProbBits) + Slot - Model.CumFreqs[Symbol];
+			while (State < RansLowerBound)
+			{
+				if (Ptr == End)
+				{
+					Stats.NumDecodeErrors++;
+					return false;
+				}
+				State = (State << 8) | *Ptr++;
+			}
+		}
+
+		// A well formed stream ends back at the encoder's initial state, with every byte consumed
+		if (State != RansLowerBound || Ptr != End)
+		{
+			Stats.NumDecodeErrors++;
+			return false;
+		}
+
+		Stats.DecodedBytes += NumBytes;
+		Stats.DecodeCycles += FPlatformTime::Cycles64() - StartCycles;
+		return true;
+	}
+
+	/**
+	 * Sender: builds the next model once enough bytes went by. Returns true with the model to send reliably; the caller then
+	 * calls ActivatePendingModel once the receiver acknowledged it with NMT_BunchCompressionModelAck.
+	 */
+	bool BuildPendingModel(uint8& OutModelId, TArray<uint16>& OutFreqs)
+	{
+		if (PendingSendModel != INDEX_NONE || BytesSinceModelUpdate < ModelUpdateBytes)
+		{
+			return false;
+		}
+
+		// Never overwrite the model in use, nor one a reliable bunch waiting for its ACK was encoded with: its resends
+		// carry the same bytes. If every other slot is still referenced, try again on a later tick.
+		const int32 FirstSlot = ActiveSendModel == INDEX_NONE ? 0 : ActiveSendModel;
+		for (int32 Offset = 1; Offset <= NumModelSlots && PendingSendModel == INDEX_NONE; Offset++)
+		{
+			const int32 Slot = (FirstSlot + Offset) % NumModelSlots;
+			if (Slot != ActiveSendModel && SendModelRefs[Slot] == 0)
+			{
+				PendingSendModel = Slot;
+			}
+		}
+
+		if (PendingSendModel == INDEX_NONE)
+		{
+			return false;
+		}
+
+		SendModels[PendingSendModel].BuildFromCounts(TrainingCounts);
+
+		// Decay, so the model follows the traffic as the match changes
+		for (uint32& Count : TrainingCounts)
+		{
+			Count >>= 1;
+		}
+		BytesSinceModelUpdate = 0;
+
+		OutModelId = uint8(PendingSendModel);
+		OutFreqs = TArray<uint16>(SendModels[PendingSendModel].Freqs, 256);
+		return true;
+	}
+
+	/** Sender: NMT_BunchCompressionModelAck arrived. Returns false for an id we have no update in flight for. */
+	bool ActivatePendingModel(uint8 ModelId)
+	{
+		if (PendingSendModel == INDEX_NONE || ModelId != PendingSendModel)
+		{
+			return false;
+		}
+
+		ActiveSendModel = PendingSendModel;
+		PendingSendModel = INDEX_NONE;
+		return true;
+	}
+
+	bool HasPendingModel() const
+	{
+		return PendingSendModel != INDEX_NONE;
+	}
+
+	/** A reliable bunch encoded with ModelId went into OutRec. Released when it's ACKed or its channel is cleaned up. */
+	void AddSendModelRef(uint8 ModelId)
+	{
+		check(ModelId < NumModelSlots);
+		SendModelRefs[ModelId]++;
+	}
+
+	void ReleaseSendModelRef(uint8 ModelId)
+	{
+		check(ModelId < NumModelSlots && SendModelRefs[ModelId] > 0);
+		SendModelRefs[ModelId]--;
+	}
+
+	/** Receiver: NMT_BunchCompressionModel arrived. The caller answers with NMT_BunchCompressionModelAck if it returns true. */
+	bool ReceivedModel(uint8 ModelId, const TArray<uint16>& Freqs)
+	{
+		return ModelId < NumModelSlots && ReceiveModels[ModelId].InitFromFreqs(Freqs);
+	}
+
+private:
+
+	static constexpr uint32 RansLowerBound = 1u << 23;
+
+	/** Models we encode with, and the ones the remote side told us it encodes with */
+	FModel SendModels[NumModelSlots];
+	FModel ReceiveModels[NumModelSlots];
+
+	int32 ActiveSendModel = INDEX_NONE;
+	int32 PendingSendModel = INDEX_NONE;
+
+	/** Un-ACKed reliable bunches encoded with each send model */
+	int32 SendModelRefs[NumModelSlots] = {};
+
+	uint32 TrainingCounts[256] = {};
+	int32 BytesSinceModelUpdate = 0;
+
+	TArray<uint8> EncodeScratch;
+};
@@ -0,0 +1,210 @@
+
+/**
+ * Delay-based (LEDBAT style) send rate controller for a UNetConnection.
+ *
+ * The rate NMT_NetSpeed negotiates is only the ceiling. Below it, the rate follows what the path can take:
+ *	- BaseRtt is the lowest RTT seen over the last BaseRttWindow seconds, i.e. the RTT with empty queues.
+ *	- QueuingDelay is how far recent RTT samples sit above BaseRtt.
+ *	- Once per round trip the rate moves towards keeping QueuingDelay at TargetQueuingDelay: up while the queues are
+ *	  below target (and we actually used the rate), down when they're above.
+ *	- A NAK backs the rate off multiplicatively, at most once per round trip.
+ *
+ * Samples come from the connection's existing ACK / NAK notifications, see UNetConnection::ReceivedAck / ReceivedNak.
+ */
+class FNetCongestionController
+{
+public:
+
+	/** Queuing delay we aim for, in seconds. Lower keeps latency down at the cost of throughput on noisy paths. */
+	float TargetQueuingDelay = 0.025f;
+
+	/** Largest relative rate change per round trip, when furthest off target */
+	float RateGain = 0.25f;
+
+	/** Rate multiplier applied on loss */
+	float LossBackoff = 0.7f;
+
+	/** How long a BaseRtt sample is trusted, in seconds. Route changes can raise the real base RTT. */
+	float BaseRttWindow = 10.f;
+
+	/** Bytes per second */
+	int32 MinRate = 1800;
+
+	void Init(int32 InMaxRate, double Now)
+	{
+		MaxRate = InMaxRate;
+		Rate = FMath::Clamp(InMaxRate / 4, MinRate, MaxRate);
+		RoundStartTime = Now;
+		FMemory::Memzero(SentPackets, sizeof(SentPackets));
+	}
+
+	/** NMT_NetSpeed (or the server's MaxClientRate) changed the ceiling */
+	void SetMaxRate(int32 InMaxRate)
+	{
+		MaxRate = FMath::Max(InMaxRate, MinRate);
+		Rate = FMath::Min(Rate, MaxRate);
+	}
+
+	int32 GetRate() const
+	{
+		return Rate;
+	}
+
+	/** False until Init: the rate is 0 and must not be applied to the connection */
+	bool IsInitialized() const
+	{
+		return MaxRate > 0;
+	}
+
+	void OnPacketSent(int32 PacketId, int32 NumBytes, double Now)
+	{
+		FSentPacket& Sent = SentPackets[PacketId & (MaxTrackedPackets - 1)];
+		Sent.PacketId = PacketId;
+		Sent.SendTime = Now;
+		Sent.NumBytes = NumBytes;
+
+		RoundBytesSent += NumBytes;
+	}
+
+	void OnPacketAcked(int32 PacketId, double Now)
+	{
+		FSentPacket* Sent = FindSentPacket(PacketId);
+		if (!Sent)
+		{
+			return;
+		}
+
+		AddRttSample(Now - Sent->SendTime, Now);
+		Stats.BytesAcked += Sent->NumBytes;
+		Sent->PacketId = INDEX_NONE;
+
+		MaybeEndRound(Now);
+	}
+
+	void OnPacketNaked(int32 PacketId, double Now)
+	{
+		if (FSentPacket* Sent = FindSentPacket(PacketId))
+		{
+			Stats.BytesLost += Sent->NumBytes;
+			Sent->PacketId = INDEX_NONE;
+		}
+
+		// One back-off per round trip, however many packets a single burst of loss took
+		if (!bBackedOffThisRound)
+		{
+			Rate = FMath::Max(MinRate, int32(Rate * LossBackoff));
+			bBackedOffThisRound = true;
+			Stats.NumLossBackoffs++;
+		}
+
+		MaybeEndRound(Now);
+	}
+
+	double GetQueuingDelay() const
+	{
+		return BaseRtt > 0.0 ? FMath::Max(0.0, RecentRtt - BaseRtt) : 0.0;
+	}
+
+	struct FStats
+	{
+		/** Goodput is BytesAcked over time, compare against a fixed NetSpeed run under the same emulated loss / lag */
+		uint64 BytesAcked = 0;
+		uint64 BytesLost = 0;
+		uint32 NumLossBackoffs = 0;
+
+		/** Smoothed queuing delay, in seconds */
+		double AvgQueuingDelay = 0.0;
+	};
+
+	FStats Stats;
+
+private:
+
+	static constexpr int32 MaxTrackedPackets = 256;
+	static constexpr int32 NumRecentRttSamples = 4;
+
+	struct FSentPacket
+	{
+		int32 PacketId;
+		int32 NumBytes;
+		double SendTime;
+	};
+
+	FSentPacket* FindSentPacket(int32 PacketId)
+	{
+		FSentPacket& Sent = SentPackets[PacketId & (MaxTrackedPackets - 1)];
+		return Sent.PacketId == PacketId && Sent.SendTime > 0.0 ? &Sent : nullptr;
+	}
+
+	void AddRttSample(double Rtt, double Now)
+	{
+		// Two bucket windowed min: the previous window's min stays valid until the current window has been running a full window
+		if (Now - BaseRttWindowStart > BaseRttWindow)
+		{
+			PreviousWindowMinRtt = CurrentWindowMinRtt;
+			CurrentWindowMinRtt = Rtt;
+			BaseRttWindowStart = Now;
+		}
+		else if (CurrentWindowMinRtt <= 0.0 || Rtt < CurrentWindowMinRtt)
+		{
+			CurrentWindowMinRtt = Rtt;
+		}
+		BaseRtt = PreviousWindowMinRtt > 0.0 ? FMath::Min(PreviousWindowMinRtt, CurrentWindowMinRtt) : CurrentWindowMinRtt;
+
+		// Min of the last few samples filters out one-off delays (a late ACK, a long frame on the remote side)
+		RecentRttSamples[NextRecentRttSample++ % NumRecentRttSamples] = Rtt;
+		RecentRtt = Rtt;
+		for (double Sample : RecentRttSamples)
+		{
+			if (Sample > 0.0)
+			{
+				RecentRtt = FMath::Min(RecentRtt, Sample);
+			}
+		}
+
+		Stats.AvgQueuingDelay += (GetQueuingDelay() - Stats.AvgQueuingDelay) / 16.0;
+	}
+
+	void MaybeEndRound(double Now)
+	{
+		const double RoundTime = Now - RoundStartTime;
+		if (RecentRtt <= 0.0 || RoundTime < RecentRtt)
+		{
+			return;
+		}
+
+		if (!bBackedOffThisRound)
+		{
+			const float OffTarget = FMath::Clamp(float((TargetQueuingDelay - GetQueuingDelay()) / TargetQueuingDelay), -1.f, 1.f);
+
+			// Don't grow a rate we aren't using, or an idle connection would come back with a rate the path never carried
+			const bool bAppLimited = RoundBytesSent < 0.5 * Rate * RoundTime;
+			if (OffTarget < 0.f || !bAppLimited)
+			{
+				Rate = FMath::Clamp(int32(Rate * (1.f + RateGain * OffTarget)), MinRate, MaxRate);
+			}
+		}
+
+		RoundStartTime = Now;
+		RoundBytesSent = 0;
+		bBackedOffThisRound = false;
+	}
+
+	FSentPacket SentPackets[MaxTrackedPackets];
+
+	int32 Rate = 0;
+	int32 MaxRate = 0;
+
+	double BaseRtt = 0.0;
+	double BaseRttWindowStart = 0.0;
+	double CurrentWindowMinRtt = 0.0;
+	double PreviousWindowMinRtt = 0.0;
+
+	double RecentRttSamples[NumRecentRttSamples] = {};
+	int32 NextRecentRttSample = 0;
+	double RecentRtt = 0.0;
+
+	double RoundStartTime = 0.0;
+	int64 RoundBytesSent = 0;
+	bool bBackedOffThisRound = false;
+};
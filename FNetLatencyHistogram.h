@@ -0,0 +1,46 @@
+
+/**
+ * Log2-bucketed histogram of latencies, cheap enough to record every bunch.
+ * Bucket 0 is < 1ms, bucket N is [2^(N-1), 2^N) ms, the last bucket holds everything above.
+ */
+struct FNetLatencyHistogram
+{
+	static constexpr int32 NumBuckets = 12;
+
+	uint32 Buckets[NumBuckets] = {};
+	uint32 NumSamples = 0;
+	double TotalSeconds = 0.0;
+	double MaxSeconds = 0.0;
+
+	void AddSample(double Seconds)
+	{
+		const uint32 Milliseconds = uint32(FMath::Max(Seconds, 0.0) * 1000.0);
+		const int32 Bucket = Milliseconds == 0 ? 0 : FMath::Min<int32>(FMath::FloorLog2(Milliseconds) + 1, NumBuckets - 1);
+
+		Buckets[Bucket]++;
+		NumSamples++;
+		TotalSeconds += Seconds;
+		MaxSeconds = FMath::Max(MaxSeconds, Seconds);
+	}
+
+	/** Upper bound, in seconds, of the bucket containing the given percentile (0..1) */
+	double GetPercentileUpperBound(float Percentile) const
+	{
+		const uint32 Target = uint32(FMath::CeilToInt(NumSamples * Percentile));
+		uint32 Count = 0;
+		for (int32 Bucket = 0; Bucket < NumBuckets; Bucket++)
+		{
+			Count += Buckets[Bucket];
+			if (Count >= Target)
+			{
+				return Bucket == NumBuckets - 1 ? MaxSeconds : double(1 << Bucket) / 1000.0;
+			}
+		}
+		return MaxSeconds;
+	}
+
+	void Reset()
+	{
+		*this = FNetLatencyHistogram();
+	}
+};
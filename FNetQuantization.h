@@ -0,0 +1,128 @@
+
+/**
+ * Declarative quantization of replicated FVector / FRotator properties.
+ *
+ * Instead of changing a property's type to one of the FVector_NetQuantize* structs, a class declares the precision it needs
+ * next to the property's replication condition:
+ *
+ *	void AMyActor::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+ *	{
+ *		DOREPLIFETIME_QUANTIZED_VECTOR(AMyActor, TargetLocation, EVectorQuantization::RoundOneDecimal);
+ *		DOREPLIFETIME_QUANTIZED_ROTATOR(AMyActor, AimRotation, ERotatorQuantization::ShortComponents);
+ *	}
+ *
+ * FRepLayout::InitFromClass flags the property's command (ERepLayoutCmdFlags::IsQuantized) after calling
+ * GetLifetimeReplicatedProps, and FRepLayout::NetSerializeItem then sends and receives it through NetSerializeQuantized
+ * instead of the full precision path. Same packing as FRepMovement uses for its quantization levels.
+ */
+
+struct FNetQuantizationParams
+{
+	enum class EType : uint8
+	{
+		Vector,
+		Rotator,
+	};
+
+	EType Type = EType::Vector;
+	EVectorQuantization VectorQuantization = EVectorQuantization::RoundWholeNumber;
+	ERotatorQuantization RotatorQuantization = ERotatorQuantization::ByteComponents;
+};
+
+inline bool SerializeQuantizedVector(FArchive& Ar, FVector& Vector, EVectorQuantization Quantization)
+{
+	switch (Quantization)
+	{
+		case EVectorQuantization::RoundTwoDecimals:
+			return SerializePackedVector<100, 30>(Vector, Ar);
+
+		case EVectorQuantization::RoundOneDecimal:
+			return SerializePackedVector<10, 27>(Vector, Ar);
+
+		default:
+			return SerializePackedVector<1, 24>(Vector, Ar);
+	}
+}
+
+inline void SerializeQuantizedRotator(FArchive& Ar, FRotator& Rotator, ERotatorQuantization Quantization)
+{
+	if (Quantization == ERotatorQuantization::ShortComponents)
+	{
+		Rotator.SerializeCompressedShort(Ar);
+	}
+	else
+	{
+		Rotator.SerializeCompressed(Ar);
+	}
+}
+
+/** Quantization declared per replicated property. Filled from GetLifetimeReplicatedProps, read by FRepLayout (see RepLayout.h). */
+class FNetQuantizationRegistry
+{
+public:
+
+	static FNetQuantizationRegistry& Get()
+	{
+		static FNetQuantizationRegistry Registry;
+		return Registry;
+	}
+
+	void Register(const UClass* Class, FName PropertyName, const FNetQuantizationParams& Params)
+	{
+		const FProperty* Property = FindFProperty<FProperty>(Class, PropertyName);
+		check(Property);
+
+		FScopeLock Lock(&CriticalSection);
+		Entries.Add(Property, Params);
+	}
+
+	const FNetQuantizationParams* Find(const FProperty* Property) const
+	{
+		FScopeLock Lock(&CriticalSection);
+		return Entries.Find(Property);
+	}
+
+	/** Returns false if the property has no declared quantization and must go through its regular NetSerialize */
+	bool NetSerializeQuantized(FArchive& Ar, const FProperty* Property, void* Data, bool& bOutSuccess) const
+	{
+		const FNetQuantizationParams* Params = Find(Property);
+		if (!Params)
+		{
+			return false;
+		}
+
+		if (Params->Type == FNetQuantizationParams::EType::Vector)
+		{
+			bOutSuccess = SerializeQuantizedVector(Ar, *(FVector*)Data, Params->VectorQuantization);
+		}
+		else
+		{
+			SerializeQuantizedRotator(Ar, *(FRotator*)Data, Params->RotatorQuantization);
+			bOutSuccess = true;
+		}
+		return true;
+	}
+
+private:
+
+	mutable FCriticalSection CriticalSection;
+	TMap<const FProperty*, FNetQuantizationParams> Entries;
+};
+
+#define DOREPLIFETIME_QUANTIZED_VECTOR(c, v, q) \
+{ \
+	DOREPLIFETIME(c, v); \
+	FNetQuantizationParams QuantizationParams; \
+	QuantizationParams.Type = FNetQuantizationParams::EType::Vector; \
+	QuantizationParams.VectorQuantization = q; \
+	FNetQuantizationRegistry::Get().Register(c::StaticClass(), GET_MEMBER_NAME_CHECKED(c, v), QuantizationParams); \
+}
+
+#define DOREPLIFETIME_QUANTIZED_ROTATOR(c, v, q) \
+{ \
+	DOREPLIFETIME(c, v); \
+	FNetQuantizationParams QuantizationParams; \
+	QuantizationParams.Type = FNetQuantizationParams::EType::Rotator; \
+	QuantizationParams.RotatorQuantization = q; \
+	FNetQuantizationRegistry::Get().Register(c::StaticClass(), GET_MEMBER_NAME_CHECKED(c, v), QuantizationParams); \
+}
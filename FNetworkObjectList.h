@@ -0,0 +1,199 @@
+
+
+/** Per-actor replication bookkeeping kept by the net driver, shared by all of its connections */
+struct FNetworkObjectInfo
+{
+	/** Pointer to the replicated actor. */
+	AActor* Actor;
+
+	/** Next time to consider replicating the actor. Based on FPlatformTime::Seconds(). */
+	double NextUpdateTime;
+
+	/** Last absolute time in seconds since actor actually sent something during replication */
+	double LastNetReplicateTime;
+
+	/** Optimal delta between replication updates based on how frequently actor properties are actually changing */
+	float OptimalNetUpdateDelta;
+
+	/** Number of considerations in a row that found nothing to send. Drives the exponential back-off. */
+	uint32 ConsecutiveIdleUpdates;
+
+	/** UNetDriver::ReplicationFrame the actor was last considered in, from the consider lists or popped by a connection's scheduler */
+	uint32 ConsideredFrame;
+
+	/** Set by any connection whose ReplicateActor sent something this frame. Game thread only, parallel tasks don't replicate. */
+	uint8 bReplicatedThisFrame:1;
+
+	/** Set by ForceNetUpdate (property dirtied, RPC) so the back-off doesn't grow again before the change was sent */
+	uint8 bPendingNetUpdate:1;
+
+	/** bOnlyRelevantToOwner actor found through UNetDriver::OwnerOnlyActorsByRoot instead of the shared consider list */
+	uint8 bOwnerOnlyIndexed:1;
+
+	/** Indexed owner-only actor that is due this frame. Only written before connections replicate. */
+	uint8 bOwnerOnlyDue:1;
+
+	/** Instigator at the time the actor was indexed, so a change can be noticed */
+	const AActor* IndexedInstigator;
+
+	/** Keys the actor is under in UNetDriver::OwnerOnlyActorsByRoot, so it can be moved without a rebuild. Null if not indexed. */
+	const AActor* IndexedRoot;
+	const AActor* IndexedInstigatorRoot;
+
+	/** Connections this actor's channel is parked on. Once it holds every connection the actor leaves the active list. */
+	TSet<TWeakObjectPtr<UNetConnection>> DormantConnections;
+
+	/** Put to sleep by UNetDriver::AutoDormancyIdleUpdates rather than by game code, so ForceNetUpdate wakes it */
+	uint8 bAutoDormant:1;
+
+	/** FAdaptiveNetUpdateStats::Epoch this actor was last counted in NumActorsBackedOff */
+	uint32 BackedOffStatsEpoch;
+
+	/** When the actor would next be due at NetUpdateFrequency, so each backed-off interval counts one avoided call */
+	double NextFullRateDueTime;
+
+	FNetworkObjectInfo(AActor* InActor)
+		: Actor(InActor)
+		, NextUpdateTime(0.0)
+		, LastNetReplicateTime(0.0)
+		, OptimalNetUpdateDelta(0.f)
+		, ConsecutiveIdleUpdates(0)
+		, ConsideredFrame(0)
+		, bReplicatedThisFrame(false)
+		, bPendingNetUpdate(false)
+		, bOwnerOnlyIndexed(false)
+		, bOwnerOnlyDue(false)
+		, IndexedInstigator(nullptr)
+		, IndexedRoot(nullptr)
+		, IndexedInstigatorRoot(nullptr)
+		, bAutoDormant(false)
+		, BackedOffStatsEpoch(0)
+		, NextFullRateDueTime(0.0)
+	{
+	}
+};
+
+/**
+ * Every replicated actor of a net driver. Only ActiveNetworkObjects is walked each frame: an actor dormant on every
+ * connection (or placed in the map and DORM_Initial) costs nothing until it's flushed.
+ */
+class FNetworkObjectList
+{
+public:
+
+	typedef TSet<TSharedPtr<FNetworkObjectInfo>, FNetworkObjectKeyFuncs> FNetworkObjectSet;
+
+	TSharedPtr<FNetworkObjectInfo>* FindOrAdd(AActor* const Actor, UNetDriver* NetDriver, bool* OutWasAdded = nullptr);
+
+	TSharedPtr<FNetworkObjectInfo> Find(AActor* const Actor);
+
+	const FNetworkObjectSet& GetActiveObjects() const
+	{
+		return ActiveNetworkObjects;
+	}
+
+	/** Including the ones dormant on every connection */
+	const FNetworkObjectSet& GetAllObjects() const
+	{
+		return AllNetworkObjects;
+	}
+
+	/** Channel of Actor parked on Connection. Moves the actor out of the active list once that's every connection. */
+	void MarkDormant(AActor* const Actor, UNetConnection* const Connection, const int32 NumConnections)
+	{
+		TSharedPtr<FNetworkObjectInfo>* InfoPtr = AllNetworkObjects.Find(Actor);
+		if (!InfoPtr)
+		{
+			return;
+		}
+
+		FNetworkObjectInfo* ActorInfo = InfoPtr->Get();
+		ActorInfo->DormantConnections.Add(Connection);
+
+		if (ActorInfo->DormantConnections.Num() >= NumConnections)
+		{
+			MarkDormantOnAllConnections(*InfoPtr);
+		}
+	}
+
+	/** Not dormant anywhere anymore */
+	void MarkActive(AActor* const Actor)
+	{
+		if (TSharedPtr<FNetworkObjectInfo>* InfoPtr = AllNetworkObjects.Find(Actor))
+		{
+			(*InfoPtr)->DormantConnections.Reset();
+			ObjectsDormantOnAllConnections.Remove(*InfoPtr);
+			ActiveNetworkObjects.Add(*InfoPtr);
+		}
+	}
+
+	/** Also used directly for placed DORM_Initial actors, which clients already have from the map */
+	void MarkDormantOnAllConnections(const TSharedPtr<FNetworkObjectInfo>& InfoPtr)
+	{
+		ActiveNetworkObjects.Remove(InfoPtr);
+		ObjectsDormantOnAllConnections.Add(InfoPtr);
+	}
+
+	/** The new connection has no channel for anything yet: everything dormant on all the others is active again for it */
+	void HandleConnectionAdded()
+	{
+		for (auto It = ObjectsDormantOnAllConnections.CreateIterator(); It; ++It)
+		{
+			if ((*It)->Actor->NetDormancy != DORM_Initial)
+			{
+				ActiveNetworkObjects.Add(*It);
+				It.RemoveCurrent();
+			}
+		}
+	}
+
+	/** Drops the connection from every dormancy set, which may leave actors dormant on all the remaining connections */
+	void HandleConnectionRemoved(UNetConnection* const Connection, const int32 NumRemainingConnections)
+	{
+		for (auto It = ActiveNetworkObjects.CreateIterator(); It; ++It)
+		{
+			FNetworkObjectInfo* ActorInfo = It->Get();
+			ActorInfo->DormantConnections.Remove(Connection);
+			if (ActorInfo->DormantConnections.Num() > 0 && ActorInfo->DormantConnections.Num() >= NumRemainingConnections)
+			{
+				ObjectsDormantOnAllConnections.Add(*It);
+				It.RemoveCurrent();
+			}
+		}
+
+		for (const TSharedPtr<FNetworkObjectInfo>& InfoPtr : ObjectsDormantOnAllConnections)
+		{
+			InfoPtr->DormantConnections.Remove(Connection);
+		}
+	}
+
+private:
+
+	FNetworkObjectSet AllNetworkObjects;
+	FNetworkObjectSet ActiveNetworkObjects;
+	FNetworkObjectSet ObjectsDormantOnAllConnections;
+};
+
+/** Counters for the adaptive net update frequency, reset every time they're reported */
+struct FAdaptiveNetUpdateStats
+{
+	/** Distinct actors that would have been due at NetUpdateFrequency but were backed off, at least once since the last report */
+	uint32 NumActorsBackedOff = 0;
+
+	/** ReplicateActor calls not made because of that: one per client connection each time a backed-off actor passes a full-rate interval */
+	uint32 NumAvoidedReplicateActorCalls = 0;
+
+	/** Backed-off actors that were snapped back to full rate by ForceNetUpdate */
+	uint32 NumSnapBacks = 0;
+
+	/** Bumped by every Reset, so an actor backed off over several frames is only counted once per report */
+	uint32 Epoch = 1;
+
+	/** Called once the counters have been reported */
+	void Reset()
+	{
+		const uint32 NextEpoch = Epoch + 1;
+		*this = FAdaptiveNetUpdateStats();
+		Epoch = NextEpoch;
+	}
+};
@@ -0,0 +1,131 @@
+
+
+/**
+ * Holds packets that arrived ahead of a gap in packet sequence numbers, so the missing packets get a chance to show up
+ * (possibly in a later frame) before we treat them as dropped. See "Detecting Incoming Dropped Packets" in UNetDriver.h.
+ *
+ * Fixed capacity, indexed by packet id modulo capacity, all packet storage allocated up front.
+ * Packet ids are UNetConnection's extended InPacketId space, not the 14-bit wrapping header sequence, so id + 1 is always
+ * the next packet.
+ * A packet is held while it is within WindowPackets of the last processed packet and younger than WindowSeconds.
+ */
+class FPacketReorderBuffer
+{
+public:
+
+	/** Must be a power of two, and at least the largest window */
+	static constexpr int32 Capacity = 32;
+
+	struct FSlot
+	{
+		int32 PacketId = INDEX_NONE;
+		int64 NumBits = 0;
+		double ReceiveTime = 0.0;
+		uint8 Data[MAX_PACKET_SIZE];
+	};
+
+	struct FStats
+	{
+		/** Packets held because of a gap */
+		uint32 NumBuffered = 0;
+
+		/** Missing packets that arrived while we were still waiting for them */
+		uint32 NumRecovered = 0;
+
+		/** Missing packets we gave up on (window exceeded or timed out) */
+		uint32 NumDropped = 0;
+	};
+
+	void Init(int32 InWindowPackets, float InWindowSeconds)
+	{
+		WindowPackets = FMath::Clamp(InWindowPackets, 1, Capacity);
+		WindowSeconds = InWindowSeconds;
+	}
+
+	int32 GetWindowPackets() const
+	{
+		return WindowPackets;
+	}
+
+	bool IsEmpty() const
+	{
+		return NumHeld == 0;
+	}
+
+	/** Stores a packet that arrived PacketSequenceDelta (> 1, <= WindowPackets) ahead of the last processed one */
+	void Add(int32 PacketId, const uint8* Data, int64 NumBits, double Now)
+	{
+		FSlot& Slot = Slots[PacketId & (Capacity - 1)];
+		if (Slot.PacketId == PacketId)
+		{
+			// Duplicate
+			return;
+		}
+
+		check(Slot.PacketId == INDEX_NONE);
+		Slot.PacketId = PacketId;
+		Slot.NumBits = NumBits;
+		Slot.ReceiveTime = Now;
+		FMemory::Memcpy(Slot.Data, Data, FMath::DivideAndRoundUp<int64>(NumBits, 8));
+
+		OldestReceiveTime = NumHeld == 0 ? Now : FMath::Min(OldestReceiveTime, Now);
+		NumHeld++;
+		Stats.NumBuffered++;
+	}
+
+	/** Returns the held packet with PacketId, or nullptr. The slot stays valid until Release. */
+	const FSlot* Find(int32 PacketId) const
+	{
+		const FSlot& Slot = Slots[PacketId & (Capacity - 1)];
+		return Slot.PacketId == PacketId ? &Slot : nullptr;
+	}
+
+	/** Lowest held packet id after LastProcessedId, for giving up on a gap. INDEX_NONE if empty. */
+	int32 FindNextHeld(int32 LastProcessedId) const
+	{
+		for (int32 Offset = 1; Offset <= Capacity && NumHeld > 0; Offset++)
+		{
+			if (Find(LastProcessedId + Offset))
+			{
+				return LastProcessedId + Offset;
+			}
+		}
+		return INDEX_NONE;
+	}
+
+	void Release(int32 PacketId)
+	{
+		FSlot& Slot = Slots[PacketId & (Capacity - 1)];
+		check(Slot.PacketId == PacketId);
+		Slot.PacketId = INDEX_NONE;
+		NumHeld--;
+	}
+
+	bool HasExpired(double Now) const
+	{
+		return NumHeld > 0 && Now - OldestReceiveTime > WindowSeconds;
+	}
+
+	/** Call after releasing packets, so HasExpired looks at what's still held */
+	void UpdateOldestReceiveTime()
+	{
+		OldestReceiveTime = TNumericLimits<double>::Max();
+		for (const FSlot& Slot : Slots)
+		{
+			if (Slot.PacketId != INDEX_NONE)
+			{
+				OldestReceiveTime = FMath::Min(OldestReceiveTime, Slot.ReceiveTime);
+			}
+		}
+	}
+
+	FStats Stats;
+
+private:
+
+	FSlot Slots[Capacity];
+	int32 NumHeld = 0;
+	int32 WindowPackets = 8;
+	float WindowSeconds = 0.1f;
+	double OldestReceiveTime = 0.0;
+};
@@ -0,0 +1,361 @@
+
+#if PLATFORM_LINUX
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <errno.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#endif
+
+/** One datagram from a receive batch. Data points into FBatchedDatagramSocket's buffers and is valid until the next ReceiveBatch. */
+struct FReceivedDatagram
+{
+	TSharedPtr<FInternetAddr> FromAddr;
+	const uint8* Data = nullptr;
+	int32 Size = 0;
+};
+
+/**
+ * Moves many datagrams per syscall on a UDP socket, for UIpNetDriver.
+ *
+ * On Linux, receiving uses recvmmsg and sending uses sendmmsg. If the kernel supports UDP GSO (UDP_SEGMENT, 4.18+), runs of
+ * equally sized packets to the same address are handed to the kernel as one super-packet that it segments itself.
+ * Packets queued by every connection during TickFlush go out in a single Flush.
+ *
+ * If the kernel doesn't have recvmmsg / sendmmsg (ENOSYS), or on other platforms, the same interface falls back to one
+ * RecvFrom / SendTo per packet, so the net driver doesn't need two code paths.
+ * GSO is turned off for good the first time a segmented send fails with EIO: the setsockopt probe succeeds on kernels
+ * whose NIC driver or route (no checksum offload, some tunnels) can't actually segment.
+ */
+class FBatchedDatagramSocket
+{
+public:
+
+	static constexpr int32 BatchSize = 64;
+	static constexpr int32 MaxPacketSize = MAX_PACKET_SIZE;
+
+	/** Largest UDP GSO super-packet we'll build, the kernel limit is 64 segments / 64KB */
+	static constexpr int32 MaxGSOSegments = 32;
+
+	void Init(FSocket* InSocket, ISocketSubsystem* InSocketSubsystem, bool bTryGSO)
+	{
+		Socket = InSocket;
+		SocketSubsystem = InSocketSubsystem;
+
+#if PLATFORM_LINUX
+		NativeSocket = static_cast<FSocketBSD*>(Socket)->GetNativeSocket();
+		bBatchingSupported = true;
+
+		// Probing for GSO: older kernels reject the option outright
+		int32 GSOSize = 0;
+		bGSOSupported = bTryGSO && setsockopt(NativeSocket, SOL_UDP, UDP_SEGMENT, &GSOSize, sizeof(GSOSize)) == 0;
+
+		for (int32 i = 0; i < BatchSize; i++)
+		{
+			RecvIovecs[i].iov_base = RecvBuffers[i];
+			RecvIovecs[i].iov_len = MaxPacketSize;
+		}
+#endif
+	}
+
+	/** Reads up to BatchSize datagrams without blocking. Returns how many were written to OutDatagrams. */
+	int32 ReceiveBatch(FReceivedDatagram (&OutDatagrams)[BatchSize])
+	{
+#if PLATFORM_LINUX
+		if (bBatchingSupported)
+		{
+			for (int32 i = 0; i < BatchSize; i++)
+			{
+				FMemory::Memzero(RecvMsgs[i]);
+				RecvMsgs[i].msg_hdr.msg_name = &RecvAddrs[i];
+				RecvMsgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+				RecvMsgs[i].msg_hdr.msg_iov = &RecvIovecs[i];
+				RecvMsgs[i].msg_hdr.msg_iovlen = 1;
+			}
+
+			const int32 NumReceived = recvmmsg(NativeSocket, RecvMsgs, BatchSize, MSG_DONTWAIT, nullptr);
+			Stats.NumRecvSyscalls++;
+
+			if (NumReceived < 0)
+			{
+				if (errno == ENOSYS)
+				{
+					UE_LOG(LogNet, Log, TEXT("recvmmsg not supported by this kernel, falling back to one packet per syscall"));
+					bBatchingSupported = false;
+					return ReceiveOneByOne(OutDatagrams);
+				}
+				return 0;
+			}
+
+			for (int32 i = 0; i < NumReceived; i++)
+			{
+				OutDatagrams[i].FromAddr = ToInternetAddr(RecvAddrs[i]);
+				OutDatagrams[i].Data = RecvBuffers[i];
+				OutDatagrams[i].Size = RecvMsgs[i].msg_len;
+			}
+
+			Stats.NumPacketsReceived += NumReceived;
+			return NumReceived;
+		}
+#endif
+		return ReceiveOneByOne(OutDatagrams);
+	}
+
+	/** Copies the packet into the send queue. Nothing hits the socket until Flush. */
+	void QueueSend(const FInternetAddr& ToAddr, const uint8* Data, int32 Size)
+	{
+		check(Size <= MaxPacketSize);
+
+		if (QueuedSends.Num() == BatchSize * MaxGSOSegments)
+		{
+			Flush();
+		}
+
+		FQueuedSend& Send = QueuedSends.AddDefaulted_GetRef();
+		Send.ToAddr = ToAddr.Clone();
+		Send.Offset = SendBuffer.Num();
+		Send.Size = Size;
+		SendBuffer.Append(Data, Size);
+	}
+
+	/** Sends everything queued since the last Flush. Called once per TickFlush. */
+	void Flush()
+	{
+		if (QueuedSends.Num() == 0)
+		{
+			return;
+		}
+
+#if PLATFORM_LINUX
+		if (bBatchingSupported)
+		{
+			FlushBatched();
+		}
+		else
+#endif
+		{
+			SendOneByOne(0);
+		}
+
+		Stats.NumPacketsSent += QueuedSends.Num();
+		QueuedSends.Reset();
+		SendBuffer.Reset();
+	}
+
+	struct FStats
+	{
+		uint64 NumPacketsReceived = 0;
+		uint64 NumPacketsSent = 0;
+		uint64 NumRecvSyscalls = 0;
+		uint64 NumSendSyscalls = 0;
+
+		/** Messages sendmmsg refused, each lost like a failed SendTo */
+		uint64 NumSendErrors = 0;
+	};
+
+	FStats Stats;
+
+	bool IsBatchingSupported() const
+	{
+		return bBatchingSupported;
+	}
+
+	bool IsGSOSupported() const
+	{
+		return bGSOSupported;
+	}
+
+private:
+
+	struct FQueuedSend
+	{
+		TSharedPtr<FInternetAddr> ToAddr;
+		int32 Offset = 0;
+		int32 Size = 0;
+	};
+
+	int32 ReceiveOneByOne(FReceivedDatagram (&OutDatagrams)[BatchSize])
+	{
+		int32 NumReceived = 0;
+		while (NumReceived < BatchSize)
+		{
+			TSharedRef<FInternetAddr> FromAddr = SocketSubsystem->CreateInternetAddr();
+			int32 BytesRead = 0;
+
+			Stats.NumRecvSyscalls++;
+			if (!Socket->RecvFrom(RecvBuffers[NumReceived], MaxPacketSize, BytesRead, *FromAddr) || BytesRead == 0)
+			{
+				break;
+			}
+
+			OutDatagrams[NumReceived].FromAddr = FromAddr;
+			OutDatagrams[NumReceived].Data = RecvBuffers[NumReceived];
+			OutDatagrams[NumReceived].Size = BytesRead;
+			NumReceived++;
+		}
+
+		Stats.NumPacketsReceived += NumReceived;
+		return NumReceived;
+	}
+
+	/** QueuedSends from FirstSend on, one SendTo each */
+	void SendOneByOne(int32 FirstSend)
+	{
+		for (int32 SendIndex = FirstSend; SendIndex < QueuedSends.Num(); SendIndex++)
+		{
+			const FQueuedSend& Send = QueuedSends[SendIndex];
+			int32 BytesSent = 0;
+			Socket->SendTo(SendBuffer.GetData() + Send.Offset, Send.Size, BytesSent, *Send.ToAddr);
+			Stats.NumSendSyscalls++;
+		}
+	}
+
+#if PLATFORM_LINUX
+	void FlushBatched()
+	{
+		int32 SendIndex = 0;
+		while (SendIndex < QueuedSends.Num())
+		{
+			int32 NumMsgs = 0;
+			for (; NumMsgs < BatchSize && SendIndex < QueuedSends.Num(); NumMsgs++)
+			{
+				const FQueuedSend& First = QueuedSends[SendIndex];
+
+				// With GSO, a run of same-size packets to the same address (the last one may be shorter) becomes one message.
+				// Consecutive queued packets are contiguous in SendBuffer, so the run is one iovec.
+				int32 NumSegments = 1;
+				int32 RunSize = First.Size;
+				if (bGSOSupported)
+				{
+					while (SendIndex + NumSegments < QueuedSends.Num() && NumSegments < MaxGSOSegments)
+					{
+						const FQueuedSend& Next = QueuedSends[SendIndex + NumSegments];
+						const FQueuedSend& Prev = QueuedSends[SendIndex + NumSegments - 1];
+						if (Prev.Size != First.Size || Next.Size > First.Size || !Next.ToAddr->CompareEndpoints(*First.ToAddr))
+						{
+							break;
+						}
+						RunSize += Next.Size;
+						NumSegments++;
+					}
+				}
+
+				MsgFirstSend[NumMsgs] = SendIndex;
+				MsgNumSegments[NumMsgs] = NumSegments;
+
+				FromInternetAddr(*First.ToAddr, SendAddrs[NumMsgs], SendAddrLens[NumMsgs]);
+				SendIovecs[NumMsgs].iov_base = SendBuffer.GetData() + First.Offset;
+				SendIovecs[NumMsgs].iov_len = RunSize;
+
+				msghdr& Header = SendMsgs[NumMsgs].msg_hdr;
+				FMemory::Memzero(SendMsgs[NumMsgs]);
+				Header.msg_name = &SendAddrs[NumMsgs];
+				Header.msg_namelen = SendAddrLens[NumMsgs];
+				Header.msg_iov = &SendIovecs[NumMsgs];
+				Header.msg_iovlen = 1;
+
+				if (NumSegments > 1)
+				{
+					Header.msg_control = SendControl[NumMsgs];
+					Header.msg_controllen = CMSG_SPACE(sizeof(uint16));
+
+					cmsghdr* ControlMsg = CMSG_FIRSTHDR(&Header);
+					ControlMsg->cmsg_level = SOL_UDP;
+					ControlMsg->cmsg_type = UDP_SEGMENT;
+					ControlMsg->cmsg_len = CMSG_LEN(sizeof(uint16));
+					*reinterpret_cast<uint16*>(CMSG_DATA(ControlMsg)) = uint16(First.Size);
+				}
+
+				SendIndex += NumSegments;
+			}
+
+			int32 NumDone = 0;
+			while (NumDone < NumMsgs)
+			{
+				const int32 Result = sendmmsg(NativeSocket, SendMsgs + NumDone, NumMsgs - NumDone, 0);
+				Stats.NumSendSyscalls++;
+
+				if (Result < 0)
+				{
+					// sendmmsg stops at the first failing message, nothing from it on went out
+					if (errno == EINTR)
+					{
+						continue;
+					}
+
+					if (errno == ENOSYS)
+					{
+						UE_LOG(LogNet, Log, TEXT("sendmmsg not supported by this kernel, falling back to one packet per syscall"));
+						bBatchingSupported = false;
+						bGSOSupported = false;
+						SendOneByOne(MsgFirstSend[NumDone]);
+						return;
+					}
+
+					if (errno == EIO && MsgNumSegments[NumDone] > 1)
+					{
+						// Requeue from the failed message, unsegmented
+						UE_LOG(LogNet, Warning, TEXT("UDP GSO send failed with EIO, disabling GSO on this socket"));
+						bGSOSupported = false;
+						SendIndex = MsgFirstSend[NumDone];
+						break;
+					}
+
+					// One bad destination (ECONNREFUSED, EMSGSIZE, ENOBUFS...): that message is lost, same as a failed
+					// SendTo, the rest of the batch is mostly for other clients and still goes out
+					Stats.NumSendErrors++;
+					NumDone++;
+					continue;
+				}
+				NumDone += Result;
+			}
+		}
+	}
+
+	TSharedRef<FInternetAddr> ToInternetAddr(const sockaddr_storage& Storage) const
+	{
+		TSharedRef<FInternetAddr> Addr = SocketSubsystem->CreateInternetAddr();
+		static_cast<FInternetAddrBSD&>(Addr.Get()).SetIp(Storage);
+		return Addr;
+	}
+
+	static void FromInternetAddr(const FInternetAddr& Addr, sockaddr_storage& OutStorage, socklen_t& OutLen)
+	{
+		const FInternetAddrBSD& BSDAddr = static_cast<const FInternetAddrBSD&>(Addr);
+		OutStorage = BSDAddr.GetStorage();
+		OutLen = BSDAddr.GetStorageSize();
+	}
+
+	int NativeSocket = -1;
+
+	mmsghdr RecvMsgs[BatchSize];
+	iovec RecvIovecs[BatchSize];
+	sockaddr_storage RecvAddrs[BatchSize];
+
+	mmsghdr SendMsgs[BatchSize];
+	iovec SendIovecs[BatchSize];
+	sockaddr_storage SendAddrs[BatchSize];
+	socklen_t SendAddrLens[BatchSize];
+	alignas(cmsghdr) uint8 SendControl[BatchSize][CMSG_SPACE(sizeof(uint16))];
+
+	/** Index in QueuedSends of the first packet of each message, and how many packets it carries */
+	int32 MsgFirstSend[BatchSize];
+	int32 MsgNumSegments[BatchSize];
+#endif
+
+	FSocket* Socket = nullptr;
+	ISocketSubsystem* SocketSubsystem = nullptr;
+
+	bool bBatchingSupported = false;
+	bool bGSOSupported = false;
+
+	uint8 RecvBuffers[BatchSize][MaxPacketSize];
+
+	TArray<FQueuedSend> QueuedSends;
+
+	/** Packed payloads of QueuedSends, in queue order */
+	TArray<uint8> SendBuffer;
+};
@@ -0,0 +1,411 @@
+
+/** A piece of a broadcast record, relay to viewer: type, time, record size, offset of this piece, the piece's bytes */
+DEFINE_CONTROL_CHANNEL_MESSAGE(BroadcastRecord, 31, uint8, double, int32, int32, TArray<uint8>);
+
+/**
+ * Spectator fan-out.
+ *
+ * Spectators don't get a UNetConnection on the game server. The server records a single replay stream (frames and keyframes,
+ * see FReplayChunkFile.h) with UDemoNetDriver, as if for one spectator, and streams it to a USpectatorRelayNetDriver:
+ *
+ *	game server (UDemoNetDriver + FBroadcastStreamSender) --TCP--> relay (FBroadcastStreamReceiver) --NMT_BroadcastRecord--> viewers
+ *
+ * The relay is a separate process with no game world. It keeps the records since the last two keyframes, shared by every
+ * viewer, and each viewer only costs it a cursor into them plus its connection's reliability (acks and resends). Viewers
+ * join at the latest keyframe, and one that falls more than a keyframe interval behind skips ahead to the latest keyframe.
+ * On the viewer, UDemoNetDriver::PlayBroadcastRecord plays the records as they complete, like a replay.
+ */
+
+/** Record as it travels from the game server to the relay and is shared by all viewers there */
+struct FBroadcastRecord
+{
+	EReplayRecordType Type = EReplayRecordType::Frame;
+	double Time = 0.0;
+	TArray<uint8> Data;
+};
+
+/**
+ * Game server side: streams the recorded records to the relay over TCP, without ever blocking the game thread.
+ * If the relay doesn't keep up, frames are dropped until a resync keyframe can be sent, as FReplayWriteThread does for the disk.
+ */
+class FBroadcastStreamSender
+{
+public:
+
+	/** Bytes waiting for the socket before frames are dropped */
+	int32 MaxPendingBytes = 4 * 1024 * 1024;
+
+	~FBroadcastStreamSender()
+	{
+		Close();
+	}
+
+	bool Connect(const FString& RelayAddress)
+	{
+		ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+
+		TSharedPtr<FInternetAddr> Addr = SocketSubsystem->GetAddressFromString(RelayAddress);
+		if (!Addr.IsValid())
+		{
+			UE_LOG(LogNet, Warning, TEXT("FBroadcastStreamSender: invalid relay address %s"), *RelayAddress);
+			return false;
+		}
+
+		Socket = SocketSubsystem->CreateSocket(NAME_Stream, TEXT("BroadcastStream"), Addr->GetProtocolType());
+		if (!Socket)
+		{
+			return false;
+		}
+
+		Socket->SetNoDelay(true);
+		Socket->SetNonBlocking(true);
+		Socket->Connect(*Addr);
+		return true;
+	}
+
+	void Close()
+	{
+		if (Socket)
+		{
+			Socket->Close();
+			ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(Socket);
+			Socket = nullptr;
+		}
+	}
+
+	bool IsConnected() const
+	{
+		return Socket != nullptr;
+	}
+
+	bool IsReadyToResync() const
+	{
+		return bDroppingFrames && GetNumPendingBytes() <= MaxPendingBytes / 2;
+	}
+
+	/** Returns false if the record was dropped for backpressure */
+	bool QueueRecord(EReplayRecordType Type, double Time, const uint8* Data, int32 Num)
+	{
+		if (bDroppingFrames)
+		{
+			if (Type == EReplayRecordType::Frame || !IsReadyToResync())
+			{
+				Stats.NumFramesDropped += Type == EReplayRecordType::Frame ? 1 : 0;
+				return false;
+			}
+			Type = EReplayRecordType::ResyncKeyframe;
+			bDroppingFrames = false;
+		}
+		else if (GetNumPendingBytes() + Num > MaxPendingBytes)
+		{
+			UE_LOG(LogNet, Warning, TEXT("FBroadcastStreamSender: relay is %d bytes behind, dropping frames until the next keyframe"), GetNumPendingBytes());
+			bDroppingFrames = true;
+			Stats.NumFramesDropped += Type == EReplayRecordType::Frame ? 1 : 0;
+			return false;
+		}
+
+		// Same framing as records in a replay chunk
+		FReplayRecord::Append(PendingBytes, Type, Time, Data, Num);
+		return true;
+	}
+
+	/** Sends as much as the socket takes right now. Called once per frame, after the frame's records are queued. */
+	void Flush()
+	{
+		if (Socket && Socket->GetConnectionState() == SCS_ConnectionError)
+		{
+			UE_LOG(LogNet, Warning, TEXT("FBroadcastStreamSender: can't reach the relay"));
+			Close();
+		}
+
+		while (Socket && SentOffset < PendingBytes.Num())
+		{
+			int32 BytesSent = 0;
+			if (!Socket->Send(PendingBytes.GetData() + SentOffset, PendingBytes.Num() - SentOffset, BytesSent))
+			{
+				const ESocketErrors Error = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->GetLastErrorCode();
+				if (Error != SE_EWOULDBLOCK && Error != SE_ENOTCONN)
+				{
+					UE_LOG(LogNet, Warning, TEXT("FBroadcastStreamSender: lost the relay (%d)"), int32(Error));
+					Close();
+				}
+				break;
+			}
+
+			if (BytesSent == 0)
+			{
+				break;
+			}
+			SentOffset += BytesSent;
+			Stats.BytesSent += BytesSent;
+		}
+
+		// Compact once most of the buffer is sent, rather than moving bytes on every partial send
+		if (SentOffset > 0 && SentOffset >= PendingBytes.Num() / 2)
+		{
+			PendingBytes.RemoveAt(0, SentOffset, false);
+			SentOffset = 0;
+		}
+	}
+
+	struct FStats
+	{
+		uint64 BytesSent = 0;
+		uint32 NumFramesDropped = 0;
+	};
+
+	FStats Stats;
+
+private:
+
+	int32 GetNumPendingBytes() const
+	{
+		return PendingBytes.Num() - SentOffset;
+	}
+
+	FSocket* Socket = nullptr;
+	TArray<uint8> PendingBytes;
+	int32 SentOffset = 0;
+	bool bDroppingFrames = false;
+};
+
+/** Relay side: accepts the game server's stream and cuts it back into records */
+class FBroadcastStreamReceiver
+{
+public:
+
+	~FBroadcastStreamReceiver()
+	{
+		Close();
+	}
+
+	bool Listen(int32 Port)
+	{
+		ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+
+		TSharedRef<FInternetAddr> Addr = SocketSubsystem->GetLocalBindAddr(*GLog);
+		Addr->SetPort(Port);
+
+		ListenSocket = SocketSubsystem->CreateSocket(NAME_Stream, TEXT("BroadcastStreamListen"), Addr->GetProtocolType());
+		if (!ListenSocket || !ListenSocket->Bind(*Addr) || !ListenSocket->Listen(1))
+		{
+			UE_LOG(LogNet, Warning, TEXT("FBroadcastStreamReceiver: can't listen on port %d"), Port);
+			Close();
+			return false;
+		}
+
+		ListenSocket->SetNonBlocking(true);
+		return true;
+	}
+
+	void Close()
+	{
+		ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+		for (FSocket** SocketPtr : { &StreamSocket, &ListenSocket })
+		{
+			if (*SocketPtr)
+			{
+				(*SocketPtr)->Close();
+				SocketSubsystem->DestroySocket(*SocketPtr);
+				*SocketPtr = nullptr;
+			}
+		}
+	}
+
+	/**
+	 * Reads what arrived and adds every record completed by it to OutRecords.
+	 * Returns true if a game server (re)connected, whose stream has nothing to do with what was received before.
+	 */
+	bool Receive(TArray<TSharedRef<const FBroadcastRecord>>& OutRecords)
+	{
+		bool bNewStream = false;
+		if (!StreamSocket)
+		{
+			bool bHasPendingConnection = false;
+			if (!ListenSocket || !ListenSocket->HasPendingConnection(bHasPendingConnection) || !bHasPendingConnection)
+			{
+				return false;
+			}
+
+			// One game server per relay
+			StreamSocket = ListenSocket->Accept(TEXT("BroadcastStream"));
+			if (!StreamSocket)
+			{
+				return false;
+			}
+			StreamSocket->SetNonBlocking(true);
+			ReceiveBuffer.Reset();
+			bNewStream = true;
+		}
+
+		uint32 PendingDataSize = 0;
+		while (StreamSocket->HasPendingData(PendingDataSize))
+		{
+			const int32 Pos = ReceiveBuffer.AddUninitialized(FMath::Min<uint32>(PendingDataSize, 256 * 1024));
+			int32 BytesRead = 0;
+			const bool bRead = StreamSocket->Recv(ReceiveBuffer.GetData() + Pos, ReceiveBuffer.Num() - Pos, BytesRead);
+			ReceiveBuffer.SetNum(Pos + (bRead ? BytesRead : 0), false);
+
+			if (!bRead || BytesRead == 0)
+			{
+				break;
+			}
+		}
+
+		int32 ReadPos = 0;
+		while (ReceiveBuffer.Num() - ReadPos >= FReplayRecord::HeaderSize)
+		{
+			FReplayRecord Header;
+			if (!Header.ReadHeader(ReceiveBuffer.GetData() + ReadPos))
+			{
+				UE_LOG(LogNet, Warning, TEXT("FBroadcastStreamReceiver: corrupt stream, waiting for the game server to reconnect"));
+				ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(StreamSocket);
+				StreamSocket = nullptr;
+				ReceiveBuffer.Reset();
+				return bNewStream;
+			}
+
+			if (ReceiveBuffer.Num() - ReadPos - FReplayRecord::HeaderSize < Header.Num)
+			{
+				break;
+			}
+
+			TSharedRef<FBroadcastRecord> Record = MakeShared<FBroadcastRecord>();
+			Record->Type = Header.Type;
+			Record->Time = Header.Time;
+			Record->Data.Append(Header.Data, Header.Num);
+			OutRecords.Add(Record);
+
+			ReadPos += FReplayRecord::HeaderSize + Header.Num;
+		}
+
+		ReceiveBuffer.RemoveAt(0, ReadPos, false);
+		return bNewStream;
+	}
+
+private:
+
+	FSocket* ListenSocket = nullptr;
+	FSocket* StreamSocket = nullptr;
+	TArray<uint8> ReceiveBuffer;
+};
+
+/**
+ * The records every viewer of a relay is served from. Starts at the second to last keyframe, so a viewer that is up to
+ * one keyframe interval behind can still finish what it's receiving.
+ */
+class FBroadcastRecordWindow
+{
+public:
+
+	/** Drops everything for a new stream. Indices keep growing, so viewer cursors into the old stream fall behind GetFirstIndex. */
+	void Reset()
+	{
+		FirstIndex = GetEndIndex();
+		Records.Reset();
+		LatestKeyframe = INDEX_NONE;
+		PreviousKeyframe = INDEX_NONE;
+	}
+
+	void Add(const TSharedRef<const FBroadcastRecord>& Record)
+	{
+		if (Record->Type == EReplayRecordType::Frame && LatestKeyframe == INDEX_NONE)
+		{
+			// Nothing to apply it to before the first keyframe
+			return;
+		}
+
+		if (Record->Type != EReplayRecordType::Frame)
+		{
+			if (PreviousKeyframe != INDEX_NONE)
+			{
+				Records.RemoveAt(0, PreviousKeyframe - FirstIndex, false);
+				FirstIndex = PreviousKeyframe;
+			}
+			PreviousKeyframe = LatestKeyframe;
+			LatestKeyframe = GetEndIndex();
+		}
+
+		Records.Add(Record);
+	}
+
+	/** Absolute index of the oldest record still held, and one past the newest */
+	int64 GetFirstIndex() const
+	{
+		return FirstIndex;
+	}
+
+	int64 GetEndIndex() const
+	{
+		return FirstIndex + Records.Num();
+	}
+
+	int64 GetLatestKeyframe() const
+	{
+		return LatestKeyframe;
+	}
+
+	const FBroadcastRecord& Get(int64 Index) const
+	{
+		return *Records[int32(Index - FirstIndex)];
+	}
+
+private:
+
+	TArray<TSharedRef<const FBroadcastRecord>> Records;
+	int64 FirstIndex = 0;
+	int64 LatestKeyframe = INDEX_NONE;
+	int64 PreviousKeyframe = INDEX_NONE;
+};
+
+/** One NMT_BroadcastRecord, cut from a record of the window */
+struct FBroadcastPiece
+{
+	uint8 Type = 0;
+	double Time = 0.0;
+	int32 RecordSize = 0;
+	int32 Offset = 0;
+	TArray<uint8> Data;
+};
+
+/** Where a viewer is in the relay's FBroadcastRecordWindow */
+struct FBroadcastViewer
+{
+	/** Record being cut into pieces and how much of it was, INDEX_NONE until the viewer is started on a keyframe */
+	int64 NextRecord = INDEX_NONE;
+	int32 NextOffset = 0;
+
+	/** The next record must be sent as a resync keyframe, the viewer skipped or never had what's before it */
+	bool bResync = true;
+
+	/** Cut by the viewer's task, sent in order on the game thread. What the connection didn't take waits for the next tick. */
+	TArray<FBroadcastPiece> PendingPieces;
+};
+
+/** Viewer side: puts NMT_BroadcastRecord pieces back together */
+struct FBroadcastRecordAssembler
+{
+	FBroadcastRecord Record;
+	int32 ExpectedSize = 0;
+
+	/** Returns true once Record is complete */
+	bool AddPiece(uint8 Type, double Time, int32 RecordSize, int32 Offset, const TArray<uint8>& Piece)
+	{
+		// A new record starts at offset 0, dropping whatever the relay cut short to skip this viewer ahead
+		if (Offset == 0)
+		{
+			Record.Type = EReplayRecordType(Type);
+			Record.Time = Time;
+			Record.Data.Reset(RecordSize);
+			ExpectedSize = RecordSize;
+		}
+
+		if (Offset != Record.Data.Num() || Offset + Piece.Num() > ExpectedSize)
+		{
+			return false;
+		}
+
+		Record.Data.Append(Piece);
+		return Record.Data.Num() == ExpectedSize;
+	}
+};
@@ -0,0 +1,282 @@
+
+/**
+ * Persistent per-connection replication schedule, replacing the rebuild + full sort of FActorPriority every tick.
+ *
+ * Every actor lives in one of two indexed min-heaps:
+ *	- Waiting, keyed on NextDueTime = LastReplicatedTime + 1 / NetUpdateFrequency. Not considered until it's due.
+ *	- Ready, keyed on an urgency deadline = DueTime - NetPriority * PriorityTimeScale. Higher NetPriority pops earlier.
+ *
+ * Each tick, due actors move from Waiting to Ready, and the connection pops only as many actors as it will process.
+ * Actors are only re-keyed when they replicate, or when NetPriority / NetUpdateFrequency change (UpdateActor).
+ * Anything popped but not sent (bandwidth saturated) goes back to Ready with its old key, so it's first in line next tick.
+ */
+class FNetPriorityScheduler
+{
+public:
+
+	/** Seconds of urgency one unit of NetPriority is worth when ordering actors that are due */
+	float PriorityTimeScale = 0.5f;
+
+	void AddActor(AActor* Actor, double Now)
+	{
+		if (ActorToEntry.Contains(Actor))
+		{
+			return;
+		}
+
+		const int32 EntryIndex = Entries.Add(FEntry());
+		FEntry& Entry = Entries[EntryIndex];
+		Entry.Actor = Actor;
+		Entry.LastReplicatedTime = Now;
+		ActorToEntry.Add(Actor, EntryIndex);
+
+		// New actors are due right away
+		SetKeys(Entry, Now);
+		HeapPush(Ready, EntryIndex, EHeap::Ready);
+	}
+
+	void RemoveActor(AActor* Actor)
+	{
+		int32 EntryIndex = INDEX_NONE;
+		if (ActorToEntry.RemoveAndCopyValue(Actor, EntryIndex))
+		{
+			FEntry& Entry = Entries[EntryIndex];
+			if (Entry.Heap != EHeap::None)
+			{
+				HeapRemove(Entry.Heap == EHeap::Ready ? Ready : Waiting, Entry.HeapIndex);
+			}
+			Entries.RemoveAt(EntryIndex);
+		}
+	}
+
+	/** NetPriority or NetUpdateFrequency changed, or the actor was force updated. Re-keys without waiting for the next replication. */
+	void UpdateActor(AActor* Actor, bool bForceDue = false)
+	{
+		if (const int32* EntryIndex = ActorToEntry.Find(Actor))
+		{
+			FEntry& Entry = Entries[*EntryIndex];
+			if (Entry.Heap == EHeap::None)
+			{
+				// Popped this tick, keys will be set by OnActorReplicated / EndTick
+				return;
+			}
+
+			HeapRemove(Entry.Heap == EHeap::Ready ? Ready : Waiting, Entry.HeapIndex);
+			SetKeys(Entry, bForceDue ? 0.0 : Entry.LastReplicatedTime);
+			HeapPush(Waiting, *EntryIndex, EHeap::Waiting);
+		}
+	}
+
+	/** Overrides 1 / NetUpdateFrequency for Actor, used by the adaptive net update frequency. Zero goes back to NetUpdateFrequency. */
+	void SetUpdateInterval(AActor* Actor, float UpdateInterval, bool bForceDue = false)
+	{
+		if (const int32* EntryIndex = ActorToEntry.Find(Actor))
+		{
+			Entries[*EntryIndex].UpdateInterval = UpdateInterval;
+			UpdateActor(Actor, bForceDue);
+		}
+	}
+
+	/** Pops up to MaxCount of the most urgent due actors, in priority order. Every popped actor must be resolved before EndTick. */
+	int32 PopDue(double Now, int32 MaxCount, TArray<AActor*>& OutActors)
+	{
+		while (Waiting.Num() > 0 && Entries[Waiting[0]].DueTime <= Now)
+		{
+			const int32 EntryIndex = Waiting[0];
+			HeapRemove(Waiting, 0);
+			HeapPush(Ready, EntryIndex, EHeap::Ready);
+		}
+
+		const int32 FirstOut = OutActors.Num();
+		while (Ready.Num() > 0 && OutActors.Num() - FirstOut < MaxCount)
+		{
+			const int32 EntryIndex = Ready[0];
+			HeapRemove(Ready, 0);
+			Popped.Add(EntryIndex);
+			OutActors.Add(Entries[EntryIndex].Actor);
+		}
+
+		return OutActors.Num() - FirstOut;
+	}
+
+	/** The actor was considered this tick (replicated, or found irrelevant). It waits a full update interval from Now. */
+	void OnActorReplicated(AActor* Actor, double Now)
+	{
+		if (const int32* EntryIndex = ActorToEntry.Find(Actor))
+		{
+			FEntry& Entry = Entries[*EntryIndex];
+			Entry.LastReplicatedTime = Now;
+
+			if (Entry.Heap == EHeap::None)
+			{
+				SetKeys(Entry, Now);
+				Entry.bResolved = true;
+			}
+			else
+			{
+				// Replicated without being popped
+				HeapRemove(Entry.Heap == EHeap::Ready ? Ready : Waiting, Entry.HeapIndex);
+				SetKeys(Entry, Now);
+				HeapPush(Waiting, *EntryIndex, EHeap::Waiting);
+			}
+		}
+	}
+
+	/** Puts every popped actor back. Actors that weren't resolved keep their key, so they stay at the front of Ready. */
+	void EndTick()
+	{
+		for (int32 EntryIndex : Popped)
+		{
+			// Removed while popped (and possibly the slot reused by an actor that is already in a heap)
+			if (!Entries.IsValidIndex(EntryIndex) || Entries[EntryIndex].Heap != EHeap::None)
+			{
+				continue;
+			}
+
+			FEntry& Entry = Entries[EntryIndex];
+			if (Entry.bResolved)
+			{
+				Entry.bResolved = false;
+				HeapPush(Waiting, EntryIndex, EHeap::Waiting);
+			}
+			else
+			{
+				HeapPush(Ready, EntryIndex, EHeap::Ready);
+			}
+		}
+		Popped.Reset();
+	}
+
+	int32 Num() const
+	{
+		return Entries.Num();
+	}
+
+private:
+
+	enum class EHeap : uint8
+	{
+		None,
+		Waiting,
+		Ready,
+	};
+
+	struct FEntry
+	{
+		AActor* Actor = nullptr;
+		double LastReplicatedTime = 0.0;
+		double DueTime = 0.0;
+		double UrgencyKey = 0.0;
+		float UpdateInterval = 0.f;
+		int32 HeapIndex = INDEX_NONE;
+		EHeap Heap = EHeap::None;
+		bool bResolved = false;
+	};
+
+	void SetKeys(FEntry& Entry, double LastReplicatedTime) const
+	{
+		const AActor* Actor = Entry.Actor;
+		const float UpdateInterval = Entry.UpdateInterval > 0.f ? Entry.UpdateInterval : 1.f / FMath::Max(Actor->NetUpdateFrequency, KINDA_SMALL_NUMBER);
+
+		Entry.DueTime = LastReplicatedTime + UpdateInterval;
+		Entry.UrgencyKey = Entry.DueTime - Actor->NetPriority * PriorityTimeScale;
+	}
+
+	double GetKey(int32 EntryIndex, EHeap Heap) const
+	{
+		const FEntry& Entry = Entries[EntryIndex];
+		return Heap == EHeap::Ready ? Entry.UrgencyKey : Entry.DueTime;
+	}
+
+	EHeap HeapOf(const TArray<int32>& Heap) const
+	{
+		return &Heap == &Ready ? EHeap::Ready : EHeap::Waiting;
+	}
+
+	void HeapPush(TArray<int32>& Heap, int32 EntryIndex, EHeap Which)
+	{
+		FEntry& Entry = Entries[EntryIndex];
+		Entry.Heap = Which;
+		Entry.HeapIndex = Heap.Add(EntryIndex);
+		SiftUp(Heap, Entry.HeapIndex);
+	}
+
+	void HeapRemove(TArray<int32>& Heap, int32 HeapIndex)
+	{
+		Entries[Heap[HeapIndex]].Heap = EHeap::None;
+		Entries[Heap[HeapIndex]].HeapIndex = INDEX_NONE;
+
+		const int32 Last = Heap.Num() - 1;
+		if (HeapIndex != Last)
+		{
+			Heap[HeapIndex] = Heap[Last];
+			Entries[Heap[HeapIndex]].HeapIndex = HeapIndex;
+			Heap.Pop(false);
+			SiftDown(Heap, SiftUp(Heap, HeapIndex));
+		}
+		else
+		{
+			Heap.Pop(false);
+		}
+	}
+
+	int32 SiftUp(TArray<int32>& Heap, int32 HeapIndex)
+	{
+		const EHeap Which = HeapOf(Heap);
+		while (HeapIndex > 0)
+		{
+			const int32 Parent = (HeapIndex - 1) / 2;
+			if (GetKey(Heap[Parent], Which) <= GetKey(Heap[HeapIndex], Which))
+			{
+				break;
+			}
+			Swap(Heap, HeapIndex, Parent);
+			HeapIndex = Parent;
+		}
+		return HeapIndex;
+	}
+
+	void SiftDown(TArray<int32>& Heap, int32 HeapIndex)
+	{
+		const EHeap Which = HeapOf(Heap);
+		for (;;)
+		{
+			const int32 Left = HeapIndex * 2 + 1;
+			const int32 Right = Left + 1;
+			int32 Smallest = HeapIndex;
+
+			if (Left < Heap.Num() && GetKey(Heap[Left], Which) < GetKey(Heap[Smallest], Which))
+			{
+				Smallest = Left;
+			}
+			if (Right < Heap.Num() && GetKey(Heap[Right], Which) < GetKey(Heap[Smallest], Which))
+			{
+				Smallest = Right;
+			}
+			if (Smallest == HeapIndex)
+			{
+				break;
+			}
+			Swap(Heap, HeapIndex, Smallest);
+			HeapIndex = Smallest;
+		}
+	}
+
+	void Swap(TArray<int32>& Heap, int32 A, int32 B)
+	{
+		Heap.Swap(A, B);
+		Entries[Heap[A]].HeapIndex = A;
+		Entries[Heap[B]].HeapIndex = B;
+	}
+
+	/** Sparse so entry indices stay stable while actors come and go */
+	TSparseArray<FEntry> Entries;
+	TMap<AActor*, int32> ActorToEntry;
+
+	/** Heaps of indices into Entries */
+	TArray<int32> Waiting;
+	TArray<int32> Ready;
+
+	/** Popped by PopDue this tick, put back in EndTick */
+	TArray<int32> Popped;
+};
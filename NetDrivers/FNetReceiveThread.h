@@ -0,0 +1,185 @@
+
+/** A packet slot of FNetReceiveRing. Allocated once, overwritten by the receive thread, read in place by TickDispatch. */
+struct FNetReceivedPacket
+{
+	uint8 Data[MAX_PACKET_SIZE];
+	int32 Size = 0;
+
+	/** FPlatformTime::Seconds() when the packet came off the socket */
+	double ReceiveTime = 0.0;
+
+	/** Preallocated too: RecvFrom writes the sender into it */
+	TSharedPtr<FInternetAddr> FromAddr;
+};
+
+/**
+ * Single producer / single consumer ring of preallocated packets.
+ * The receive thread is the only writer of Tail, the game thread the only writer of Head.
+ */
+class FNetReceiveRing
+{
+public:
+
+	void Init(int32 InCapacity, ISocketSubsystem* SocketSubsystem)
+	{
+		check(FMath::IsPowerOfTwo(InCapacity));
+		Capacity = InCapacity;
+		Slots.SetNum(Capacity);
+		for (FNetReceivedPacket& Slot : Slots)
+		{
+			Slot.FromAddr = SocketSubsystem->CreateInternetAddr();
+		}
+	}
+
+	/** Producer: slot to receive into, or nullptr if the game thread hasn't caught up */
+	FNetReceivedPacket* BeginWrite()
+	{
+		const uint32 CurrentTail = Tail.load(std::memory_order_relaxed);
+		if (CurrentTail - Head.load(std::memory_order_acquire) == Capacity)
+		{
+			return nullptr;
+		}
+		return &Slots[CurrentTail & (Capacity - 1)];
+	}
+
+	/** Producer: publishes the slot returned by BeginWrite */
+	void EndWrite()
+	{
+		Tail.store(Tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	/** Consumer: oldest unread packet, or nullptr if empty */
+	const FNetReceivedPacket* Peek() const
+	{
+		const uint32 CurrentHead = Head.load(std::memory_order_relaxed);
+		if (CurrentHead == Tail.load(std::memory_order_acquire))
+		{
+			return nullptr;
+		}
+		return &Slots[CurrentHead & (Capacity - 1)];
+	}
+
+	/** Consumer: hands the slot returned by Peek back to the producer */
+	void Pop()
+	{
+		Head.store(Head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+private:
+
+	TArray<FNetReceivedPacket> Slots;
+	uint32 Capacity = 0;
+
+	alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint32> Head{0};
+	alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint32> Tail{0};
+};
+
+/**
+ * Drains a net driver's socket continuously, so a long game frame doesn't leave packets sitting in (and overflowing) the
+ * kernel socket buffer. Packets are timestamped as they arrive and consumed by UIpNetDriver::TickDispatch.
+ */
+class FNetReceiveThread : public FRunnable
+{
+public:
+
+	FNetReceiveThread(FSocket* InSocket, ISocketSubsystem* SocketSubsystem, int32 RingCapacity)
+		: Socket(InSocket)
+	{
+		Ring.Init(RingCapacity, SocketSubsystem);
+		Thread = FRunnableThread::Create(this, TEXT("NetReceiveThread"), 128 * 1024, TPri_AboveNormal);
+	}
+
+	virtual ~FNetReceiveThread()
+	{
+		if (Thread)
+		{
+			Thread->Kill(true);
+			delete Thread;
+		}
+	}
+
+	virtual uint32 Run() override
+	{
+		while (!bStopping)
+		{
+			if (!Socket->Wait(ESocketWaitConditions::WaitForRead, FTimespan::FromMilliseconds(50)))
+			{
+				continue;
+			}
+
+			for (;;)
+			{
+				FNetReceivedPacket* Slot = Ring.BeginWrite();
+				if (!Slot)
+				{
+					// Ring is full: keep the packet in the kernel buffer and give the game thread time to catch up
+					NumRingFullStalls++;
+					FPlatformProcess::SleepNoStats(0.0005f);
+					break;
+				}
+
+				int32 BytesRead = 0;
+				if (!Socket->RecvFrom(Slot->Data, MAX_PACKET_SIZE, BytesRead, *Slot->FromAddr) || BytesRead == 0)
+				{
+					break;
+				}
+
+				Slot->Size = BytesRead;
+				Slot->ReceiveTime = FPlatformTime::Seconds();
+				Ring.EndWrite();
+				NumPacketsReceived++;
+			}
+		}
+		return 0;
+	}
+
+	virtual void Stop() override
+	{
+		bStopping = true;
+	}
+
+	FNetReceiveRing Ring;
+
+	std::atomic<uint64> NumPacketsReceived{0};
+	std::atomic<uint64> NumRingFullStalls{0};
+
+private:
+
+	FSocket* Socket;
+	FRunnableThread* Thread = nullptr;
+	std::atomic<bool> bStopping{false};
+};
+
+/** Per-connection receive timing, fed by the arrival timestamps of FNetReceiveThread */
+struct FNetReceiveTimingStats
+{
+	/** RFC 3550 style smoothed inter-arrival jitter, in seconds */
+	double InterArrivalJitter = 0.0;
+
+	/** Time packets spent in the ring before TickDispatch got to them */
+	double AvgQueueDelay = 0.0;
+	double MaxQueueDelay = 0.0;
+
+	void RecordArrival(double ReceiveTime, double ProcessTime)
+	{
+		if (LastReceiveTime > 0.0)
+		{
+			const double InterArrival = ReceiveTime - LastReceiveTime;
+			if (LastInterArrival >= 0.0)
+			{
+				InterArrivalJitter += (FMath::Abs(InterArrival - LastInterArrival) - InterArrivalJitter) / 16.0;
+			}
+			LastInterArrival = InterArrival;
+		}
+		LastReceiveTime = ReceiveTime;
+
+		const double QueueDelay = ProcessTime - ReceiveTime;
+		AvgQueueDelay += (QueueDelay - AvgQueueDelay) / 16.0;
+		MaxQueueDelay = FMath::Max(MaxQueueDelay, QueueDelay);
+	}
+
+private:
+
+	double LastReceiveTime = 0.0;
+	double LastInterArrival = -1.0;
+};
@@ -0,0 +1,202 @@
+
+/**
+ * Uniform XY grid of replicated actors, used by the server so every connection doesn't have to test every actor.
+ *
+ * An actor is inserted into every cell overlapped by its net cull radius (sqrt(NetCullDistanceSquared)).
+ * That means a viewer only has to look at the one cell it is standing in to find every actor that could be
+ * within relevancy distance of it.
+ *
+ * Relevancy that doesn't depend on distance is handled separately:
+ *	- bAlwaysRelevant / bNetUseOwnerRelevancy actors, and actors whose cull radius spans too many cells, are kept in a flat list.
+ *	- IsOwnedBy / this == ViewTarget / ViewTarget == GetInstigator() are checked on the actor itself (IsOwnerCandidate),
+ *	  walking its real owner chain. Owners that don't replicate, or aren't due this tick, are never in the grid, so an index
+ *	  of them would miss whatever they own.
+ *
+ * The grid only ever produces candidates. The final answer still comes from AActor::IsNetRelevantFor, so the relevant set
+ * is exactly the same as testing every actor; we just never test actors that can't possibly pass.
+ */
+struct FNetRelevancyGrid
+{
+	/** Size of a cell along X and Y, in world units. Should be in the order of the most common NetCullDistance. */
+	float CellSize = 15000.f;
+
+	/** Actors whose cull radius covers more than this many cells along an axis are treated as unbounded */
+	int32 MaxCellSpan = 8;
+
+	void AddActor(AActor* Actor)
+	{
+		FActorEntry& Entry = Entries.Add(Actor);
+		Link(Actor, Entry);
+	}
+
+	void RemoveActor(AActor* Actor)
+	{
+		if (FActorEntry* Entry = Entries.Find(Actor))
+		{
+			Unlink(Actor, *Entry);
+			Entries.Remove(Actor);
+		}
+	}
+
+	/**
+	 * Called once per tick for every actor in the consider list (not once per connection).
+	 * Only touches the cells if the actor crossed a cell border or changed cull distance.
+	 */
+	void UpdateActor(AActor* Actor)
+	{
+		FActorEntry* Entry = Entries.Find(Actor);
+		if (!Entry)
+		{
+			AddActor(Actor);
+			return;
+		}
+
+		const bool bUnbounded = IsUnbounded(Actor);
+		const FCellRect Rect = bUnbounded ? FCellRect() : GetCellRect(Actor);
+
+		if (Entry->bUnbounded != bUnbounded || Entry->Rect != Rect)
+		{
+			Unlink(Actor, *Entry);
+			Link(Actor, *Entry);
+		}
+	}
+
+	/**
+	 * Adds every actor that may be relevant to Viewer by distance. Call once per viewer of the connection, with the same
+	 * OutCandidates. Actors outside of it can still be relevant through their owner chain, see IsOwnerCandidate.
+	 */
+	void GatherCandidates(const FNetViewer& Viewer, TSet<AActor*>& OutCandidates) const
+	{
+		OutCandidates.Append(UnboundedActors);
+
+		const int32 CellX = FMath::FloorToInt(Viewer.ViewLocation.X / CellSize);
+		const int32 CellY = FMath::FloorToInt(Viewer.ViewLocation.Y / CellSize);
+		if (const TArray<AActor*>* CellActors = Cells.Find(MakeCellKey(CellX, CellY)))
+		{
+			OutCandidates.Append(*CellActors);
+		}
+	}
+
+	/**
+	 * The checks IsNetRelevantFor makes before distance: IsOwnedBy(RealViewer / ViewTarget), this == ViewTarget and
+	 * ViewTarget == GetInstigator(). Walks Actor's own owner chain, through owners the grid never saw.
+	 * Read only, safe from parallel replication tasks.
+	 */
+	static bool IsOwnerCandidate(const AActor* Actor, const TArray<FNetViewer>& ConnectionViewers)
+	{
+		for (const FNetViewer& Viewer : ConnectionViewers)
+		{
+			if (Actor == Viewer.ViewTarget || (Viewer.ViewTarget && Actor->GetInstigator() == Viewer.ViewTarget)
+				|| Actor->IsOwnedBy(Viewer.InViewer) || Actor->IsOwnedBy(Viewer.ViewTarget))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+private:
+
+	struct FCellRect
+	{
+		int32 MinX = 0;
+		int32 MinY = 0;
+		int32 MaxX = -1;
+		int32 MaxY = -1;
+
+		bool operator==(const FCellRect& Other) const
+		{
+			return MinX == Other.MinX && MinY == Other.MinY && MaxX == Other.MaxX && MaxY == Other.MaxY;
+		}
+
+		bool operator!=(const FCellRect& Other) const
+		{
+			return !(*this == Other);
+		}
+	};
+
+	struct FActorEntry
+	{
+		FCellRect Rect;
+		bool bUnbounded = false;
+	};
+
+	static uint64 MakeCellKey(int32 X, int32 Y)
+	{
+		return (uint64(uint32(X)) << 32) | uint64(uint32(Y));
+	}
+
+	bool IsUnbounded(const AActor* Actor) const
+	{
+		if (Actor->bAlwaysRelevant || Actor->bNetUseOwnerRelevancy)
+		{
+			return true;
+		}
+
+		const float CullRadius = FMath::Sqrt(Actor->NetCullDistanceSquared);
+		return CullRadius * 2.f > CellSize * MaxCellSpan;
+	}
+
+	FCellRect GetCellRect(const AActor* Actor) const
+	{
+		// Bounding square of the cull sphere projected on XY. This is a superset of IsWithinNetRelevancyDistance.
+		const FVector Location = Actor->GetActorLocation();
+		const float CullRadius = FMath::Sqrt(Actor->NetCullDistanceSquared);
+
+		FCellRect Rect;
+		Rect.MinX = FMath::FloorToInt((Location.X - CullRadius) / CellSize);
+		Rect.MinY = FMath::FloorToInt((Location.Y - CullRadius) / CellSize);
+		Rect.MaxX = FMath::FloorToInt((Location.X + CullRadius) / CellSize);
+		Rect.MaxY = FMath::FloorToInt((Location.Y + CullRadius) / CellSize);
+		return Rect;
+	}
+
+	void Link(AActor* Actor, FActorEntry& Entry)
+	{
+		Entry.bUnbounded = IsUnbounded(Actor);
+		Entry.Rect = Entry.bUnbounded ? FCellRect() : GetCellRect(Actor);
+
+		if (Entry.bUnbounded)
+		{
+			UnboundedActors.Add(Actor);
+		}
+
+		for (int32 X = Entry.Rect.MinX; X <= Entry.Rect.MaxX; X++)
+		{
+			for (int32 Y = Entry.Rect.MinY; Y <= Entry.Rect.MaxY; Y++)
+			{
+				Cells.FindOrAdd(MakeCellKey(X, Y)).Add(Actor);
+			}
+		}
+	}
+
+	void Unlink(AActor* Actor, FActorEntry& Entry)
+	{
+		if (Entry.bUnbounded)
+		{
+			UnboundedActors.RemoveSwap(Actor);
+		}
+
+		for (int32 X = Entry.Rect.MinX; X <= Entry.Rect.MaxX; X++)
+		{
+			for (int32 Y = Entry.Rect.MinY; Y <= Entry.Rect.MaxY; Y++)
+			{
+				const uint64 Key = MakeCellKey(X, Y);
+				TArray<AActor*>& CellActors = Cells.FindChecked(Key);
+				CellActors.RemoveSwap(Actor);
+				if (CellActors.Num() == 0)
+				{
+					Cells.Remove(Key);
+				}
+			}
+		}
+	}
+
+	/** Cell key -> actors whose cull radius overlaps the cell */
+	TMap<uint64, TArray<AActor*>> Cells;
+
+	TMap<AActor*, FActorEntry> Entries;
+
+	/** Actors that are candidates for every viewer */
+	TArray<AActor*> UnboundedActors;
+};
@@ -0,0 +1,108 @@
+
+DECLARE_CYCLE_STAT(TEXT("Net Shared Tasks"), STAT_NetSharedTasks, STATGROUP_Net);
+
+/** Last Run of a world context's scheduler, set by UGameEngine::TickFlushNetDrivers */
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Net Shared Tasks Time (ms)"), STAT_NetSharedTasksTime, STATGROUP_Net);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Net Shared Tasks"), STAT_NetSharedTasksNum, STATGROUP_Net);
+
+/** Order in which the tasks of drivers sharing an FNetTaskScheduler are started */
+UENUM()
+enum class ENetTaskPriority : uint8
+{
+	/** Game traffic */
+	High,
+
+	/** Beacons */
+	Normal,
+
+	/** Replay recording, spectator relays */
+	Background,
+};
+
+/**
+ * Runs the per-connection work of every net driver of a world context (game, beacon, demo...) together on the task graph workers.
+ *
+ * Each driver's TickFlush is split around Run, see UGameEngine::TickFlushNetDrivers:
+ *	- UNetDriver::TickFlushSubmit: the part that touches the world (consider list, PreReplication) runs on the game thread,
+ *	  one driver after the other. The per-connection work is handed to AddTasks.
+ *	- Run: the tasks of all drivers in a single ParallelFor, higher priority classes first.
+ *	- UNetDriver::TickFlushComplete: replicating what the tasks prioritized, and flushing, on the game thread again.
+ * Each driver running its own ParallelFor waited for its slowest connection before the next driver could start. Here the
+ * workers go straight from one driver's connections to the next driver's.
+ *
+ * Receiving (TickDispatch) isn't shared: processing packets runs game code, and reading the socket already has its own
+ * thread (UIpNetDriver::bUseReceiveThread).
+ */
+class FNetTaskScheduler
+{
+public:
+
+	/** Adds Num tasks, Work being called with each index in [0, Num). Whatever Work references must live until Run returns. */
+	void AddTasks(ENetTaskPriority Priority, int32 Num, TFunction<void(int32)>&& Work)
+	{
+		if (Num <= 0)
+		{
+			return;
+		}
+
+		const int32 BatchIndex = Batches.Add({ Priority, MoveTemp(Work) });
+		for (int32 Index = 0; Index < Num; Index++)
+		{
+			Items.Add({ BatchIndex, Index });
+		}
+	}
+
+	/** Runs everything added since the last Run and waits for it */
+	void Run()
+	{
+		SCOPE_CYCLE_COUNTER(STAT_NetSharedTasks);
+
+		const double StartTime = FPlatformTime::Seconds();
+		Stats.NumBatches = Batches.Num();
+		Stats.NumTasks = Items.Num();
+
+		if (Items.Num() > 0)
+		{
+			// Stable, so a driver's connections keep their order within a class
+			Algo::StableSortBy(Items, [this](const FItem& Item) { return Batches[Item.BatchIndex].Priority; });
+
+			// Unbalanced hands out one item at a time in index order, so higher priority tasks are started first
+			ParallelFor(Items.Num(), [this](int32 ItemIndex)
+			{
+				const FItem& Item = Items[ItemIndex];
+				Batches[Item.BatchIndex].Work(Item.Index);
+			}, EParallelForFlags::Unbalanced);
+		}
+
+		Items.Reset();
+		Batches.Reset();
+		Stats.RunTime = FPlatformTime::Seconds() - StartTime;
+	}
+
+	/** Of the last Run. A batch is one driver's AddTasks call. */
+	struct FStats
+	{
+		int32 NumBatches = 0;
+		int32 NumTasks = 0;
+		double RunTime = 0.0;
+	};
+
+	FStats Stats;
+
+private:
+
+	struct FBatch
+	{
+		ENetTaskPriority Priority;
+		TFunction<void(int32)> Work;
+	};
+
+	struct FItem
+	{
+		int32 BatchIndex;
+		int32 Index;
+	};
+
+	TArray<FBatch> Batches;
+	TArray<FItem> Items;
+};
@@ -0,0 +1,486 @@
+
+/**
+ * Chunked, seekable replay file, written and read by UDemoNetDriver.
+ *
+ *	[FReplayFileHeader][chunk 0][chunk 1]...[chunk N-1][chunk index][keyframe index][FReplayFileFooter]
+ *
+ * where each chunk is [FReplayChunkHeader][compressed records].
+ *
+ * - The recorded stream is a sequence of records: frames (the packets recorded in one tick) and keyframes (a full checkpoint
+ *   of the world at that time).
+ * - Records are packed into chunks of at most ChunkSize uncompressed bytes, each compressed on its own. A record never spans
+ *   two chunks, and a keyframe always starts a new one, so decoding can start at any keyframe without reading what's before it.
+ * - Both indices are sorted by time and written after the last chunk. The fixed size footer at the very end locates them.
+ * - Every chunk also carries its own header, so a recording that never got its indices (crash, killed server) can still be
+ *   played: the reader rebuilds them by walking the chunks, up to the last one that was completely written.
+ *
+ * The reader maps the file and uses the indices in place. Seeking to T is a binary search for the last keyframe at or before T,
+ * decompressing from that keyframe's chunk, and fast-forwarding through at most one keyframe interval of frames.
+ *
+ * Indices are written in native byte order, replays are read back on the platform family that recorded them.
+ */
+
+UENUM()
+enum class EReplayCompression : uint8
+{
+	None,
+	Zlib,
+	Oodle,
+};
+
+inline FName GetReplayCompressionFormat(EReplayCompression Compression)
+{
+	switch (Compression)
+	{
+		case EReplayCompression::Zlib:
+			return NAME_Zlib;
+
+		case EReplayCompression::Oodle:
+			return NAME_Oodle;
+
+		default:
+			return NAME_None;
+	}
+}
+
+struct FReplayFileHeader
+{
+	static constexpr uint32 ExpectedMagic = 0x52504C43;	// 'RPLC'
+	static constexpr uint32 CurrentVersion = 2;
+
+	uint32 Magic;
+	uint32 Version;
+	uint32 ChunkSize;
+
+	/** EReplayCompression */
+	uint32 Compression;
+};
+
+/** In front of every chunk's data. Repeats what the chunk index says about it, for recovering files without one. */
+struct FReplayChunkHeader
+{
+	static constexpr uint32 ExpectedMagic = 0x4B4E4843;	// 'CHNK'
+
+	/** The chunk's first record is a keyframe */
+	static constexpr uint32 Flag_Keyframe = 1 << 0;
+
+	uint32 Magic;
+	uint32 Flags;
+	uint32 CompressedSize;
+	uint32 UncompressedSize;
+	double StartTime;
+	double EndTime;
+};
+
+struct FReplayChunkInfo
+{
+	/** Where the compressed chunk starts in the file, right after its FReplayChunkHeader */
+	uint64 Offset;
+
+	/** Time of the first and last record in the chunk */
+	double StartTime;
+	double EndTime;
+
+	/** Equal sizes mean the chunk is stored uncompressed */
+	uint32 CompressedSize;
+	uint32 UncompressedSize;
+};
+
+struct FReplayKeyframeInfo
+{
+	double Time;
+
+	/** The keyframe is the first record of this chunk */
+	uint32 ChunkIndex;
+	uint32 Reserved;
+};
+
+struct FReplayFileFooter
+{
+	/** Offset of the chunk index, immediately followed by the keyframe index. 8 byte aligned. */
+	uint64 IndexOffset;
+	uint32 NumChunks;
+	uint32 NumKeyframes;
+	uint32 Magic;
+	uint32 Version;
+};
+
+// Read straight out of the mapped file, so no padding anywhere
+static_assert(sizeof(FReplayFileHeader) == 16, "FReplayFileHeader layout is part of the file format");
+static_assert(sizeof(FReplayChunkHeader) == 32, "FReplayChunkHeader layout is part of the file format");
+static_assert(sizeof(FReplayChunkInfo) == 32, "FReplayChunkInfo layout is part of the file format");
+static_assert(sizeof(FReplayKeyframeInfo) == 16, "FReplayKeyframeInfo layout is part of the file format");
+static_assert(sizeof(FReplayFileFooter) == 24, "FReplayFileFooter layout is part of the file format");
+
+enum class EReplayRecordType : uint8
+{
+	Frame,
+	Keyframe,
+
+	/** Keyframe written after frames were dropped (see FReplayWriteThread). Playback must load it even when not seeking. */
+	ResyncKeyframe,
+};
+
+/** A record as found in a decompressed chunk. Data points into the reader's chunk buffer. */
+struct FReplayRecord
+{
+	/** Type, time and size, in front of every record's data */
+	static constexpr int32 HeaderSize = sizeof(uint8) + sizeof(double) + sizeof(int32);
+
+	EReplayRecordType Type;
+	double Time;
+	const uint8* Data;
+	int32 Num;
+
+	static void Append(TArray<uint8>& Out, EReplayRecordType Type, double Time, const uint8* Data, int32 Num)
+	{
+		const int32 Pos = Out.AddUninitialized(HeaderSize + Num);
+		uint8* Dest = Out.GetData() + Pos;
+		*Dest = uint8(Type);
+		FMemory::Memcpy(Dest + 1, &Time, sizeof(double));
+		FMemory::Memcpy(Dest + 1 + sizeof(double), &Num, sizeof(int32));
+		FMemory::Memcpy(Dest + HeaderSize, Data, Num);
+	}
+
+	/** Reads the header at Src, which must have HeaderSize bytes. Returns false if it can't be a valid record. */
+	bool ReadHeader(const uint8* Src)
+	{
+		if (*Src > uint8(EReplayRecordType::ResyncKeyframe))
+		{
+			return false;
+		}
+
+		Type = EReplayRecordType(*Src);
+		FMemory::Memcpy(&Time, Src + 1, sizeof(double));
+		FMemory::Memcpy(&Num, Src + 1 + sizeof(double), sizeof(int32));
+		Data = Src + HeaderSize;
+		return Num >= 0;
+	}
+};
+
+class FReplayChunkWriter
+{
+public:
+
+	bool Open(const FString& Filename, int32 InChunkSize, EReplayCompression InCompression)
+	{
+		FileWriter.Reset(IFileManager::Get().CreateFileWriter(*Filename));
+		if (!FileWriter)
+		{
+			return false;
+		}
+
+		ChunkSize = InChunkSize;
+		Compression = InCompression;
+		Chunks.Reset();
+		Keyframes.Reset();
+		ChunkBuffer.Reset(ChunkSize);
+
+		FReplayFileHeader Header = { FReplayFileHeader::ExpectedMagic, FReplayFileHeader::CurrentVersion, uint32(ChunkSize), uint32(Compression) };
+		FileWriter->Serialize(&Header, sizeof(Header));
+		return true;
+	}
+
+	bool IsOpen() const
+	{
+		return FileWriter.IsValid();
+	}
+
+	void WriteFrame(double Time, const uint8* Data, int32 Num)
+	{
+		if (ChunkBuffer.Num() > 0 && ChunkBuffer.Num() + FReplayRecord::HeaderSize + Num > ChunkSize)
+		{
+			FlushChunk();
+		}
+		AppendRecord(EReplayRecordType::Frame, Time, Data, Num);
+	}
+
+	void WriteKeyframe(double Time, const uint8* Data, int32 Num, bool bResync = false)
+	{
+		FlushChunk();
+		Keyframes.Add({ Time, uint32(Chunks.Num()), 0 });
+		bChunkStartsWithKeyframe = true;
+		AppendRecord(bResync ? EReplayRecordType::ResyncKeyframe : EReplayRecordType::Keyframe, Time, Data, Num);
+	}
+
+	/** Writes the last chunk, the indices and the footer. Until then, FReplayChunkReader has to rebuild the indices from the chunk headers. */
+	void Close()
+	{
+		if (!FileWriter)
+		{
+			return;
+		}
+
+		FlushChunk();
+
+		static const uint8 Padding[8] = {};
+		const int64 IndexOffset = Align(FileWriter->Tell(), 8);
+		FileWriter->Serialize((void*)Padding, IndexOffset - FileWriter->Tell());
+
+		FileWriter->Serialize(Chunks.GetData(), Chunks.Num() * sizeof(FReplayChunkInfo));
+		FileWriter->Serialize(Keyframes.GetData(), Keyframes.Num() * sizeof(FReplayKeyframeInfo));
+
+		FReplayFileFooter Footer = { uint64(IndexOffset), uint32(Chunks.Num()), uint32(Keyframes.Num()), FReplayFileHeader::ExpectedMagic, FReplayFileHeader::CurrentVersion };
+		FileWriter->Serialize(&Footer, sizeof(Footer));
+
+		FileWriter->Close();
+		FileWriter.Reset();
+	}
+
+private:
+
+	void AppendRecord(EReplayRecordType Type, double Time, const uint8* Data, int32 Num)
+	{
+		if (ChunkBuffer.Num() == 0)
+		{
+			ChunkStartTime = Time;
+		}
+		ChunkEndTime = Time;
+
+		FReplayRecord::Append(ChunkBuffer, Type, Time, Data, Num);
+	}
+
+	void FlushChunk()
+	{
+		if (ChunkBuffer.Num() == 0)
+		{
+			return;
+		}
+
+		FReplayChunkInfo& Chunk = Chunks.AddDefaulted_GetRef();
+		Chunk.Offset = FileWriter->Tell() + sizeof(FReplayChunkHeader);
+		Chunk.StartTime = ChunkStartTime;
+		Chunk.EndTime = ChunkEndTime;
+		Chunk.UncompressedSize = ChunkBuffer.Num();
+
+		const FName Format = GetReplayCompressionFormat(Compression);
+		int32 CompressedSize = Format != NAME_None ? FCompression::CompressMemoryBound(Format, ChunkBuffer.Num()) : 0;
+		CompressedBuffer.SetNumUninitialized(CompressedSize, false);
+
+		// Stored raw if it doesn't compress, which the reader tells from the sizes being equal
+		const bool bCompressed = Format != NAME_None
+			&& FCompression::CompressMemory(Format, CompressedBuffer.GetData(), CompressedSize, ChunkBuffer.GetData(), ChunkBuffer.Num())
+			&& CompressedSize < ChunkBuffer.Num();
+		Chunk.CompressedSize = bCompressed ? CompressedSize : ChunkBuffer.Num();
+
+		FReplayChunkHeader ChunkHeader = { FReplayChunkHeader::ExpectedMagic, bChunkStartsWithKeyframe ? FReplayChunkHeader::Flag_Keyframe : 0u,
+			Chunk.CompressedSize, Chunk.UncompressedSize, Chunk.StartTime, Chunk.EndTime };
+		FileWriter->Serialize(&ChunkHeader, sizeof(ChunkHeader));
+		FileWriter->Serialize(bCompressed ? CompressedBuffer.GetData() : ChunkBuffer.GetData(), Chunk.CompressedSize);
+
+		ChunkBuffer.Reset();
+		bChunkStartsWithKeyframe = false;
+	}
+
+	TUniquePtr<FArchive> FileWriter;
+	int32 ChunkSize = 0;
+	EReplayCompression Compression = EReplayCompression::None;
+
+	TArray<FReplayChunkInfo> Chunks;
+	TArray<FReplayKeyframeInfo> Keyframes;
+
+	TArray<uint8> ChunkBuffer;
+	TArray<uint8> CompressedBuffer;
+	double ChunkStartTime = 0.0;
+	double ChunkEndTime = 0.0;
+	bool bChunkStartsWithKeyframe = false;
+};
+
+/**
+ * Reads a replay written by FReplayChunkWriter through a memory mapping of the whole file.
+ * Only the chunk being played is decompressed, into a buffer reused from chunk to chunk.
+ * Files without a footer are recordings that never finished: their indices are rebuilt from the chunk headers.
+ */
+class FReplayChunkReader
+{
+public:
+
+	bool Open(const FString& Filename)
+	{
+		Close();
+
+		MappedFile.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*Filename));
+		if (!MappedFile || MappedFile->GetFileSize() < int64(sizeof(FReplayFileHeader) + sizeof(FReplayFileFooter)))
+		{
+			Close();
+			return false;
+		}
+
+		MappedRegion.Reset(MappedFile->MapRegion(0, MappedFile->GetFileSize()));
+		if (!MappedRegion)
+		{
+			Close();
+			return false;
+		}
+
+		const uint8* FileData = MappedRegion->GetMappedPtr();
+		const int64 FileSize = MappedRegion->GetMappedSize();
+
+		const FReplayFileHeader& Header = *(const FReplayFileHeader*)FileData;
+		const FReplayFileFooter& Footer = *(const FReplayFileFooter*)(FileData + FileSize - sizeof(FReplayFileFooter));
+
+		if (Header.Magic != FReplayFileHeader::ExpectedMagic || Header.Version != FReplayFileHeader::CurrentVersion)
+		{
+			UE_LOG(LogNet, Warning, TEXT("FReplayChunkReader: %s is not a replay"), *Filename);
+			Close();
+			return false;
+		}
+
+		Compression = EReplayCompression(Header.Compression);
+
+		// A missing footer means the recording never finished, see FReplayChunkWriter::Close
+		const int64 IndexSize = int64(Footer.NumChunks) * sizeof(FReplayChunkInfo) + int64(Footer.NumKeyframes) * sizeof(FReplayKeyframeInfo);
+		if (Footer.Magic == FReplayFileHeader::ExpectedMagic && Footer.Version == FReplayFileHeader::CurrentVersion
+			&& Footer.IndexOffset % 8 == 0 && int64(Footer.IndexOffset) + IndexSize + int64(sizeof(Footer)) == FileSize)
+		{
+			Chunks = MakeArrayView((const FReplayChunkInfo*)(FileData + Footer.IndexOffset), Footer.NumChunks);
+			Keyframes = MakeArrayView((const FReplayKeyframeInfo*)(Chunks.GetData() + Chunks.Num()), Footer.NumKeyframes);
+		}
+		else
+		{
+			RecoverIndices(FileData, FileSize);
+			UE_LOG(LogNet, Warning, TEXT("FReplayChunkReader: %s is an unfinished recording, recovered %d chunks (%.1f s)"), *Filename, Chunks.Num(), GetTotalTime());
+		}
+
+		return Chunks.Num() > 0 && LoadChunk(0);
+	}
+
+	void Close()
+	{
+		Chunks = {};
+		Keyframes = {};
+		RecoveredChunks.Reset();
+		RecoveredKeyframes.Reset();
+		MappedRegion.Reset();
+		MappedFile.Reset();
+		CurrentChunk = INDEX_NONE;
+		ChunkData.Reset();
+	}
+
+	double GetTotalTime() const
+	{
+		return Chunks.Num() > 0 ? Chunks.Last().EndTime : 0.0;
+	}
+
+	/** Positions the reader on the last keyframe at or before Time, which the next PeekRecord returns */
+	bool SeekToKeyframe(double Time)
+	{
+		const int32 KeyframeIndex = Algo::UpperBoundBy(Keyframes, Time, &FReplayKeyframeInfo::Time) - 1;
+		return Keyframes.IsValidIndex(KeyframeIndex) && LoadChunk(Keyframes[KeyframeIndex].ChunkIndex);
+	}
+
+	/** Next record, moving on to the next chunk as needed. Data stays valid until PopRecord. Returns nullptr at the end. */
+	const FReplayRecord* PeekRecord()
+	{
+		if (CurrentChunk == INDEX_NONE)
+		{
+			return nullptr;
+		}
+
+		if (ChunkPos == ChunkData.Num() && !LoadChunk(CurrentChunk + 1))
+		{
+			return nullptr;
+		}
+
+		if (ChunkPos + FReplayRecord::HeaderSize > ChunkData.Num())
+		{
+			return nullptr;
+		}
+
+		if (!CurrentRecord.ReadHeader(ChunkData.GetData() + ChunkPos) || CurrentRecord.Num > ChunkData.Num() - ChunkPos - FReplayRecord::HeaderSize)
+		{
+			return nullptr;
+		}
+		return &CurrentRecord;
+	}
+
+	/** Consumes the record returned by PeekRecord */
+	void PopRecord()
+	{
+		ChunkPos += FReplayRecord::HeaderSize + CurrentRecord.Num;
+	}
+
+private:
+
+	/** Walks the chunk headers from the start of the file, up to the first chunk that wasn't completely written */
+	void RecoverIndices(const uint8* FileData, int64 FileSize)
+	{
+		RecoveredChunks.Reset();
+		RecoveredKeyframes.Reset();
+
+		int64 Pos = sizeof(FReplayFileHeader);
+		while (Pos + int64(sizeof(FReplayChunkHeader)) <= FileSize)
+		{
+			// Chunks aren't aligned in the file
+			FReplayChunkHeader ChunkHeader;
+			FMemory::Memcpy(&ChunkHeader, FileData + Pos, sizeof(ChunkHeader));
+
+			const int64 DataOffset = Pos + sizeof(FReplayChunkHeader);
+			if (ChunkHeader.Magic != FReplayChunkHeader::ExpectedMagic || ChunkHeader.CompressedSize > ChunkHeader.UncompressedSize
+				|| DataOffset + ChunkHeader.CompressedSize > FileSize)
+			{
+				break;
+			}
+
+			if (ChunkHeader.Flags & FReplayChunkHeader::Flag_Keyframe)
+			{
+				RecoveredKeyframes.Add({ ChunkHeader.StartTime, uint32(RecoveredChunks.Num()), 0 });
+			}
+			RecoveredChunks.Add({ uint64(DataOffset), ChunkHeader.StartTime, ChunkHeader.EndTime, ChunkHeader.CompressedSize, ChunkHeader.UncompressedSize });
+
+			Pos = DataOffset + ChunkHeader.CompressedSize;
+		}
+
+		Chunks = RecoveredChunks;
+		Keyframes = RecoveredKeyframes;
+	}
+
+	bool LoadChunk(int32 ChunkIndex)
+	{
+		if (!Chunks.IsValidIndex(ChunkIndex))
+		{
+			return false;
+		}
+
+		const FReplayChunkInfo& Chunk = Chunks[ChunkIndex];
+		if (Chunk.Offset + Chunk.CompressedSize > uint64(MappedRegion->GetMappedSize()))
+		{
+			return false;
+		}
+
+		const uint8* Src = MappedRegion->GetMappedPtr() + Chunk.Offset;
+		ChunkData.SetNumUninitialized(Chunk.UncompressedSize, false);
+
+		if (Chunk.CompressedSize == Chunk.UncompressedSize)
+		{
+			FMemory::Memcpy(ChunkData.GetData(), Src, Chunk.UncompressedSize);
+		}
+		else if (!FCompression::UncompressMemory(GetReplayCompressionFormat(Compression), ChunkData.GetData(), Chunk.UncompressedSize, Src, Chunk.CompressedSize))
+		{
+			UE_LOG(LogNet, Warning, TEXT("FReplayChunkReader: chunk %d failed to decompress"), ChunkIndex);
+			CurrentChunk = INDEX_NONE;
+			return false;
+		}
+
+		CurrentChunk = ChunkIndex;
+		ChunkPos = 0;
+		return true;
+	}
+
+	TUniquePtr<IMappedFileHandle> MappedFile;
+	TUniquePtr<IMappedFileRegion> MappedRegion;
+	EReplayCompression Compression = EReplayCompression::None;
+
+	/** Both point into the mapped file, or into the Recovered arrays for an unfinished recording */
+	TArrayView<const FReplayChunkInfo> Chunks;
+	TArrayView<const FReplayKeyframeInfo> Keyframes;
+
+	TArray<FReplayChunkInfo> RecoveredChunks;
+	TArray<FReplayKeyframeInfo> RecoveredKeyframes;
+
+	int32 CurrentChunk = INDEX_NONE;
+	TArray<uint8> ChunkData;
+	int32 ChunkPos = 0;
+
+	FReplayRecord CurrentRecord;
+};
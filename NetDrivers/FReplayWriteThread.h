@@ -0,0 +1,180 @@
+
+DECLARE_CYCLE_STAT(TEXT("Demo Record Frame"), STAT_DemoRecordFrame, STATGROUP_Net);
+DECLARE_CYCLE_STAT(TEXT("Demo Save Keyframe"), STAT_DemoSaveKeyframe, STATGROUP_Net);
+DECLARE_CYCLE_STAT(TEXT("Demo Load Keyframe"), STAT_DemoLoadKeyframe, STATGROUP_Net);
+
+/** A record handed from the game thread to FReplayWriteThread */
+struct FReplayWriteRequest
+{
+	EReplayRecordType Type = EReplayRecordType::Frame;
+	double Time = 0.0;
+	TArray<uint8> Data;
+};
+
+/**
+ * Compresses and writes replay records for UDemoNetDriver, so the game thread only pays for serializing them.
+ *
+ * - Records go to the writer through a single producer / single consumer queue. Their buffers come back through a second
+ *   one, so the game thread fills one buffer while the writer drains the other and steady state recording doesn't allocate.
+ * - Chunks are written with one sequential write each (see FReplayChunkWriter::FlushChunk).
+ * - If the disk falls behind and more than MaxQueuedBytes are waiting, frames are dropped rather than stalling the game
+ *   thread. Recording resumes once the backlog is half drained, with a resync keyframe, so the file never has frames that
+ *   don't follow from what's before them.
+ */
+class FReplayWriteThread : public FRunnable
+{
+public:
+
+	struct FStats
+	{
+		std::atomic<uint64> NumRecordsWritten{0};
+		std::atomic<uint64> NumFramesDropped{0};
+		std::atomic<uint64> NumResyncKeyframes{0};
+
+		/** Time the writer spent compressing and writing, in seconds */
+		std::atomic<double> WriteTime{0.0};
+	};
+
+	FStats Stats;
+
+	FReplayWriteThread(FReplayChunkWriter& InWriter, int64 InMaxQueuedBytes)
+		: Writer(InWriter)
+		, MaxQueuedBytes(InMaxQueuedBytes)
+		, Requests(QueueCapacity)
+		, FreeBuffers(QueueCapacity)
+	{
+		WorkEvent = FPlatformProcess::GetSynchEventFromPool(false);
+		Thread = FRunnableThread::Create(this, TEXT("ReplayWriteThread"), 128 * 1024, TPri_BelowNormal);
+	}
+
+	/** Writes everything still queued before returning */
+	virtual ~FReplayWriteThread()
+	{
+		if (Thread)
+		{
+			Thread->Kill(true);
+			delete Thread;
+		}
+		FPlatformProcess::ReturnSynchEventToPool(WorkEvent);
+	}
+
+	/** Game thread: an empty buffer to serialize the next record into, recycled from a written one when possible */
+	TArray<uint8> AcquireBuffer()
+	{
+		TArray<uint8> Buffer;
+		FreeBuffers.Dequeue(Buffer);
+		return Buffer;
+	}
+
+	/** Game thread: frames are being dropped, and the backlog drained enough to resume with a keyframe */
+	bool IsReadyToResync() const
+	{
+		return bDroppingFrames && QueuedBytes.load(std::memory_order_relaxed) <= MaxQueuedBytes / 2;
+	}
+
+	/**
+	 * Game thread: queues a record for writing, taking its buffer. Returns false if it was dropped for backpressure, after
+	 * which only a keyframe is accepted, once IsReadyToResync.
+	 */
+	bool QueueRecord(EReplayRecordType Type, double Time, TArray<uint8>&& Data)
+	{
+		const int64 Backlog = QueuedBytes.load(std::memory_order_relaxed);
+
+		if (bDroppingFrames)
+		{
+			if (Type == EReplayRecordType::Frame || Backlog > MaxQueuedBytes / 2)
+			{
+				Stats.NumFramesDropped += Type == EReplayRecordType::Frame ? 1 : 0;
+				return false;
+			}
+
+			// Caught up: the keyframe carries everything the dropped frames would have
+			Type = EReplayRecordType::ResyncKeyframe;
+			bDroppingFrames = false;
+			Stats.NumResyncKeyframes++;
+		}
+		else if (Backlog + Data.Num() > MaxQueuedBytes || Requests.IsFull())
+		{
+			UE_LOG(LogNet, Warning, TEXT("FReplayWriteThread: writer is %lld bytes behind, dropping frames until the next keyframe"), Backlog);
+			bDroppingFrames = true;
+			Stats.NumFramesDropped += Type == EReplayRecordType::Frame ? 1 : 0;
+			return false;
+		}
+
+		QueuedBytes += Data.Num();
+
+		FReplayWriteRequest Request;
+		Request.Type = Type;
+		Request.Time = Time;
+		Request.Data = MoveTemp(Data);
+		verify(Requests.Enqueue(MoveTemp(Request)));
+
+		WorkEvent->Trigger();
+		return true;
+	}
+
+	virtual uint32 Run() override
+	{
+		FReplayWriteRequest Request;
+		for (;;)
+		{
+			if (!Requests.Dequeue(Request))
+			{
+				if (bStopping)
+				{
+					break;
+				}
+				WorkEvent->Wait(FTimespan::FromMilliseconds(50));
+				continue;
+			}
+
+			const double StartTime = FPlatformTime::Seconds();
+			const int32 NumBytes = Request.Data.Num();
+
+			if (Request.Type == EReplayRecordType::Frame)
+			{
+				Writer.WriteFrame(Request.Time, Request.Data.GetData(), NumBytes);
+			}
+			else
+			{
+				Writer.WriteKeyframe(Request.Time, Request.Data.GetData(), NumBytes, Request.Type == EReplayRecordType::ResyncKeyframe);
+			}
+
+			Stats.WriteTime = Stats.WriteTime + (FPlatformTime::Seconds() - StartTime);
+			Stats.NumRecordsWritten++;
+			QueuedBytes -= NumBytes;
+
+			// Back to the game thread for reuse, or freed here if it has plenty
+			Request.Data.Reset();
+			FreeBuffers.Enqueue(MoveTemp(Request.Data));
+		}
+
+		Writer.Close();
+		return 0;
+	}
+
+	virtual void Stop() override
+	{
+		bStopping = true;
+		WorkEvent->Trigger();
+	}
+
+private:
+
+	static constexpr uint32 QueueCapacity = 1024;
+
+	/** Only used by the writer thread once it's started */
+	FReplayChunkWriter& Writer;
+	const int64 MaxQueuedBytes;
+
+	TCircularQueue<FReplayWriteRequest> Requests;
+	TCircularQueue<TArray<uint8>> FreeBuffers;
+	std::atomic<int64> QueuedBytes{0};
+
+	/** Game thread only */
+	bool bDroppingFrames = false;
+
+	FEvent* WorkEvent = nullptr;
+	FRunnableThread* Thread = nullptr;
+	std::atomic<bool> bStopping{false};
+};
@@ -0,0 +1,262 @@
+
+/**
+ * Connectionless handshake handling for UIpNetDriver, built to stay cheap under a flood of spoofed packets.
+ *
+ * Same idea as StatelessConnectHandlerComponent: the server keeps no state for a client until the client proves it can
+ * receive at its claimed address, by echoing back a cookie.
+ *	- Hello (padded to ChallengePacketSize) -> Challenge(Timestamp, Cookie), Cookie = HMAC-SHA1(Secret, Timestamp | Address | Port)
+ *	- ChallengeResponse(Timestamp, Cookie) -> verified against the current or previous secret, then the connection is created
+ * The client half is WriteHello / MakeChallengeResponse, driven by UIpNetDriver::BeginClientFastPathHandshake.
+ *
+ * On top of that:
+ *	- A Hello is never smaller than the Challenge it gets, so the server can't be used as a reflection amplifier.
+ *	- Secrets rotate every SecretUpdateTime, a cookie is accepted for at most two rotations.
+ *	- Hellos go through a token bucket per source, in a fixed-size table indexed by a keyed hash of the address. Addresses
+ *	  that hash to the same slot share its bucket: a spoofed flood spreads over all slots, so it only takes a real client's
+ *	  slot down to its share instead of starving every client the way a global budget would. Cookie verification is one
+ *	  HMAC, cheaper than the syscall that read the packet, and isn't limited.
+ *	- Challenges for a whole receive batch are queued and sent in one flush with the rest of the batch.
+ *	- No UNetConnection or MappedClientConnections entry is created before a cookie verifies.
+ */
+class FStatelessHandshakeFastPath
+{
+public:
+
+	enum class EHandshakePacketType : uint8
+	{
+		Hello = 1,
+		Challenge = 2,
+		ChallengeResponse = 3,
+	};
+
+	static constexpr int32 SecretByteSize = 64;
+	static constexpr int32 CookieByteSize = 20;
+
+	/** Type (1) + Timestamp (8) + Cookie (20). Every handshake packet, Hello included, has this size. */
+	static constexpr int32 ChallengePacketSize = 1 + sizeof(double) + CookieByteSize;
+
+	/** How often the secret rotates, in seconds */
+	float SecretUpdateTime = 15.f;
+
+	/** Slots of the per-source Hello table, a power of two. 16 bytes each. */
+	static constexpr int32 RateLimitTableSize = 65536;
+
+	/** Hellos a slot may send per second, and how many it can burst. A client resends its Hello every half second. */
+	float HellosPerSecondPerSlot = 8.f;
+	float HelloBurstPerSlot = 16.f;
+
+	/** Client side: the Hello that starts the handshake, padded with zeroes to the size of the Challenge it asks for */
+	static void WriteHello(uint8 (&OutHello)[ChallengePacketSize])
+	{
+		FMemory::Memzero(OutHello);
+		OutHello[0] = uint8(EHandshakePacketType::Hello);
+	}
+
+	/** Client side: if Data is a Challenge, writes the ChallengeResponse echoing its timestamp and cookie and returns true */
+	static bool MakeChallengeResponse(const uint8* Data, int32 Size, uint8 (&OutResponse)[ChallengePacketSize])
+	{
+		if (Size != ChallengePacketSize || Data[0] != uint8(EHandshakePacketType::Challenge))
+		{
+			return false;
+		}
+
+		FMemory::Memcpy(OutResponse, Data, ChallengePacketSize);
+		OutResponse[0] = uint8(EHandshakePacketType::ChallengeResponse);
+		return true;
+	}
+
+	void Init(double Now)
+	{
+		RateLimitTable.Init(FTokenBucket{ HelloBurstPerSlot, Now }, RateLimitTableSize);
+
+		// Unknown to senders, so they can't aim a flood at the slot of a particular client
+		FGuid SeedGuid;
+		FPlatformMisc::CreateGuid(SeedGuid);
+		FMemory::Memcpy(&RateLimitSeed, &SeedGuid, sizeof(RateLimitSeed));
+
+		GenerateSecret(0);
+		GenerateSecret(1);
+		LastSecretUpdateTime = Now;
+	}
+
+	void Tick(double Now)
+	{
+		if (Now - LastSecretUpdateTime >= SecretUpdateTime)
+		{
+			ActiveSecret = 1 - ActiveSecret;
+			GenerateSecret(ActiveSecret);
+			LastSecretUpdateTime = Now;
+		}
+	}
+
+	/**
+	 * Handles one connectionless packet. If it's a Hello, the challenge is written to OutChallenge and true is returned so the
+	 * caller can queue it with the batch. Returns false for everything else.
+	 * Sets bOutConnectionVerified when a ChallengeResponse verifies; only then may the caller create a UNetConnection.
+	 */
+	bool ProcessPacket(const FInternetAddr& FromAddr, const uint8* Data, int32 Size, double Now, uint8 (&OutChallenge)[ChallengePacketSize], bool& bOutConnectionVerified)
+	{
+		bOutConnectionVerified = false;
+
+		if (Size != ChallengePacketSize)
+		{
+			Stats.NumDropped++;
+			return false;
+		}
+
+		const EHandshakePacketType Type = EHandshakePacketType(Data[0]);
+		if (Type == EHandshakePacketType::Hello)
+		{
+			if (!RateLimitTable[GetRateLimitSlot(FromAddr)].Consume(Now, HellosPerSecondPerSlot, HelloBurstPerSlot))
+			{
+				Stats.NumRateLimited++;
+				return false;
+			}
+
+			uint8 Cookie[CookieByteSize];
+			GenerateCookie(FromAddr, Now, ActiveSecret, Cookie);
+
+			OutChallenge[0] = uint8(EHandshakePacketType::Challenge);
+			FMemory::Memcpy(OutChallenge + 1, &Now, sizeof(double));
+			FMemory::Memcpy(OutChallenge + 1 + sizeof(double), Cookie, CookieByteSize);
+
+			Stats.NumChallengesSent++;
+			return true;
+		}
+
+		if (Type == EHandshakePacketType::ChallengeResponse)
+		{
+			double Timestamp;
+			FMemory::Memcpy(&Timestamp, Data + 1, sizeof(double));
+			const uint8* ReceivedCookie = Data + 1 + sizeof(double);
+
+			bOutConnectionVerified = VerifyCookie(FromAddr, Timestamp, ReceivedCookie, Now);
+			if (bOutConnectionVerified)
+			{
+				Stats.NumVerified++;
+			}
+			else
+			{
+				Stats.NumRejected++;
+			}
+			return false;
+		}
+
+		Stats.NumDropped++;
+		return false;
+	}
+
+	struct FStats
+	{
+		uint64 NumChallengesSent = 0;
+		uint64 NumVerified = 0;
+		uint64 NumRejected = 0;
+
+		/** Malformed, dropped before any hashing */
+		uint64 NumDropped = 0;
+
+		/** Hellos dropped by their slot's token bucket */
+		uint64 NumRateLimited = 0;
+	};
+
+	FStats Stats;
+
+private:
+
+	struct FTokenBucket
+	{
+		float Tokens = 0.f;
+		double LastRefillTime = 0.0;
+
+		bool Consume(double Now, float PerSecond, float Burst)
+		{
+			Tokens = FMath::Min(Burst, Tokens + float(Now - LastRefillTime) * PerSecond);
+			LastRefillTime = Now;
+
+			if (Tokens < 1.f)
+			{
+				return false;
+			}
+
+			Tokens -= 1.f;
+			return true;
+		}
+	};
+
+	/** Keyed, so which addresses share a slot depends on RateLimitSeed and not just on the addresses */
+	uint32 GetRateLimitSlot(const FInternetAddr& Addr) const
+	{
+		uint8 AddrData[16 + sizeof(int32)];
+		int32 AddrDataSize = 0;
+
+		const TArray<uint8> RawIp = Addr.GetRawIp();
+		FMemory::Memcpy(AddrData, RawIp.GetData(), FMath::Min(RawIp.Num(), 16));
+		AddrDataSize += FMath::Min(RawIp.Num(), 16);
+
+		const int32 Port = Addr.GetPort();
+		FMemory::Memcpy(AddrData + AddrDataSize, &Port, sizeof(int32));
+		AddrDataSize += sizeof(int32);
+
+		return uint32(CityHash64WithSeed((const char*)AddrData, AddrDataSize, RateLimitSeed)) & (RateLimitTableSize - 1);
+	}
+
+	void GenerateSecret(int32 SecretIndex)
+	{
+		// Not FMath::Rand, its seed is predictable
+		for (int32 Offset = 0; Offset < SecretByteSize; Offset += sizeof(FGuid))
+		{
+			FGuid RandomGuid;
+			FPlatformMisc::CreateGuid(RandomGuid);
+			FMemory::Memcpy(&Secrets[SecretIndex][Offset], &RandomGuid, sizeof(FGuid));
+		}
+	}
+
+	void GenerateCookie(const FInternetAddr& Addr, double Timestamp, int32 SecretIndex, uint8 (&OutCookie)[CookieByteSize]) const
+	{
+		uint8 CookieData[sizeof(double) + 16 + sizeof(int32)];
+		int32 CookieDataSize = 0;
+
+		FMemory::Memcpy(CookieData, &Timestamp, sizeof(double));
+		CookieDataSize += sizeof(double);
+
+		const TArray<uint8> RawIp = Addr.GetRawIp();
+		FMemory::Memcpy(CookieData + CookieDataSize, RawIp.GetData(), FMath::Min(RawIp.Num(), 16));
+		CookieDataSize += FMath::Min(RawIp.Num(), 16);
+
+		const int32 Port = Addr.GetPort();
+		FMemory::Memcpy(CookieData + CookieDataSize, &Port, sizeof(int32));
+		CookieDataSize += sizeof(int32);
+
+		FSHA1::HMACBuffer(Secrets[SecretIndex], SecretByteSize, CookieData, CookieDataSize, OutCookie);
+	}
+
+	bool VerifyCookie(const FInternetAddr& Addr, double Timestamp, const uint8* ReceivedCookie, double Now) const
+	{
+		// A cookie older than two rotations was made with a secret we no longer have
+		const double CookieAge = Now - Timestamp;
+		if (CookieAge < 0.0 || CookieAge > SecretUpdateTime * 2.f)
+		{
+			return false;
+		}
+
+		// Try the active secret first, then the one it replaced
+		for (int32 SecretIndex : { ActiveSecret, 1 - ActiveSecret })
+		{
+			uint8 ExpectedCookie[CookieByteSize];
+			GenerateCookie(Addr, Timestamp, SecretIndex, ExpectedCookie);
+			if (FMemory::Memcmp(ExpectedCookie, ReceivedCookie, CookieByteSize) == 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	uint8 Secrets[2][SecretByteSize];
+	int32 ActiveSecret = 0;
+	double LastSecretUpdateTime = 0.0;
+
+	/** RateLimitTableSize token buckets, indexed by GetRateLimitSlot */
+	TArray<FTokenBucket> RateLimitTable;
+	uint64 RateLimitSeed = 0;
+};
@@ -77,8 +77,8 @@
  *
  * Whenever a client wants to Join a server, they will first establish a new UPendingNetGame in UEngine::Browse with the server's IP.
  * UPendingNetGame::Initialize and UPendingNetGame::InitNetDriver are responsible for initializing settings and setting up the NetDriver respectively.
- * Clients will immediately setup a UNetConnection for the server as a part of this initialization, and will start sending data to the server on that connection,
- * initiating the handshaking process.
+ * InitNetDriver returns right away: the server's address is resolved on a worker, and UPendingNetGame::Tick then sets up a UNetConnection
+ * for the server and starts sending data to it on that connection, initiating the handshaking process.
  *
  * On both Clients and Server, UNetDriver::TickDispatch is typically responsible for receiving network data.
  * Typically, when we receive a packet, we inspect its address and see whether or not it's from a connection we already know about.
@@ -116,8 +116,11 @@
  *
  * Client's UPendingNetGame::NotifyControlMessage receives NMT_Welcome, reads the map info (so it can start loading later),
  * and sends an NMT_NetSpeed message with the configured Net Speed of the client.
+ * The map named in the client's URL has been loading asynchronously since InitNetDriver. If the welcome names another one,
+ * that one starts loading right away, ahead of UGameEngine::LoadMap.
  *
  * Server's UWorld::NotifyControlMessage receives NMT_NetSpeed, and adjusts the connections Net Speed appropriately.
+ * With UNetConnection::bUseCongestionControl that rate is only a ceiling, see FNetCongestionController.
  *
  * At this point, the handshaking is considered to be complete, and the player is fully connected to the game.
  * Depending on how long it takes to load the map, the client could still receive some non-handshake control messages
@@ -302,6 +305,28 @@ struct FNetDriverDefinition
 
 }
 
+/**
+ * Everything one connection's replication task reads and writes. Tasks never touch each other's FConnectionReplicationTask.
+ * With bParallelConnectionReplication the task only decides what the connection gets: its actors in priority order and
+ * which of them are relevant. ReplicateActor then runs on the game thread, see ServerReplicateActors_FinishConnections.
+ */
+struct FConnectionReplicationTask
+{
+	UNetConnection* Connection = nullptr;
+	TArray<FNetViewer> ConnectionViewers;
+
+	/** Copied out of the worker's FMemStack, which doesn't outlive the task */
+	TArray<FActorPriority> PriorityList;
+
+	/** One bit per PriorityList entry */
+	TBitArray<> Relevant;
+
+	/** Popped from the connection's FNetPriorityScheduler before the tasks start, see ServerReplicateActors_PopScheduledActors */
+	TArray<AActor*> ScheduledActors;
+
+	int32 Updated = 0;
+};
+
 // Returns true if this actor should replicate to *any* of the passed in connections
 static FORCEINLINE_DEBUGGABLE bool IsActorRelevantToConnection( const AActor* Actor, const TArray<FNetViewer>& ConnectionViewers );
 
@@ -333,63 +358,2182 @@ class UNetDriver : public UObject, public FExec
 		bool bReuseAddressAndPort, 
 		FString& Error) PURE_VIRTUAL(UNetDriver::InitListen, return true;);
 
-	UChannel* GetOrCreateChannelByName(const FName& ChName);
+	/** Actor channels closed on this driver, reset and waiting to be handed out again by GetOrCreateChannelByName */
+	UPROPERTY()
+	TArray<TObjectPtr<UChannel>> ActorChannelPool;
 
+	/** Replicators released by pooled actor channels */
+	TArray<TSharedRef<FObjectReplicator>> ReplicatorPool;
 
-	int32 UNetDriver::ServerReplicateActors_ProcessPrioritizedActors(
-		UNetConnection* Connection,
-		const TArray<FNetViewer>& ConnectionViewers, 
-		FActorPriority** PriorityActors, 
-		const int32 FinalSortedCount, 
-		int32& OutUpdated )
+	/** High-water marks. Anything released past these is freed normally. */
+	UPROPERTY(Config)
+	int32 MaxActorChannelPoolSize;
+
+	UPROPERTY(Config)
+	int32 MaxReplicatorPoolSize;
+
+	/** Allocation counters for the channel and replicator pools */
+	struct FChannelPoolStats
+	{
+		uint32 NumChannelsAllocated = 0;
+		uint32 NumChannelsReused = 0;
+		uint32 NumChannelsDiscarded = 0;
+		uint32 NumReplicatorsAllocated = 0;
+		uint32 NumReplicatorsReused = 0;
+		uint32 NumReplicatorsDiscarded = 0;
+	};
+
+	FChannelPoolStats ChannelPoolStats;
+
+	UChannel* GetOrCreateChannelByName(const FName& ChName)
+	{
+		if (ChName == NAME_Actor && ActorChannelPool.Num() > 0)
+		{
+			ChannelPoolStats.NumChannelsReused++;
+			return ActorChannelPool.Pop(false);
+		}
+
+		if (ChName == NAME_Actor)
+		{
+			ChannelPoolStats.NumChannelsAllocated++;
+		}
+		return InternalCreateChannelByName(ChName);
+	}
+
+	/** Called by UActorChannel::CleanUp once the channel is out of its connection */
+	void ReleaseToChannelPool(UChannel* Channel)
+	{
+		UActorChannel* ActorChannel = CastChecked<UActorChannel>(Channel);
+		ActorChannel->ResetForPool(this);
+
+		if (ActorChannelPool.Num() < MaxActorChannelPoolSize)
+		{
+			ActorChannelPool.Add(ActorChannel);
+		}
+		else
+		{
+			ChannelPoolStats.NumChannelsDiscarded++;
+			ActorChannel->MarkAsGarbage();
+		}
+	}
+
+	TSharedRef<FObjectReplicator> GetOrCreateReplicator()
+	{
+		if (ReplicatorPool.Num() > 0)
+		{
+			ChannelPoolStats.NumReplicatorsReused++;
+			return ReplicatorPool.Pop(false);
+		}
+
+		ChannelPoolStats.NumReplicatorsAllocated++;
+		return MakeShared<FObjectReplicator>();
+	}
+
+	void ReleaseReplicator(const TSharedRef<FObjectReplicator>& Replicator)
+	{
+		// Something else (dormancy, a pending RPC) may still hold the replicator, in which case it just dies with its last reference
+		if (!Replicator.IsUnique())
+		{
+			return;
+		}
+
+		if (ReplicatorPool.Num() < MaxReplicatorPoolSize)
+		{
+			Replicator->ResetForPool();
+			ReplicatorPool.Add(Replicator);
+		}
+		else
+		{
+			ChannelPoolStats.NumReplicatorsDiscarded++;
+		}
+	}
+
+	/** Where UDataStreamChannel writes received files, and keeps partial ones to resume */
+	UPROPERTY(Config)
+	FString DataStreamDirectory;
+
+	/** Blocks a data stream may have outstanding (and the receiver buffer out of order), see FDataStreamTransfer.h */
+	UPROPERTY(Config)
+	int32 DataStreamWindowBlocks;
+
+	/** Largest file a remote may send over a data stream */
+	UPROPERTY(Config)
+	int64 MaxDataStreamTransferBytes;
+
+	/** Start order of this driver's tasks when it shares its world context's FNetTaskScheduler */
+	UPROPERTY(Config)
+	ENetTaskPriority NetTaskPriority;
+
+	/**
+	 * Set by UGameEngine::CreateNetDriver_Local when the world context's drivers share a scheduler. TickFlush then does
+	 * nothing: UGameEngine::Tick calls TickFlushNetDrivers once the context's world ticked, which calls TickFlushSubmit and
+	 * TickFlushComplete of all of them around the shared Run instead.
+	 */
+	FNetTaskScheduler* SharedTaskScheduler = nullptr;
+
+	/** Runs this driver's tasks when it doesn't share a scheduler */
+	FNetTaskScheduler OwnTaskScheduler;
+
+	/** Submitted connection replication tasks and the consider list they read, kept until TickFlushComplete */
+	TArray<FConnectionReplicationTask> ReplicationTasks;
+	TArray<FNetworkObjectInfo*> ReplicationConsiderList;
+
+	virtual void TickFlush(float DeltaSeconds)
+	{
+		if (SharedTaskScheduler)
+		{
+			return;
+		}
+
+		TickFlushSubmit(DeltaSeconds, OwnTaskScheduler);
+		OwnTaskScheduler.Run();
+		TickFlushComplete(DeltaSeconds);
+	}
+
+	/**
+	 * Game thread half of TickFlush that runs before the tasks: ServerReplicateActors up to
+	 * ServerReplicateActors_SubmitConnections, with ReplicationTasks and ReplicationConsiderList.
+	 * Subclasses add the per-connection work of their own to Scheduler here.
+	 */
+	virtual void TickFlushSubmit(float DeltaSeconds, FNetTaskScheduler& Scheduler)
+	{
+		// ... replicate, submitting the connections ...
+	}
+
+	/** Game thread half of TickFlush that runs once Scheduler's tasks are done */
+	virtual void TickFlushComplete(float DeltaSeconds)
+	{
+		// ... ServerReplicateActors_FinishConnections(ReplicationTasks), then the rest of ServerReplicateActors ...
+
+		// Bulk transfers get whatever rate replication left, before the packets go out
+		for (UNetConnection* Connection : ClientConnections)
+		{
+			if (Connection->DataStreamChannel)
+			{
+				Connection->DataStreamChannel->TickTransfers();
+			}
+		}
+		if (ServerConnection && ServerConnection->DataStreamChannel)
+		{
+			ServerConnection->DataStreamChannel->TickTransfers();
+		}
+
+		// ... flush every connection ...
+
+		// Everything packed this tick is on the wire: release each connection's send working set in one go
+		for (UNetConnection* Connection : ClientConnections)
+		{
+			Connection->SendBufferPool.EndTick();
+		}
+		if (ServerConnection)
+		{
+			ServerConnection->SendBufferPool.EndTick();
+		}
+	}
+
+	/** If true, ServerReplicateActors only runs IsNetRelevantFor on the actors RelevancyGrid returns for the connection's viewers */
+	UPROPERTY(Config)
+	uint32 bUseRelevancyGrid:1;
+
+	/** Spatial index of the replicated actors, see FNetRelevancyGrid */
+	FNetRelevancyGrid RelevancyGrid;
+
+	/** If true, each connection pops its due actors from UNetConnection::PriorityScheduler instead of prioritizing and sorting the whole consider list */
+	UPROPERTY(Config)
+	uint32 bUseIncrementalPriorityScheduler:1;
+
+	/** Most actors a connection pops from its scheduler per tick. Whatever it doesn't get to stays at the front for next tick. */
+	UPROPERTY(Config)
+	int32 MaxScheduledActorsPerConnection;
+
+	virtual void AddNetworkActor(AActor* Actor)
+	{
+		Actor->AssignNetIndex();
+
+		if (bUseRelevancyGrid && IsServer())
+		{
+			RelevancyGrid.AddActor(Actor);
+		}
+
+		TSharedPtr<FNetworkObjectInfo>* InfoPtr = GetNetworkObjectList().FindOrAdd(Actor, this);
+		FNetworkObjectInfo* ActorInfo = InfoPtr->Get();
+
+		// Clients loaded it with the map, nothing to replicate until it's flushed (FlushActorDormancy adds it to the schedulers)
+		if (IsServer() && Actor->NetDormancy == DORM_Initial && Actor->IsNetStartupActor() && !IsOwnerOnlyIndexable(Actor))
+		{
+			GetNetworkObjectList().MarkDormantOnAllConnections(*InfoPtr);
+			return;
+		}
+
+		// Owner-only actors never go in the shared consider list or the schedulers, see OwnerOnlyActorsByRoot
+		if (IsServer() && IsOwnerOnlyIndexable(Actor))
+		{
+			ActorInfo->bOwnerOnlyIndexed = true;
+			OwnerOnlyActorInfos.Add(ActorInfo);
+			OwnerOnlyReindexQueue.Add(ActorInfo);
+			return;
+		}
+
+		if (bUseIncrementalPriorityScheduler && IsServer())
+		{
+			for (UNetConnection* Connection : ClientConnections)
+			{
+				Connection->PriorityScheduler.AddActor(Actor, GetElapsedTime());
+			}
+		}
+	}
+
+	virtual void RemoveNetworkActor(AActor* Actor)
+	{
+		// Actor->NetIndex stays: other drivers may still replicate the actor, and our own channels to it close later
+
+		RelevancyGrid.RemoveActor(Actor);
+
+		for (UNetConnection* Connection : ClientConnections)
+		{
+			Connection->PriorityScheduler.RemoveActor(Actor);
+		}
+
+		FNetworkObjectInfo* ActorInfo = FindNetworkObjectInfo(Actor);
+		if (ActorInfo && ActorInfo->bOwnerOnlyIndexed)
+		{
+			UnindexOwnerOnlyActor(ActorInfo);
+			OwnerOnlyActorInfos.RemoveSwap(ActorInfo);
+			OwnerOnlyReindexQueue.Remove(ActorInfo);
+			ActorInfo->bOwnerOnlyIndexed = false;
+		}
+	}
+
+	/** Actor's owner chain changed, see AActor::InvalidateOwnerChainCache. Only the owner-only actors it affects are re-indexed. */
+	void NotifyActorOwnerChainChanged(AActor* Actor)
+	{
+		if (!IsServer())
+		{
+			return;
+		}
+
+		FNetworkObjectInfo* ActorInfo = FindNetworkObjectInfo(Actor);
+		if (ActorInfo && ActorInfo->bOwnerOnlyIndexed)
+		{
+			OwnerOnlyReindexQueue.Add(ActorInfo);
+		}
+
+		// Owner-only actors it instigated are indexed under its root too
+		if (const TArray<FNetworkObjectInfo*>* Instigated = OwnerOnlyActorsByInstigator.Find(Actor))
+		{
+			OwnerOnlyReindexQueue.Append(*Instigated);
+		}
+	}
+
+	/**
+	 * bOnlyRelevantToOwner actors that IsNetRelevantFor can only accept through their owner chain or instigator:
+	 * bAlwaysRelevant and bNetUseOwnerRelevancy are checked before bOnlyRelevantToOwner, so those stay in the shared list.
+	 */
+	static bool IsOwnerOnlyIndexable(const AActor* Actor)
 	{
-		UActorChannel* Channel = PriorityActors[j]->Channel;
-		if ( !Channel || Channel->Actor ) //make sure didn't just close this channel
+		return Actor->bOnlyRelevantToOwner && !Actor->bAlwaysRelevant && !Actor->bNetUseOwnerRelevancy;
+	}
+
+	/**
+	 * Owner-only actors by the root of their owner chain, and by the root of their instigator's owner chain.
+	 * IsOwnedBy(RealViewer / ViewTarget), this == ViewTarget and ViewTarget == Instigator all imply the viewer shares one of
+	 * those roots, so a connection only has to look at the entries of its own viewers' roots.
+	 * Entries move one actor at a time: when an owner-only actor comes, goes or changes instigator, or when its or its
+	 * instigator's owner chain changes (NotifyActorOwnerChainChanged).
+	 */
+	TMap<const AActor*, TArray<FNetworkObjectInfo*>> OwnerOnlyActorsByRoot;
+
+	/** Owner-only actors by instigator, so an instigator's owner change re-indexes what it instigated */
+	TMap<const AActor*, TArray<FNetworkObjectInfo*>> OwnerOnlyActorsByInstigator;
+
+	TArray<FNetworkObjectInfo*> OwnerOnlyActorInfos;
+
+	/** Owner-only actors to (re-)index before the next replication, see ServerReplicateActors_UpdateOwnerOnlyIndex */
+	TSet<FNetworkObjectInfo*> OwnerOnlyReindexQueue;
+
+	/** Indexed owner-only actors that are due this frame, the counterpart of the shared consider list */
+	TArray<FNetworkObjectInfo*> OwnerOnlyConsiderList;
+
+	/**
+	 * Actors a connection's scheduler popped that aren't in either consider list: left over from an earlier frame's budget or
+	 * MaxScheduledActorsPerConnection, or due there a little before NextUpdateTime. Considered like the others.
+	 */
+	TArray<FNetworkObjectInfo*> ScheduledConsiderList;
+
+	typedef TArray<const AActor*, TInlineAllocator<4>> FViewerRoots;
+
+	static void GetViewerRoots(const TArray<FNetViewer>& ConnectionViewers, FViewerRoots& OutRoots)
+	{
+		for (const FNetViewer& Viewer : ConnectionViewers)
+		{
+			if (Viewer.InViewer)
+			{
+				OutRoots.AddUnique(Viewer.InViewer->GetOwnerChainRoot());
+			}
+			if (Viewer.ViewTarget)
+			{
+				OutRoots.AddUnique(Viewer.ViewTarget->GetOwnerChainRoot());
+			}
+		}
+	}
+
+	/** Whether a viewer with one of Roots can still find ActorInfo in OwnerOnlyActorsByRoot */
+	static bool IsOwnerOnlyActorUnderRoots(const FNetworkObjectInfo* ActorInfo, const FViewerRoots& Roots)
+	{
+		return Roots.Contains(ActorInfo->IndexedRoot) || (ActorInfo->IndexedInstigatorRoot && Roots.Contains(ActorInfo->IndexedInstigatorRoot));
+	}
+
+	static void RemoveFromOwnerOnlyIndex(TMap<const AActor*, TArray<FNetworkObjectInfo*>>& Index, const AActor* Key, FNetworkObjectInfo* ActorInfo)
+	{
+		TArray<FNetworkObjectInfo*>* Infos = Key ? Index.Find(Key) : nullptr;
+		if (Infos)
+		{
+			Infos->RemoveSwap(ActorInfo);
+			if (Infos->Num() == 0)
+			{
+				Index.Remove(Key);
+			}
+		}
+	}
+
+	void IndexOwnerOnlyActor(FNetworkObjectInfo* ActorInfo)
+	{
+		AActor* Actor = ActorInfo->Actor;
+		Actor->UpdateOwnerChainCache();
+		ActorInfo->IndexedRoot = Actor->GetOwnerChainRoot();
+		OwnerOnlyActorsByRoot.FindOrAdd(ActorInfo->IndexedRoot).Add(ActorInfo);
+
+		AActor* Instigator = Actor->GetInstigator();
+		ActorInfo->IndexedInstigator = Instigator;
+		if (Instigator)
+		{
+			OwnerOnlyActorsByInstigator.FindOrAdd(Instigator).Add(ActorInfo);
+
+			Instigator->UpdateOwnerChainCache();
+			if (Instigator->GetOwnerChainRoot() != ActorInfo->IndexedRoot)
+			{
+				ActorInfo->IndexedInstigatorRoot = Instigator->GetOwnerChainRoot();
+				OwnerOnlyActorsByRoot.FindOrAdd(ActorInfo->IndexedInstigatorRoot).Add(ActorInfo);
+			}
+		}
+	}
+
+	void UnindexOwnerOnlyActor(FNetworkObjectInfo* ActorInfo)
+	{
+		RemoveFromOwnerOnlyIndex(OwnerOnlyActorsByRoot, ActorInfo->IndexedRoot, ActorInfo);
+		RemoveFromOwnerOnlyIndex(OwnerOnlyActorsByRoot, ActorInfo->IndexedInstigatorRoot, ActorInfo);
+		RemoveFromOwnerOnlyIndex(OwnerOnlyActorsByInstigator, ActorInfo->IndexedInstigator, ActorInfo);
+
+		ActorInfo->IndexedRoot = nullptr;
+		ActorInfo->IndexedInstigatorRoot = nullptr;
+		ActorInfo->IndexedInstigator = nullptr;
+	}
+
+	/** An owner-only actor's channel stays open only while the connection's viewers can still reach it through the index */
+	void CloseOwnerOnlyChannelIfUnreachable(UNetConnection* Connection, FNetworkObjectInfo* ActorInfo)
+	{
+		UActorChannel* Channel = Connection->FindActorChannelRef(ActorInfo->Actor);
+		if (Channel && ActorInfo->IndexedRoot && !IsOwnerOnlyActorUnderRoots(ActorInfo, Connection->OwnerOnlyViewerRoots))
+		{
+			Channel->Close(EChannelCloseReason::Relevancy);
+		}
+	}
+
+	/**
+	 * Moves the queued owner-only actors in the index. The ones that changed roots had their channels opened for the old
+	 * owner's connection, which would otherwise never look at them again.
+	 */
+	void ServerReplicateActors_UpdateOwnerOnlyIndex()
+	{
+		for (FNetworkObjectInfo* ActorInfo : OwnerOnlyReindexQueue)
+		{
+			const AActor* OldRoot = ActorInfo->IndexedRoot;
+			const AActor* OldInstigatorRoot = ActorInfo->IndexedInstigatorRoot;
+
+			UnindexOwnerOnlyActor(ActorInfo);
+			IndexOwnerOnlyActor(ActorInfo);
+
+			if (OldRoot && (OldRoot != ActorInfo->IndexedRoot || OldInstigatorRoot != ActorInfo->IndexedInstigatorRoot))
+			{
+				for (UNetConnection* Connection : ClientConnections)
+				{
+					CloseOwnerOnlyChannelIfUnreachable(Connection, ActorInfo);
+				}
+
+				// Due right away for its new owner, whatever its back-off was
+				ForceNetUpdate(ActorInfo->Actor);
+			}
+		}
+		OwnerOnlyReindexQueue.Reset();
+	}
+
+	/**
+	 * Serial, before Connection prioritizes. If its viewers' roots changed (possession, view target), the owner-only
+	 * actors it has channels to may no longer be reachable.
+	 */
+	void ServerReplicateActors_UpdateOwnerOnlyViewerRoots(UNetConnection* Connection, const TArray<FNetViewer>& ConnectionViewers)
+	{
+		FViewerRoots ViewerRoots;
+		GetViewerRoots(ConnectionViewers, ViewerRoots);
+		if (ViewerRoots == Connection->OwnerOnlyViewerRoots)
+		{
+			return;
+		}
+
+		Connection->OwnerOnlyViewerRoots = MoveTemp(ViewerRoots);
+		for (FNetworkObjectInfo* ActorInfo : OwnerOnlyActorInfos)
+		{
+			CloseOwnerOnlyChannelIfUnreachable(Connection, ActorInfo);
+		}
+	}
+
+	/** The due owner-only actors this connection's viewers could be relevant to. Read only, safe from parallel replication tasks. */
+	void ServerReplicateActors_GatherOwnerOnlyActors(const TArray<FNetViewer>& ConnectionViewers, TArray<FNetworkObjectInfo*>& OutActors) const
+	{
+		FViewerRoots ViewerRoots;
+		GetViewerRoots(ConnectionViewers, ViewerRoots);
+
+		for (const AActor* Root : ViewerRoots)
 		{
-			AActor* Actor = ActorInfo->Actor;
-			if ( IsActorRelevantToConnection( Actor, ConnectionViewers ) )
+			if (const TArray<FNetworkObjectInfo*>* Indexed = OwnerOnlyActorsByRoot.Find(Root))
 			{
-				// Create UActorChannel for AActor
-				if (Channel == NULL)
+				for (FNetworkObjectInfo* ActorInfo : *Indexed)
 				{
-					// Create a new channel for this actor.
-					Channel = Connection->CreateChannelByName(NAME_Actor);
-					if (Channel)
+					if (ActorInfo->bOwnerOnlyDue)
 					{
-						Channel->SetChannelActor(Actor, ESetChannelActorFlags::None);
+						OutActors.AddUnique(ActorInfo);
 					}
 				}
 			}
+		}
+	}
+
+	/** NetPriority / NetUpdateFrequency of Actor changed, see AActor::SetNetUpdateFrequency */
+	void NotifyActorPriorityInputsChanged(AActor* Actor)
+	{
+		for (UNetConnection* Connection : ClientConnections)
+		{
+			Connection->PriorityScheduler.UpdateActor(Actor);
+		}
+	}
+
+	/**
+	 * Serial, before any connection is prioritized. Pops the connection's due actors into ScheduledActors, and considers those
+	 * that aren't in a consider list the same way BuildConsiderList would: owner chain, relevancy grid cell, and later
+	 * their net update times in ServerReplicateActors_UpdateNetUpdateTimes.
+	 */
+	void ServerReplicateActors_PopScheduledActors(UNetConnection* Connection, TArray<AActor*>& OutScheduledActors)
+	{
+		OutScheduledActors.Reset();
+		Connection->PriorityScheduler.PopDue(GetElapsedTime(), MaxScheduledActorsPerConnection, OutScheduledActors);
+
+		for (AActor* Actor : OutScheduledActors)
+		{
+			FNetworkObjectInfo* ActorInfo = GetNetworkObjectList().Find(Actor).Get();
+			if (ActorInfo->ConsideredFrame == ReplicationFrame)
+			{
+				continue;
+			}
 
-			Channel->ReplicateActor();
+			ActorInfo->ConsideredFrame = ReplicationFrame;
+			ActorInfo->bReplicatedThisFrame = false;
+			ActorInfo->NextFullRateDueTime = GetElapsedTime() + 1.f / FMath::Max(Actor->NetUpdateFrequency, KINDA_SMALL_NUMBER);
+			Actor->UpdateOwnerChainCache();
 
-			// If the actor wasn't recently relevant, or if it was torn off, close the actor channel if it exists for this connection
-			if (!bIsRecentlyRelevant)
+			if (bUseRelevancyGrid)
 			{
-				Channel->Close(Actor->GetTearOff() ? EChannelCloseReason::TearOff : EChannelCloseReason::Relevancy);
+				RelevancyGrid.UpdateActor(Actor);
 			}
+
+			ScheduledConsiderList.Add(ActorInfo);
 		}
-		
-	};
+	}
 
-};
+	/** Scheduler counterpart of ServerReplicateActors_PrioritizeActors. Builds the FActorPriority list from the popped due actors only. */
+	int32 ServerReplicateActors_BuildScheduledPriorityList(UNetConnection* Connection, const TArray<FNetViewer>& ConnectionViewers, const TArray<FNetworkObjectInfo*>& OwnerOnlyActors, const TArray<AActor*>& DueActors, FActorPriority*& OutPriorityList, FActorPriority**& OutPriorityActors)
+	{
+		const int32 NumActors = OwnerOnlyActors.Num() + DueActors.Num();
 
+		OutPriorityList = new (FMemStack::Get(), NumActors) FActorPriority;
+		OutPriorityActors = new (FMemStack::Get(), NumActors) FActorPriority*;
 
-UCLASS(transient, config = Engine)
-class WEBSOCKETNETWORKING_API UWebSocketNetDriver : public UNetDriver
-{
+		// The connection's own owner-only actors aren't in the scheduler, they go first
+		for (int32 i = 0; i < NumActors; i++)
+		{
+			FNetworkObjectInfo* ActorInfo = i < OwnerOnlyActors.Num() ? OwnerOnlyActors[i] : GetNetworkObjectList().Find(DueActors[i - OwnerOnlyActors.Num()]).Get();
 
-};
+			// Already in priority order, so the priority value itself is only informational
+			OutPriorityList[i] = FActorPriority(Connection, Connection->FindActorChannelRef(ActorInfo->Actor), ActorInfo, ConnectionViewers, false);
+			OutPriorityActors[i] = OutPriorityList + i;
+		}
 
+		return NumActors;
+	}
 
-UCLASS(transient, config=Engine)
-class ONLINESUBSYSTEMUTILS_API UIpNetDriver : public UNetDriver
-{
+	/**
+	 * If true, actors whose replicated state isn't changing back off exponentially from NetUpdateFrequency
+	 * towards MinNetUpdateFrequency, and snap back to NetUpdateFrequency as soon as ForceNetUpdate is called.
+	 */
+	UPROPERTY(Config)
+	uint32 bUseAdaptiveNetUpdateFrequency:1;
 
-};
+	/** Factor the update delta of an idle actor grows by every time it is considered and has nothing to send */
+	UPROPERTY(Config)
+	float AdaptiveNetUpdateBackoff;
 
-UCLASS(transient, config=Engine)
-class ENGINE_API UDemoNetDriver : public UNetDriver
-{
+	FAdaptiveNetUpdateStats AdaptiveNetUpdateStats;
+
+	/** Collects the actors that are due this frame. Adaptive back-off happens here: backed-off actors never reach a connection. */
+	int32 ServerReplicateActors_BuildConsiderList(TArray<FNetworkObjectInfo*>& OutConsiderList, const float ServerTickTime)
+	{
+		const double Now = GetElapsedTime();
+		OwnerOnlyConsiderList.Reset();
+		ScheduledConsiderList.Reset();
+
+		for (const TSharedPtr<FNetworkObjectInfo>& ObjectInfo : GetNetworkObjectList().GetActiveObjects())
+		{
+			FNetworkObjectInfo* ActorInfo = ObjectInfo.Get();
+			ActorInfo->bOwnerOnlyDue = false;
+
+			const float FullRateDelta = 1.f / FMath::Max(ActorInfo->Actor->NetUpdateFrequency, KINDA_SMALL_NUMBER);
+
+			if (ActorInfo->NextUpdateTime > Now)
+			{
+				// Once per full-rate interval the actor sits out, not once per server frame
+				if (bUseAdaptiveNetUpdateFrequency && ActorInfo->NextFullRateDueTime <= Now)
+				{
+					if (ActorInfo->BackedOffStatsEpoch != AdaptiveNetUpdateStats.Epoch)
+					{
+						ActorInfo->BackedOffStatsEpoch = AdaptiveNetUpdateStats.Epoch;
+						AdaptiveNetUpdateStats.NumActorsBackedOff++;
+					}
+					AdaptiveNetUpdateStats.NumAvoidedReplicateActorCalls += ClientConnections.Num();
+					ActorInfo->NextFullRateDueTime += FullRateDelta;
+				}
+				continue;
+			}
+
+			// Considered now, so the next full-rate interval starts here
+			ActorInfo->NextFullRateDueTime = Now + FullRateDelta;
+			ActorInfo->ConsideredFrame = ReplicationFrame;
+
+			ActorInfo->bReplicatedThisFrame = false;
+
+			// Serial, so the parallel connection tasks only ever read owner chain caches
+			ActorInfo->Actor->UpdateOwnerChainCache();
+
+			if (ActorInfo->bOwnerOnlyIndexed)
+			{
+				if (ActorInfo->Actor->GetInstigator() != ActorInfo->IndexedInstigator)
+				{
+					OwnerOnlyReindexQueue.Add(ActorInfo);
+				}
+				ActorInfo->bOwnerOnlyDue = true;
+				OwnerOnlyConsiderList.Add(ActorInfo);
+				continue;
+			}
+
+			OutConsiderList.Add(ActorInfo);
+		}
+
+		ServerReplicateActors_UpdateOwnerOnlyIndex();
+
+		return OutConsiderList.Num();
+	}
+
+	/** After every connection had its go at the consider list: back off the actors nobody sent anything for */
+	void ServerReplicateActors_UpdateNetUpdateTimes(const TArray<FNetworkObjectInfo*>& ConsiderList)
+	{
+		const double Now = GetElapsedTime();
 
+		for (const TArray<FNetworkObjectInfo*>* List : { &ConsiderList, &OwnerOnlyConsiderList, &ScheduledConsiderList })
+		{
+			for (FNetworkObjectInfo* ActorInfo : *List)
+			{
+				const AActor* Actor = ActorInfo->Actor;
+				const float MinDelta = 1.f / FMath::Max(Actor->NetUpdateFrequency, KINDA_SMALL_NUMBER);
+				const float MaxDelta = FMath::Max(MinDelta, 1.f / FMath::Max(Actor->MinNetUpdateFrequency, KINDA_SMALL_NUMBER));
+
+				if (ActorInfo->bReplicatedThisFrame)
+				{
+					ActorInfo->LastNetReplicateTime = Now;
+					ActorInfo->ConsecutiveIdleUpdates = 0;
+					ActorInfo->bPendingNetUpdate = false;
+					ActorInfo->OptimalNetUpdateDelta = MinDelta;
+				}
+				else if (bUseAdaptiveNetUpdateFrequency && !ActorInfo->bPendingNetUpdate)
+				{
+					ActorInfo->ConsecutiveIdleUpdates++;
+					ActorInfo->OptimalNetUpdateDelta = FMath::Clamp(ActorInfo->OptimalNetUpdateDelta * AdaptiveNetUpdateBackoff, MinDelta, MaxDelta);
+
+					if (AutoDormancyIdleUpdates > 0 && Actor->NetDormancy == DORM_Awake && ActorInfo->ConsecutiveIdleUpdates >= uint32(AutoDormancyIdleUpdates))
+					{
+						ActorInfo->bAutoDormant = true;
+						const_cast<AActor*>(Actor)->NetDormancy = DORM_DormantAll;
+						NotifyActorDormancyChanged(const_cast<AActor*>(Actor));
+					}
+				}
+				else
+				{
+					ActorInfo->OptimalNetUpdateDelta = MinDelta;
+				}
+
+				ActorInfo->NextUpdateTime = Now + ActorInfo->OptimalNetUpdateDelta;
+
+				if (bUseIncrementalPriorityScheduler && bUseAdaptiveNetUpdateFrequency)
+				{
+					for (UNetConnection* Connection : ClientConnections)
+					{
+						Connection->PriorityScheduler.SetUpdateInterval(ActorInfo->Actor, ActorInfo->OptimalNetUpdateDelta);
+					}
+				}
+			}
+		}
+	}
+
+	/**
+	 * If > 0, DORM_Awake actors go DORM_DormantAll on their own after this many considerations in a row with nothing to send,
+	 * and wake up again on ForceNetUpdate. Idle considerations are only counted with bUseAdaptiveNetUpdateFrequency.
+	 */
+	UPROPERTY(Config)
+	int32 AutoDormancyIdleUpdates;
+
+	/**
+	 * Takes a channel out of replication on its connection. The channel stays open and keeps its index and replicators;
+	 * the actor leaves the connection's scheduler, and the consider list once it's dormant on every connection.
+	 */
+	void ServerReplicateActors_ParkChannel(UNetConnection* Connection, UActorChannel* Channel)
+	{
+		AActor* Actor = Channel->Actor;
+		Channel->bDormant = true;
+		Channel->bPendingDormancy = false;
+
+		Connection->PriorityScheduler.RemoveActor(Actor);
+		GetNetworkObjectList().MarkDormant(Actor, Connection, ClientConnections.Num());
+	}
+
+	/** See AActor::SetNetDormancy */
+	void NotifyActorDormancyChanged(AActor* Actor)
+	{
+		if (Actor->NetDormancy <= DORM_Awake)
+		{
+			FlushActorDormancy(Actor);
+
+			for (UNetConnection* Connection : ClientConnections)
+			{
+				if (UActorChannel* Channel = Connection->FindActorChannelRef(Actor))
+				{
+					Channel->bPendingDormancy = false;
+				}
+			}
+			return;
+		}
+
+		// Every open channel sends what it still has to, then parks on its next consideration
+		for (UNetConnection* Connection : ClientConnections)
+		{
+			if (UActorChannel* Channel = Connection->FindActorChannelRef(Actor))
+			{
+				Channel->bPendingDormancy = !Channel->bDormant;
+			}
+		}
+	}
+
+	/**
+	 * Actor's replicated state changed while dormant. Only the connections it is parked on are woken; connections where
+	 * it is still awake (or has no channel) already replicate it normally.
+	 */
+	void FlushActorDormancy(AActor* Actor)
+	{
+		FNetworkObjectInfo* ActorInfo = FindNetworkObjectInfo(Actor);
+		if (!ActorInfo)
+		{
+			return;
+		}
+
+		// Still dormant after this update goes out
+		const bool bParkAgain = Actor->NetDormancy > DORM_Awake;
+
+		for (const TWeakObjectPtr<UNetConnection>& WeakConnection : ActorInfo->DormantConnections)
+		{
+			UNetConnection* Connection = WeakConnection.Get();
+			UActorChannel* Channel = Connection ? Connection->FindActorChannelRef(Actor) : nullptr;
+			if (!Channel)
+			{
+				continue;
+			}
+
+			Channel->bDormant = false;
+			Channel->bPendingDormancy = bParkAgain;
+		}
+
+		// Back in the schedulers it was parked out of, or never added to (placed DORM_Initial). No-op where it already is.
+		if (bUseIncrementalPriorityScheduler && !ActorInfo->bOwnerOnlyIndexed)
+		{
+			for (UNetConnection* Connection : ClientConnections)
+			{
+				Connection->PriorityScheduler.AddActor(Actor, GetElapsedTime());
+			}
+		}
+
+		GetNetworkObjectList().MarkActive(Actor);
+		ForceNetUpdate(Actor);
+	}
+
+	/** A new connection has to see every actor once, including those dormant on every other connection */
+	void NotifyClientConnectionAdded(UNetConnection* Connection)
+	{
+		GetNetworkObjectList().HandleConnectionAdded();
+
+		// AddNetworkActor only filled the schedulers of connections that existed then. Placed DORM_Initial actors stay
+		// dormant on all connections (the client has them from the map) and owner-only actors go through their own index.
+		if (bUseIncrementalPriorityScheduler)
+		{
+			const double Now = GetElapsedTime();
+			for (const TSharedPtr<FNetworkObjectInfo>& InfoPtr : GetNetworkObjectList().GetActiveObjects())
+			{
+				if (!InfoPtr->bOwnerOnlyIndexed)
+				{
+					Connection->PriorityScheduler.AddActor(InfoPtr->Actor, Now);
+				}
+			}
+		}
+	}
+
+	/** Called once Connection is out of ClientConnections */
+	void NotifyClientConnectionRemoved(UNetConnection* Connection)
+	{
+		GetNetworkObjectList().HandleConnectionRemoved(Connection, ClientConnections.Num());
+	}
+
+	/** A replicated property of Actor was dirtied or an RPC was queued on it: consider it again on the next frame at full rate */
+	void ForceNetUpdate(AActor* Actor)
+	{
+		FNetworkObjectInfo* ActorInfo = FindNetworkObjectInfo(Actor);
+		if (!ActorInfo)
+		{
+			return;
+		}
+
+		if (ActorInfo->ConsecutiveIdleUpdates > 0)
+		{
+			AdaptiveNetUpdateStats.NumSnapBacks++;
+		}
+
+		ActorInfo->ConsecutiveIdleUpdates = 0;
+		ActorInfo->bPendingNetUpdate = true;
+
+		// Dormancy we put the actor in ourselves ends as soon as it has something to send
+		if (ActorInfo->bAutoDormant)
+		{
+			ActorInfo->bAutoDormant = false;
+			Actor->NetDormancy = DORM_Awake;
+			FlushActorDormancy(Actor);
+		}
+		ActorInfo->OptimalNetUpdateDelta = 1.f / FMath::Max(Actor->NetUpdateFrequency, KINDA_SMALL_NUMBER);
+		ActorInfo->NextUpdateTime = 0.0;
+
+		if (bUseIncrementalPriorityScheduler)
+		{
+			for (UNetConnection* Connection : ClientConnections)
+			{
+				Connection->PriorityScheduler.SetUpdateInterval(Actor, 0.f, true);
+			}
+		}
+	}
+
+	/** Queues an RPC on Actor's channels. Unreliable multicasts and client RPCs are sent with the next replication of the actor. */
+	virtual void ProcessRemoteFunction(AActor* Actor, UFunction* Function, void* Parameters, FOutParmRec* OutParms, FFrame* Stack, UObject* SubObject = nullptr)
+	{
+		// Don't let a backed-off actor sit on a queued RPC for up to 1 / MinNetUpdateFrequency
+		if (bUseAdaptiveNetUpdateFrequency)
+		{
+			ForceNetUpdate(Actor);
+		}
+
+		// ...
+	}
+
+	/** Once per tick, before any connection is processed. Re-buckets the actors that moved. */
+	void ServerReplicateActors_UpdateRelevancyGrid(const TArray<FNetworkObjectInfo*>& ConsiderList)
+	{
+		if (!bUseRelevancyGrid)
+		{
+			return;
+		}
+
+		for (FNetworkObjectInfo* ActorInfo : ConsiderList)
+		{
+			RelevancyGrid.UpdateActor(ActorInfo->Actor);
+		}
+		for (FNetworkObjectInfo* ActorInfo : OwnerOnlyConsiderList)
+		{
+			RelevancyGrid.UpdateActor(ActorInfo->Actor);
+		}
+	}
+
+
+	/**
+	 * If true, the prioritization and relevancy passes of every client connection run as tasks on the task graph workers.
+	 * ReplicateActor and everything else that touches driver-wide state (NetGUID cache, changelist managers, channel pool,
+	 * game subobject callbacks) then runs on the game thread, connection after connection, exactly as without it.
+	 */
+	UPROPERTY(Config)
+	uint32 bParallelConnectionReplication:1;
+
+	/** If true, connections that are up to date with an actor share one serialized payload per frame, see FSharedReplicationPayloadCache */
+	UPROPERTY(Config)
+	uint32 bShareReplicationPayloads:1;
+
+	FSharedReplicationPayloadCache SharedReplicationPayloads;
+
+	/** Replicates to every connection in Tasks, prioritizing them in parallel first if bParallelConnectionReplication is set */
+	int32 ServerReplicateActors_ReplicateConnections(TArray<FConnectionReplicationTask>& Tasks, const TArray<FNetworkObjectInfo*>& ConsiderList, const bool bCPUSaturated)
+	{
+		ServerReplicateActors_SubmitConnections(Tasks, ConsiderList, bCPUSaturated, OwnTaskScheduler);
+		OwnTaskScheduler.Run();
+		return ServerReplicateActors_FinishConnections(Tasks);
+	}
+
+	/**
+	 * First half of ServerReplicateActors_ReplicateConnections. Serially, this replicates every connection right away.
+	 * In parallel, each connection's prioritization and relevancy become a task on Scheduler, and Tasks and ConsiderList must
+	 * live until Scheduler.Run returns.
+	 */
+	void ServerReplicateActors_SubmitConnections(TArray<FConnectionReplicationTask>& Tasks, const TArray<FNetworkObjectInfo*>& ConsiderList, const bool bCPUSaturated, FNetTaskScheduler& Scheduler)
+	{
+		SharedReplicationPayloads.BeginFrame(ReplicationFrame);
+
+		for (FConnectionReplicationTask& Task : Tasks)
+		{
+			Task.Connection->PurgeStaleActorChannels();
+			ServerReplicateActors_UpdateOwnerOnlyViewerRoots(Task.Connection, Task.ConnectionViewers);
+
+			// Serial too: what's popped may need its grid cell updated before any task computes relevancy
+			if (bUseIncrementalPriorityScheduler)
+			{
+				ServerReplicateActors_PopScheduledActors(Task.Connection, Task.ScheduledActors);
+			}
+		}
+
+		auto PrioritizeConnection = [this, &ConsiderList, bCPUSaturated](FConnectionReplicationTask& Task, FActorPriority**& OutPriorityActors) -> int32
+		{
+			FActorPriority* PriorityList = nullptr;
+
+			// Owner-only actors of other connections are never looked at
+			TArray<FNetworkObjectInfo*> OwnerOnlyActors;
+			ServerReplicateActors_GatherOwnerOnlyActors(Task.ConnectionViewers, OwnerOnlyActors);
+
+			return bUseIncrementalPriorityScheduler
+				? ServerReplicateActors_BuildScheduledPriorityList(Task.Connection, Task.ConnectionViewers, OwnerOnlyActors, Task.ScheduledActors, PriorityList, OutPriorityActors)
+				: ServerReplicateActors_PrioritizeActors(Task.Connection, Task.ConnectionViewers, ConsiderList, OwnerOnlyActors, bCPUSaturated, PriorityList, OutPriorityActors);
+		};
+
+		if (!bParallelConnectionReplication)
+		{
+			for (FConnectionReplicationTask& Task : Tasks)
+			{
+				FActorPriority** PriorityActors = nullptr;
+				const int32 FinalSortedCount = PrioritizeConnection(Task, PriorityActors);
+				ServerReplicateActors_ProcessPrioritizedActors(Task.Connection, Task.ConnectionViewers, PriorityActors, FinalSortedCount, Task.Updated);
+			}
+		}
+		else
+		{
+			Scheduler.AddTasks(NetTaskPriority, Tasks.Num(), [this, &Tasks, PrioritizeConnection](int32 TaskIndex)
+			{
+				FConnectionReplicationTask& Task = Tasks[TaskIndex];
+
+				FMemMark Mark(FMemStack::Get());
+				FActorPriority** PriorityActors = nullptr;
+				const int32 FinalSortedCount = PrioritizeConnection(Task, PriorityActors);
+
+				Task.PriorityList.Reset(FinalSortedCount);
+				for (int32 i = 0; i < FinalSortedCount; i++)
+				{
+					Task.PriorityList.Add(*PriorityActors[i]);
+				}
+				ServerReplicateActors_ComputeRelevancy(Task);
+			});
+		}
+	}
+
+	/**
+	 * Worker half of a parallel connection: which of its prioritized actors pass IsNetRelevantFor. Only reads the world,
+	 * the relevancy grid and the connection's own channels.
+	 */
+	void ServerReplicateActors_ComputeRelevancy(FConnectionReplicationTask& Task) const
+	{
+		TSet<AActor*> RelevancyCandidates;
+		ServerReplicateActors_GatherRelevancyCandidates(Task.ConnectionViewers, RelevancyCandidates);
+
+		Task.Relevant.Init(false, Task.PriorityList.Num());
+		for (int32 i = 0; i < Task.PriorityList.Num(); i++)
+		{
+			const FActorPriority& Priority = Task.PriorityList[i];
+			if (!Priority.Channel || !Priority.Channel->bDormant)
+			{
+				Task.Relevant[i] = ServerReplicateActors_IsRelevant(Priority.ActorInfo->Actor, Task.ConnectionViewers, RelevancyCandidates);
+			}
+		}
+	}
+
+	/** Second half of ServerReplicateActors_ReplicateConnections, once the tasks ran. Returns the number of actors updated. */
+	int32 ServerReplicateActors_FinishConnections(TArray<FConnectionReplicationTask>& Tasks)
+	{
+		if (bParallelConnectionReplication)
+		{
+			// In connection order, so the bunches and channel indices are the same as replicating serially
+			for (FConnectionReplicationTask& Task : Tasks)
+			{
+				TArray<FActorPriority*> PriorityActors;
+				PriorityActors.Reserve(Task.PriorityList.Num());
+				for (FActorPriority& Priority : Task.PriorityList)
+				{
+					PriorityActors.Add(&Priority);
+				}
+
+				ServerReplicateActors_ProcessPrioritizedActors(Task.Connection, Task.ConnectionViewers, PriorityActors.GetData(), PriorityActors.Num(), Task.Updated, &Task.Relevant);
+				Task.PriorityList.Reset();
+			}
+		}
+
+		if (bUseIncrementalPriorityScheduler)
+		{
+			for (FConnectionReplicationTask& Task : Tasks)
+			{
+				Task.Connection->PriorityScheduler.EndTick();
+			}
+		}
+
+		int32 Updated = 0;
+		for (const FConnectionReplicationTask& Task : Tasks)
+		{
+			Updated += Task.Updated;
+		}
+		return Updated;
+	}
+
+	/** Everything that isn't in OutCandidates, and isn't an owner candidate, is known to fail IsNetRelevantFor for every viewer */
+	void ServerReplicateActors_GatherRelevancyCandidates(const TArray<FNetViewer>& ConnectionViewers, TSet<AActor*>& OutCandidates) const
+	{
+		if (bUseRelevancyGrid)
+		{
+			for (const FNetViewer& Viewer : ConnectionViewers)
+			{
+				RelevancyGrid.GatherCandidates(Viewer, OutCandidates);
+			}
+		}
+	}
+
+	bool ServerReplicateActors_IsRelevant(AActor* Actor, const TArray<FNetViewer>& ConnectionViewers, const TSet<AActor*>& RelevancyCandidates) const
+	{
+		const bool bIsCandidate = !bUseRelevancyGrid || RelevancyCandidates.Contains(Actor) || FNetRelevancyGrid::IsOwnerCandidate(Actor, ConnectionViewers);
+		return bIsCandidate && IsActorRelevantToConnection(Actor, ConnectionViewers);
+	}
+
+	/**
+	 * Game thread only. PrecomputedRelevancy is set for connections whose relevancy was worked out by a parallel task,
+	 * with one bit per entry of PriorityActors.
+	 */
+	int32 UNetDriver::ServerReplicateActors_ProcessPrioritizedActors(
+		UNetConnection* Connection,
+		const TArray<FNetViewer>& ConnectionViewers, 
+		FActorPriority** PriorityActors, 
+		const int32 FinalSortedCount, 
+		int32& OutUpdated,
+		const TBitArray<>* PrecomputedRelevancy = nullptr )
+	{
+		TSet<AActor*> RelevancyCandidates;
+		if (!PrecomputedRelevancy)
+		{
+			ServerReplicateActors_GatherRelevancyCandidates(ConnectionViewers, RelevancyCandidates);
+		}
+
+		for ( int32 j = 0; j < FinalSortedCount; j++ )
+		{
+			// Out of budget for this tick: CurrentNetSpeed, i.e. the congestion controller's rate when bUseCongestionControl is set
+			if (!Connection->IsNetReady(false))
+			{
+				// With the scheduler, actors popped but not replicated are first in line next tick (EndTick)
+				for (int32 k = j; k < FinalSortedCount; k++)
+				{
+					PriorityActors[k]->ActorInfo->bPendingNetUpdate = true;
+				}
+				return j;
+			}
+
+			FNetworkObjectInfo* ActorInfo = PriorityActors[j]->ActorInfo;
+
+			UActorChannel* Channel = PriorityActors[j]->Channel;
+
+			// Parked: nothing changed since it went dormant on this connection, FlushActorDormancy wakes it
+			if (Channel && Channel->bDormant)
+			{
+				continue;
+			}
+
+			if ( !Channel || Channel->Actor ) //make sure didn't just close this channel
+			{
+				AActor* Actor = ActorInfo->Actor;
+				const bool bIsRelevant = PrecomputedRelevancy ? (*PrecomputedRelevancy)[j] : ServerReplicateActors_IsRelevant(Actor, ConnectionViewers, RelevancyCandidates);
+				if ( bIsRelevant )
+				{
+					// Create UActorChannel for AActor
+					if (Channel == NULL)
+					{
+						// Create a new channel for this actor.
+						Channel = Connection->CreateChannelByName(NAME_Actor);
+						if (Channel)
+						{
+							Channel->SetChannelActor(Actor, ESetChannelActorFlags::None);
+							Channel->bPendingDormancy = Actor->NetDormancy > DORM_Awake;
+						}
+					}
+				}
+
+				if (Channel->ReplicateActor())
+				{
+					OutUpdated++;
+					ActorInfo->bReplicatedThisFrame = true;
+				}
+
+				// Final state is out and ACKed: park the channel instead of replicating an unchanging actor every tick
+				if (Channel->bPendingDormancy && Channel->ReadyForDormancy())
+				{
+					ServerReplicateActors_ParkChannel(Connection, Channel);
+					continue;
+				}
+
+				// If the actor wasn't recently relevant, or if it was torn off, close the actor channel if it exists for this connection
+				if (!bIsRecentlyRelevant)
+				{
+					Channel->Close(Actor->GetTearOff() ? EChannelCloseReason::TearOff : EChannelCloseReason::Relevancy);
+				}
+			}
+
+			if (bUseIncrementalPriorityScheduler)
+			{
+				Connection->PriorityScheduler.OnActorReplicated(ActorInfo->Actor, GetElapsedTime());
+			}
+		}
+
+		return FinalSortedCount;
+		
+	};
+
+};
+
+
+UCLASS(transient, config = Engine)
+class WEBSOCKETNETWORKING_API UWebSocketNetDriver : public UNetDriver
+{
+
+};
+
+
+UCLASS(transient, config=Engine)
+class ONLINESUBSYSTEMUTILS_API UIpNetDriver : public UNetDriver
+{
+	/**
+	 * If true, TickDispatch reads up to FBatchedDatagramSocket::BatchSize packets per syscall, and packets sent by all connections
+	 * are queued and written in one batch at the end of TickFlush. Falls back to one syscall per packet where unsupported.
+	 */
+	UPROPERTY(Config)
+	uint32 bUseBatchedSocketIO:1;
+
+	/** If true and the kernel supports it, the batched path lets the kernel segment runs of packets to the same client (UDP GSO) */
+	UPROPERTY(Config)
+	uint32 bUseUdpGSO:1;
+
+	FBatchedDatagramSocket BatchedSocket;
+
+	/** If true, a dedicated thread drains the socket into a ring of preallocated packets that TickDispatch consumes */
+	UPROPERTY(Config)
+	uint32 bUseReceiveThread:1;
+
+	/** Packets the receive thread can hold for the game thread, rounded up to a power of two */
+	UPROPERTY(Config)
+	int32 ReceiveThreadRingSize;
+
+	TUniquePtr<FNetReceiveThread> ReceiveThread;
+
+	/**
+	 * If true, connectionless packets go through HandshakeFastPath instead of the PacketHandler's stateless handshake.
+	 * Clients must use it too (UPendingNetGame starts it through BeginClientFastPathHandshake), so enable it on both sides.
+	 */
+	UPROPERTY(Config)
+	uint32 bUseHandshakeFastPath:1;
+
+	FStatelessHandshakeFastPath HandshakeFastPath;
+
+	/** Server side: the ChallengeResponse each new connection was accepted with, so the client's resends of it are dropped */
+	TMap<TWeakObjectPtr<UNetConnection>, TArray<uint8>> AcceptedHandshakeResponses;
+
+	/** Client side of the fast path handshake */
+	enum class EClientFastPathStep : uint8
+	{
+		None,
+
+		/** Hello sent, waiting for the Challenge */
+		AwaitingChallenge,
+
+		/** ChallengeResponse sent, resent until the server's first game packet shows it was accepted */
+		AwaitingServer,
+	};
+
+	EClientFastPathStep ClientFastPathStep = EClientFastPathStep::None;
+
+	/** The Hello or ChallengeResponse the client resends every ClientHandshakeResendTime */
+	uint8 ClientHandshakePacket[FStatelessHandshakeFastPath::ChallengePacketSize];
+	double LastClientHandshakeSendTime = 0.0;
+
+	static constexpr double ClientHandshakeResendTime = 0.5;
+
+	FSimpleDelegate OnClientFastPathComplete;
+
+	/** Maps client addresses to their connection, see "Startup and Handshaking" above */
+	TMap<TSharedRef<const FInternetAddr>, UNetConnection*, FDefaultSetAllocator, FInternetAddrConstKeyMapFuncs<UNetConnection*>> MappedClientConnections;
+
+	virtual bool InitBase(bool bInitAsClient, FNetworkNotify* InNotify, const FURL& URL, bool bReuseAddressAndPort, FString& Error) override
+	{
+		if (!Super::InitBase(bInitAsClient, InNotify, URL, bReuseAddressAndPort, Error))
+		{
+			return false;
+		}
+
+		if (bUseHandshakeFastPath)
+		{
+			HandshakeFastPath.Init(FPlatformTime::Seconds());
+		}
+
+		if (bUseReceiveThread)
+		{
+			ReceiveThread = MakeUnique<FNetReceiveThread>(GetSocket(), GetSocketSubsystem(), FMath::RoundUpToPowerOfTwo(ReceiveThreadRingSize));
+		}
+
+		if (bUseBatchedSocketIO)
+		{
+			BatchedSocket.Init(GetSocket(), GetSocketSubsystem(), bUseUdpGSO);
+			UE_LOG(LogNet, Log, TEXT("%s: batched socket IO enabled (batching supported: %d, GSO: %d)"), *GetName(), BatchedSocket.IsBatchingSupported(), BatchedSocket.IsGSOSupported());
+		}
+		return true;
+	}
+
+	virtual void TickDispatch(float DeltaTime) override
+	{
+		Super::TickDispatch(DeltaTime);
+
+		if (bUseHandshakeFastPath)
+		{
+			HandshakeFastPath.Tick(FPlatformTime::Seconds());
+		}
+
+		if (ClientFastPathStep != EClientFastPathStep::None && FPlatformTime::Seconds() - LastClientHandshakeSendTime >= ClientHandshakeResendTime)
+		{
+			SendClientHandshakePacket();
+		}
+
+		if (ReceiveThread)
+		{
+			TickDispatchFromReceiveThread();
+			return;
+		}
+
+		if (!bUseBatchedSocketIO)
+		{
+			TickDispatchOneByOne();
+			return;
+		}
+
+		FReceivedDatagram Datagrams[FBatchedDatagramSocket::BatchSize];
+		for (int32 NumReceived = BatchedSocket.ReceiveBatch(Datagrams); NumReceived > 0; NumReceived = BatchedSocket.ReceiveBatch(Datagrams))
+		{
+			for (int32 i = 0; i < NumReceived; i++)
+			{
+				FReceivedDatagram& Datagram = Datagrams[i];
+				UNetConnection* Connection = ServerConnection;
+				if (!Connection)
+				{
+					Connection = MappedClientConnections.FindRef(Datagram.FromAddr.ToSharedRef());
+				}
+
+				if (Connection)
+				{
+					DispatchConnectionPacket(Connection, Datagram.Data, Datagram.Size);
+				}
+				else
+				{
+					ProcessConnectionlessPacket(Datagram.FromAddr.ToSharedRef(), Datagram.Data, Datagram.Size);
+				}
+			}
+
+			// Challenges for the whole batch go out together
+			if (bUseHandshakeFastPath)
+			{
+				BatchedSocket.Flush();
+			}
+		}
+	}
+
+	/**
+	 * Packet from an address with no connection. With the fast path, nothing is allocated for the sender
+	 * until it echoes back a valid cookie.
+	 */
+	void ProcessConnectionlessPacket(const TSharedRef<const FInternetAddr>& Address, const uint8* Data, int32 CountBytes)
+	{
+		if (!bUseHandshakeFastPath)
+		{
+			ProcessConnectionlessPacketWithHandler(Address, Data, CountBytes);
+			return;
+		}
+
+		uint8 Challenge[FStatelessHandshakeFastPath::ChallengePacketSize];
+		bool bConnectionVerified = false;
+		if (HandshakeFastPath.ProcessPacket(*Address, Data, CountBytes, FPlatformTime::Seconds(), Challenge, bConnectionVerified))
+		{
+			if (bUseBatchedSocketIO)
+			{
+				BatchedSocket.QueueSend(*Address, Challenge, sizeof(Challenge));
+			}
+			else
+			{
+				int32 BytesSent = 0;
+				GetSocket()->SendTo(Challenge, sizeof(Challenge), BytesSent, *Address);
+			}
+		}
+		else if (bConnectionVerified && Notify->NotifyAcceptingConnection() == EAcceptConnection::Accept)
+		{
+			// Only now does the client get a UNetConnection; game level handshaking (NMT_Hello...) continues on it
+			UIpConnection* Connection = NewObject<UIpConnection>(GetTransientPackage(), NetConnectionClass);
+			Connection->InitRemoteConnection(this, GetSocket(), World ? World->URL : FURL(), *Address, USOCK_Open);
+			Notify->NotifyAcceptedConnection(Connection);
+			AddClientConnection(Connection);
+			MappedClientConnections.Add(Address, Connection);
+			AcceptedHandshakeResponses.Add(Connection, TArray<uint8>(Data, CountBytes));
+		}
+	}
+
+	/** Packet from the address of an existing connection. Handshake packets still in flight are handled here instead. */
+	void DispatchConnectionPacket(UNetConnection* Connection, const uint8* Data, int32 CountBytes)
+	{
+		if (Connection == ServerConnection && ClientFastPathStep != EClientFastPathStep::None)
+		{
+			if (!ReceivedClientHandshakePacket(Data, CountBytes))
+			{
+				return;
+			}
+		}
+		else if (AcceptedHandshakeResponses.Num() > 0)
+		{
+			if (const TArray<uint8>* Response = AcceptedHandshakeResponses.Find(Connection))
+			{
+				if (Response->Num() == CountBytes && FMemory::Memcmp(Response->GetData(), Data, CountBytes) == 0)
+				{
+					return;
+				}
+
+				// The client got past the handshake, it won't resend the response anymore
+				AcceptedHandshakeResponses.Remove(Connection);
+			}
+		}
+
+		Connection->ReceivedRawPacket((uint8*)Data, CountBytes);
+	}
+
+	/** Returns true if the packet isn't part of the handshake and should go to the server connection */
+	bool ReceivedClientHandshakePacket(const uint8* Data, int32 CountBytes)
+	{
+		uint8 Response[FStatelessHandshakeFastPath::ChallengePacketSize];
+		if (FStatelessHandshakeFastPath::MakeChallengeResponse(Data, CountBytes, Response))
+		{
+			// Also for a Challenge to a resent Hello: the latest cookie is as good as any
+			FMemory::Memcpy(ClientHandshakePacket, Response, sizeof(Response));
+			SendClientHandshakePacket();
+
+			if (ClientFastPathStep == EClientFastPathStep::AwaitingChallenge)
+			{
+				// NMT_Hello can follow right away, its packets are resent until the server created our connection
+				ClientFastPathStep = EClientFastPathStep::AwaitingServer;
+				OnClientFastPathComplete.ExecuteIfBound();
+			}
+			return false;
+		}
+
+		if (ClientFastPathStep == EClientFastPathStep::AwaitingChallenge)
+		{
+			return false;
+		}
+
+		ClientFastPathStep = EClientFastPathStep::None;
+		return true;
+	}
+
+	void SendClientHandshakePacket()
+	{
+		LastClientHandshakeSendTime = FPlatformTime::Seconds();
+
+		int32 BytesSent = 0;
+		GetSocket()->SendTo(ClientHandshakePacket, sizeof(ClientHandshakePacket), BytesSent, *ServerConnection->RemoteAddr);
+	}
+
+	bool IsUsingHandshakeFastPath() const
+	{
+		return bUseHandshakeFastPath;
+	}
+
+	/** Client side: Hello / Challenge / ChallengeResponse with a server using the fast path. OnComplete fires once the response is sent. */
+	void BeginClientFastPathHandshake(FSimpleDelegate OnComplete)
+	{
+		check(ServerConnection);
+		OnClientFastPathComplete = MoveTemp(OnComplete);
+		ClientFastPathStep = EClientFastPathStep::AwaitingChallenge;
+
+		FStatelessHandshakeFastPath::WriteHello(ClientHandshakePacket);
+		SendClientHandshakePacket();
+	}
+
+	/** Neither batched IO nor the receive thread: one RecvFrom per packet, dispatched the same way as theirs */
+	void TickDispatchOneByOne()
+	{
+		ISocketSubsystem* SocketSubsystem = GetSocketSubsystem();
+		TSharedRef<FInternetAddr> FromAddr = SocketSubsystem->CreateInternetAddr();
+
+		uint8 Data[MAX_PACKET_SIZE];
+		int32 BytesRead = 0;
+		while (GetSocket()->RecvFrom(Data, sizeof(Data), BytesRead, *FromAddr) && BytesRead > 0)
+		{
+			UNetConnection* Connection = ServerConnection ? ServerConnection.Get() : MappedClientConnections.FindRef(FromAddr);
+
+			if (Connection)
+			{
+				DispatchConnectionPacket(Connection, Data, BytesRead);
+			}
+			else
+			{
+				// A new connection keeps the address as its MappedClientConnections key, the next packet needs its own
+				ProcessConnectionlessPacket(FromAddr, Data, BytesRead);
+				FromAddr = SocketSubsystem->CreateInternetAddr();
+			}
+		}
+	}
+
+	/** Processes everything the receive thread queued since last frame. The socket itself is only read by the receive thread. */
+	void TickDispatchFromReceiveThread()
+	{
+		const double ProcessTime = FPlatformTime::Seconds();
+
+		while (const FNetReceivedPacket* Packet = ReceiveThread->Ring.Peek())
+		{
+			TSharedRef<FInternetAddr> FromAddr = Packet->FromAddr.ToSharedRef();
+			UNetConnection* Connection = ServerConnection ? ServerConnection.Get() : MappedClientConnections.FindRef(FromAddr);
+
+			if (Connection)
+			{
+				Connection->ReceiveTimingStats.RecordArrival(Packet->ReceiveTime, ProcessTime);
+				DispatchConnectionPacket(Connection, Packet->Data, Packet->Size);
+			}
+			else
+			{
+				// The slot's address is reused by the receive thread once popped, so new connections must clone it
+				ProcessConnectionlessPacket(FromAddr->Clone(), Packet->Data, Packet->Size);
+			}
+
+			ReceiveThread->Ring.Pop();
+		}
+	}
+
+	virtual void LowLevelDestroy() override
+	{
+		// Before the socket goes away
+		ReceiveThread.Reset();
+		if (bUseBatchedSocketIO)
+		{
+			BatchedSocket.Flush();
+		}
+
+		Super::LowLevelDestroy();
+	}
+
+	/** Called by UIpConnection::LowLevelSend instead of FSocket::SendTo when batching */
+	void QueueBatchedSend(const FInternetAddr& ToAddr, const uint8* Data, int32 CountBytes)
+	{
+		BatchedSocket.QueueSend(ToAddr, Data, CountBytes);
+	}
+
+	bool IsUsingBatchedSocketIO() const
+	{
+		return bUseBatchedSocketIO;
+	}
+
+	virtual void TickFlushComplete(float DeltaSeconds) override
+	{
+		// Every connection flushes into the batch here...
+		Super::TickFlushComplete(DeltaSeconds);
+
+		// ...and it all goes out in as few syscalls as possible
+		if (bUseBatchedSocketIO)
+		{
+			BatchedSocket.Flush();
+		}
+	}
+};
+
+UCLASS(transient, config=Engine)
+class ONLINESUBSYSTEMUTILS_API UIpConnection : public UNetConnection
+{
+	virtual void LowLevelSend(void* Data, int32 CountBits, FOutPacketTraits& Traits) override
+	{
+		// ... PacketHandler processing, DataToSend / CountBytes are the final datagram ...
+		const uint8* DataToSend = reinterpret_cast<const uint8*>(Data);
+		const int32 CountBytes = FMath::DivideAndRoundUp(CountBits, 8);
+
+		// Game traffic of every connection goes out in UIpNetDriver::TickFlushComplete's single flush
+		UIpNetDriver* IpDriver = static_cast<UIpNetDriver*>(Driver);
+		if (IpDriver->IsUsingBatchedSocketIO())
+		{
+			IpDriver->QueueBatchedSend(*RemoteAddr, DataToSend, CountBytes);
+			return;
+		}
+
+		int32 BytesSent = 0;
+		Socket->SendTo(DataToSend, CountBytes, BytesSent, *RemoteAddr);
+	}
+};
+
+UCLASS(transient, config=Engine)
+class ENGINE_API UDemoNetDriver : public UNetDriver
+{
+	/** Uncompressed bytes per replay chunk. Bigger chunks compress better, smaller ones are cheaper to decode after a seek. */
+	UPROPERTY(Config)
+	int32 ReplayChunkSize;
+
+	/** Seconds between keyframes. A seek fast-forwards through at most this much of the recording. */
+	UPROPERTY(Config)
+	float ReplayKeyframeInterval;
+
+	UPROPERTY(Config)
+	EReplayCompression ReplayCompression;
+
+	/** If true, records are compressed and written by FReplayWriteThread rather than in TickFlush */
+	UPROPERTY(Config)
+	uint32 bUseAsyncReplayWriter:1;
+
+	/** Bytes the async writer may fall behind before frames are dropped, see FReplayWriteThread */
+	UPROPERTY(Config)
+	int32 MaxQueuedReplayBytes;
+
+	/** See FReplayChunkFile.h. The writer belongs to ReplayWriteThread while there is one. */
+	FReplayChunkWriter ReplayWriter;
+	FReplayChunkReader ReplayReader;
+
+	TUniquePtr<FReplayWriteThread> ReplayWriteThread;
+
+	/** Streams the same records to a USpectatorRelayNetDriver, see FBroadcastStream.h */
+	FBroadcastStreamSender BroadcastSender;
+
+	/** Recording to a file, broadcasting, or both */
+	bool bRecordingReplay;
+
+	/** Time in the replay, in seconds, recording or playing */
+	double DemoCurrentTime;
+
+	double LastKeyframeTime;
+
+	/** Packets the demo connection sent this frame, each prefixed with its size. Written out as one frame record in TickFlush. */
+	TArray<uint8> FramePackets;
+
+	/** Only set while SaveKeyframe runs, see RecordPacket */
+	UPROPERTY()
+	TObjectPtr<UNetConnection> KeyframeConnection;
+
+	TArray<uint8>* KeyframePackets = nullptr;
+
+	bool InitRecordReplay(const FString& Filename)
+	{
+		if (!ReplayWriter.Open(Filename, ReplayChunkSize, ReplayCompression))
+		{
+			return false;
+		}
+
+		if (bUseAsyncReplayWriter)
+		{
+			ReplayWriteThread = MakeUnique<FReplayWriteThread>(ReplayWriter, MaxQueuedReplayBytes);
+		}
+		BeginRecording();
+		return true;
+	}
+
+	/** Game server: spectators are served by the relay at RelayAddress instead of connecting here */
+	bool InitBroadcast(const FString& RelayAddress)
+	{
+		if (!BroadcastSender.Connect(RelayAddress))
+		{
+			return false;
+		}
+
+		BeginRecording();
+		return true;
+	}
+
+	/** Playing records from NMT_BroadcastRecord rather than from ReplayReader, see CreateBroadcastPlayer */
+	bool bPlayingBroadcast;
+
+	/**
+	 * Viewer of a USpectatorRelayNetDriver: creates the world's demo driver that PlayBroadcastRecord plays into. Called by
+	 * UControlChannel on the first record, which the relay only sends once the viewer joined, so World is the loaded map.
+	 */
+	static UDemoNetDriver* CreateBroadcastPlayer(UWorld* World)
+	{
+		if (!GEngine->CreateNamedNetDriver(World, NAME_DemoNetDriver, NAME_DemoNetDriver))
+		{
+			return nullptr;
+		}
+
+		UDemoNetDriver* DemoNetDriver = Cast<UDemoNetDriver>(GEngine->FindNamedNetDriver(World, NAME_DemoNetDriver));
+		if (!DemoNetDriver || !DemoNetDriver->InitPlayBroadcast(World))
+		{
+			GEngine->DestroyNamedNetDriver(World, NAME_DemoNetDriver);
+			return nullptr;
+		}
+
+		World->DemoNetDriver = DemoNetDriver;
+		return DemoNetDriver;
+	}
+
+	/** The playback half of InitConnect, without a file: records come in through PlayBroadcastRecord */
+	bool InitPlayBroadcast(UWorld* InWorld)
+	{
+		SetWorld(InWorld);
+
+		ServerConnection = NewObject<UNetConnection>(GetTransientPackage(), NetConnectionClass);
+		ServerConnection->InitConnection(this, USOCK_Open, FURL(), 1000000);
+		ServerConnection->CreateChannelByName(NAME_Control, EChannelCreateFlags::OpenedLocally);
+
+		DemoCurrentTime = 0.0;
+		bPlayingBroadcast = true;
+		return true;
+	}
+
+	/** Viewer of a USpectatorRelayNetDriver: a record completed. The relay always starts a viewer on a resync keyframe. */
+	void PlayBroadcastRecord(const FBroadcastRecord& Record)
+	{
+		if (Record.Type == EReplayRecordType::Frame)
+		{
+			PlayFramePackets(Record.Data.GetData(), Record.Data.Num());
+		}
+		else if (Record.Type == EReplayRecordType::ResyncKeyframe)
+		{
+			LoadKeyframe(Record.Data.GetData(), Record.Data.Num());
+		}
+		DemoCurrentTime = Record.Time;
+	}
+
+	bool InitPlayReplay(const FString& Filename)
+	{
+		DemoCurrentTime = 0.0;
+		return ReplayReader.Open(Filename);
+	}
+
+	/** Called by UDemoNetConnection::LowLevelSend instead of sending anything */
+	void RecordPacket(UNetConnection* Connection, const uint8* Data, int32 CountBytes)
+	{
+		TArray<uint8>* Packets = Connection == KeyframeConnection ? KeyframePackets : &FramePackets;
+		if (Packets)
+		{
+			Packets->Append((const uint8*)&CountBytes, sizeof(int32));
+			Packets->Append(Data, CountBytes);
+		}
+	}
+
+	/**
+	 * Full checkpoint of the replicated world: what a client joining now would be sent, so loading it needs nothing before it.
+	 *
+	 *	[int32 NumGuids][static NetGUIDs: guid, outer guid, path, checksum, flags][packets, each prefixed with its size]
+	 *
+	 * The packets come from KeyframeConnection, a connection that only lives for the call. Actors open on the recording
+	 * connection get the same channel index, so the frames that follow the keyframe keep talking to the right channels.
+	 * Actors without a channel on it (dormant) are sent on a free index and closed dormant again, leaving the index to the frames.
+	 * Static NetGUIDs are all written, since frames may reference objects the recording connection exported long before.
+	 */
+	void SaveKeyframe(TArray<uint8>& OutData)
+	{
+		SCOPE_CYCLE_COUNTER(STAT_DemoSaveKeyframe);
+
+		OutData.Reset();
+		UNetConnection* RecordingConnection = ClientConnections.Num() > 0 ? ClientConnections[0] : nullptr;
+		if (!RecordingConnection)
+		{
+			return;
+		}
+
+		FMemoryWriter Writer(OutData);
+
+		int32 NumGuids = 0;
+		const int64 NumGuidsPos = Writer.Tell();
+		Writer << NumGuids;
+
+		for (const TPair<FNetworkGUID, FNetGuidCacheObject>& Entry : GuidCache->ObjectLookup)
+		{
+			FNetworkGUID NetGUID = Entry.Key;
+			if (!NetGUID.IsStatic() || Entry.Value.PathName == NAME_None)
+			{
+				continue;
+			}
+
+			FNetworkGUID OuterGUID = Entry.Value.OuterGUID;
+			FString PathName = Entry.Value.PathName.ToString();
+			uint32 NetworkChecksum = Entry.Value.NetworkChecksum;
+			uint8 Flags = (Entry.Value.bNoLoad ? 1 : 0) | (Entry.Value.bIgnoreWhenMissing ? 2 : 0);
+			Writer << NetGUID << OuterGUID << PathName << NetworkChecksum << Flags;
+			NumGuids++;
+		}
+
+		const int64 PacketsPos = Writer.Tell();
+		Writer.Seek(NumGuidsPos);
+		Writer << NumGuids;
+		Writer.Seek(PacketsPos);
+
+		// RecordPacket appends everything this connection sends after the GUIDs
+		KeyframeConnection = NewObject<UNetConnection>(GetTransientPackage(), NetConnectionClass);
+		KeyframeConnection->InitConnection(this, USOCK_Open, RecordingConnection->URL, RecordingConnection->CurrentNetSpeed);
+		KeyframePackets = &OutData;
+
+		TArray<UActorChannel*> DormantChannels;
+		for (int32 Pass = 0; Pass < 2; Pass++)
+		{
+			for (const TSharedPtr<FNetworkObjectInfo>& ActorInfo : GetNetworkObjectList().GetAllObjects())
+			{
+				AActor* Actor = ActorInfo->Actor;
+				if (!IsValid(Actor) || Actor->GetTearOff())
+				{
+					continue;
+				}
+
+				// Open channels first, so the free indices the dormant ones take can't be one of theirs
+				const UActorChannel* RecordingChannel = RecordingConnection->FindActorChannelRef(Actor);
+				if ((Pass == 0) != (RecordingChannel != nullptr))
+				{
+					continue;
+				}
+
+				UActorChannel* Channel = Cast<UActorChannel>(KeyframeConnection->CreateChannelByName(NAME_Actor, EChannelCreateFlags::OpenedLocally,
+					RecordingChannel ? RecordingChannel->ChIndex : INDEX_NONE));
+				if (!Channel)
+				{
+					UE_LOG(LogNet, Warning, TEXT("%s: no channel for %s in keyframe"), *GetName(), *Actor->GetName());
+					continue;
+				}
+
+				Channel->SetChannelActor(Actor, ESetChannelActorFlags::None);
+				Channel->ReplicateActor();
+
+				if (!RecordingChannel)
+				{
+					DormantChannels.Add(Channel);
+				}
+			}
+		}
+
+		for (UActorChannel* Channel : DormantChannels)
+		{
+			Channel->Close(EChannelCloseReason::Dormancy);
+		}
+		KeyframeConnection->FlushNet();
+
+		// Nothing of closing the connection belongs in the keyframe
+		KeyframePackets = nullptr;
+		KeyframeConnection->Close();
+		KeyframeConnection->CleanUp();
+		KeyframeConnection = nullptr;
+	}
+
+	/** Tears down the playback world's replicated actors and channels, and rebuilds them from a SaveKeyframe checkpoint */
+	void LoadKeyframe(const uint8* Data, int32 Num)
+	{
+		SCOPE_CYCLE_COUNTER(STAT_DemoLoadKeyframe);
+
+		FMemoryReaderView Reader(MakeArrayView(Data, Num));
+
+		int32 NumGuids = 0;
+		Reader << NumGuids;
+		if (Reader.IsError() || NumGuids < 0)
+		{
+			UE_LOG(LogNet, Warning, TEXT("%s: corrupt replay keyframe"), *GetName());
+			return;
+		}
+
+		// Everything the keyframe replicates is spawned again, startup actors are reused and get their state overwritten
+		for (int32 i = ServerConnection->OpenChannels.Num() - 1; i >= 0; i--)
+		{
+			UActorChannel* Channel = Cast<UActorChannel>(ServerConnection->OpenChannels[i]);
+			if (Channel)
+			{
+				Channel->ConditionalCleanUp(true, EChannelCloseReason::Destroyed);
+			}
+		}
+
+		for (FActorIterator It(World); It; ++It)
+		{
+			if (It->GetIsReplicated() && !It->IsNetStartupActor())
+			{
+				World->DestroyActor(*It, true);
+			}
+		}
+
+		GuidCache->ResetCacheForDemo();
+
+		for (int32 i = 0; i < NumGuids; i++)
+		{
+			FNetworkGUID NetGUID;
+			FNetworkGUID OuterGUID;
+			FString PathName;
+			uint32 NetworkChecksum = 0;
+			uint8 Flags = 0;
+			Reader << NetGUID << OuterGUID << PathName << NetworkChecksum << Flags;
+			if (Reader.IsError())
+			{
+				UE_LOG(LogNet, Warning, TEXT("%s: corrupt replay keyframe"), *GetName());
+				return;
+			}
+
+			GuidCache->RegisterNetGUIDFromPath_Client(NetGUID, PathName, OuterGUID, NetworkChecksum, (Flags & 1) != 0, (Flags & 2) != 0);
+		}
+
+		const int64 PacketsPos = Reader.Tell();
+		PlayFramePackets(Data + PacketsPos, Num - int32(PacketsPos));
+	}
+
+	virtual void TickFlushComplete(float DeltaSeconds) override
+	{
+		Super::TickFlushComplete(DeltaSeconds);
+
+		if (!bRecordingReplay)
+		{
+			return;
+		}
+
+		SCOPE_CYCLE_COUNTER(STAT_DemoRecordFrame);
+
+		DemoCurrentTime += DeltaSeconds;
+
+		// Frame first: a keyframe at the same time already includes this frame's changes, so seeking to it plays nothing after it
+		if (FramePackets.Num() > 0)
+		{
+			WriteRecord(EReplayRecordType::Frame, FramePackets);
+		}
+
+		const bool bResync = (ReplayWriteThread && ReplayWriteThread->IsReadyToResync()) || BroadcastSender.IsReadyToResync();
+		if (bResync || DemoCurrentTime - LastKeyframeTime >= ReplayKeyframeInterval)
+		{
+			TArray<uint8> Keyframe = ReplayWriteThread ? ReplayWriteThread->AcquireBuffer() : TArray<uint8>();
+			SaveKeyframe(Keyframe);
+			WriteRecord(EReplayRecordType::Keyframe, Keyframe);
+			LastKeyframeTime = DemoCurrentTime;
+		}
+
+		BroadcastSender.Flush();
+	}
+
+	/** Writes the record (or hands it to ReplayWriteThread) and broadcasts it, then leaves Data empty for reuse */
+	void WriteRecord(EReplayRecordType Type, TArray<uint8>& Data)
+	{
+		if (BroadcastSender.IsConnected())
+		{
+			BroadcastSender.QueueRecord(Type, DemoCurrentTime, Data.GetData(), Data.Num());
+		}
+
+		if (ReplayWriteThread)
+		{
+			if (ReplayWriteThread->QueueRecord(Type, DemoCurrentTime, MoveTemp(Data)))
+			{
+				Data = ReplayWriteThread->AcquireBuffer();
+			}
+		}
+		else if (ReplayWriter.IsOpen())
+		{
+			if (Type == EReplayRecordType::Frame)
+			{
+				ReplayWriter.WriteFrame(DemoCurrentTime, Data.GetData(), Data.Num());
+			}
+			else
+			{
+				ReplayWriter.WriteKeyframe(DemoCurrentTime, Data.GetData(), Data.Num());
+			}
+		}
+		Data.Reset();
+	}
+
+	virtual void TickDispatch(float DeltaTime) override
+	{
+		Super::TickDispatch(DeltaTime);
+
+		// Broadcast records are played as they arrive, and carry their own time
+		if (ServerConnection && !bPlayingBroadcast)
+		{
+			DemoCurrentTime += DeltaTime;
+			PlayRecordsUntil(DemoCurrentTime);
+		}
+	}
+
+	/**
+	 * Jumps to Time: loads the last keyframe at or before it, then plays the frames in between without ticking the world.
+	 * Replaces the delta checkpoint path (IgnoringChannels / IgnoredBunchChannels) for files in the chunked format.
+	 */
+	bool GotoTime(double Time)
+	{
+		const double StartTime = FPlatformTime::Seconds();
+
+		if (!ReplayReader.SeekToKeyframe(Time))
+		{
+			return false;
+		}
+
+		const FReplayRecord* Keyframe = ReplayReader.PeekRecord();
+		if (!Keyframe || Keyframe->Type == EReplayRecordType::Frame)
+		{
+			return false;
+		}
+
+		LoadKeyframe(Keyframe->Data, Keyframe->Num);
+		ReplayReader.PopRecord();
+
+		PlayRecordsUntil(Time);
+		DemoCurrentTime = Time;
+
+		UE_LOG(LogNet, Log, TEXT("%s: GotoTime %.2f took %.1f ms"), *GetName(), Time, (FPlatformTime::Seconds() - StartTime) * 1000.0);
+		return true;
+	}
+
+	virtual void LowLevelDestroy() override
+	{
+		// Writes the indices, without which the file can't be played back. The write thread drains its queue first.
+		ReplayWriteThread.Reset();
+		ReplayWriter.Close();
+		BroadcastSender.Close();
+		bRecordingReplay = false;
+		ReplayReader.Close();
+
+		Super::LowLevelDestroy();
+	}
+
+private:
+
+	void BeginRecording()
+	{
+		if (!bRecordingReplay)
+		{
+			DemoCurrentTime = 0.0;
+			LastKeyframeTime = -ReplayKeyframeInterval;
+			bRecordingReplay = true;
+		}
+	}
+
+	void PlayRecordsUntil(double Time)
+	{
+		while (const FReplayRecord* Record = ReplayReader.PeekRecord())
+		{
+			if (Record->Time > Time)
+			{
+				break;
+			}
+
+			// Keyframes only matter when seeking, playing on from the frames gives the same state. Except after dropped frames.
+			if (Record->Type == EReplayRecordType::Frame)
+			{
+				PlayFramePackets(Record->Data, Record->Num);
+			}
+			else if (Record->Type == EReplayRecordType::ResyncKeyframe)
+			{
+				LoadKeyframe(Record->Data, Record->Num);
+			}
+			ReplayReader.PopRecord();
+		}
+	}
+
+	void PlayFramePackets(const uint8* Data, int32 Num)
+	{
+		const uint8* const End = Data + Num;
+		while (End - Data >= int32(sizeof(int32)))
+		{
+			int32 CountBytes = 0;
+			FMemory::Memcpy(&CountBytes, Data, sizeof(int32));
+			Data += sizeof(int32);
+
+			if (CountBytes < 0 || CountBytes > End - Data)
+			{
+				UE_LOG(LogNet, Warning, TEXT("%s: corrupt replay frame"), *GetName());
+				return;
+			}
+
+			ServerConnection->ReceivedRawPacket((uint8*)Data, CountBytes);
+			Data += CountBytes;
+		}
+	}
+};
+
+/**
+ * Serves spectators from a game server's broadcast stream, see FBroadcastStream.h.
+ * Runs in its own process, without a game world. Viewers connect and log in as they would to any UIpNetDriver, but all they
+ * are sent is the records, so the game server's cost doesn't grow with the number of spectators.
+ * With no UWorld to handle the login, the driver is its own FNetworkNotify.
+ */
+UCLASS(transient, config=Engine)
+class ENGINE_API USpectatorRelayNetDriver : public UIpNetDriver, public FNetworkNotify
+{
+	/** TCP port the game server's UDemoNetDriver::InitBroadcast connects to */
+	UPROPERTY(Config)
+	int32 BroadcastStreamPort;
+
+	/** Record bytes per NMT_BroadcastRecord */
+	UPROPERTY(Config)
+	int32 BroadcastPieceSize;
+
+	/** Unacknowledged reliable pieces a viewer may have before the relay waits for it, on top of IsNetReady */
+	UPROPERTY(Config)
+	int32 MaxViewerPiecesInFlight;
+
+	FBroadcastStreamReceiver StreamReceiver;
+	FBroadcastRecordWindow RecordWindow;
+
+	/** Viewers that joined (NMT_Join), i.e. loaded the map and can play records. Only these are sent to. */
+	TMap<TWeakObjectPtr<UNetConnection>, FBroadcastViewer> Viewers;
+
+	/** Map the game server plays, from the relay's URL. Sent to viewers in NMT_Welcome so they load it. */
+	FString BroadcastMap;
+
+	/** Viewers skipped ahead to the latest keyframe for falling too far behind */
+	std::atomic<uint32> NumViewerSkips{0};
+
+	/** This tick's joined viewers, each cutting its pieces in its own task */
+	TArray<TPair<UNetConnection*, FBroadcastViewer*>> ViewerTasks;
+
+	virtual bool InitListen(FNetworkNotify* InNotify, FURL& ListenURL, bool bReuseAddressAndPort, FString& Error) override
+	{
+		if (!Super::InitListen(this, ListenURL, bReuseAddressAndPort, Error))
+		{
+			return false;
+		}
+
+		BroadcastMap = ListenURL.Map;
+
+		if (!StreamReceiver.Listen(BroadcastStreamPort))
+		{
+			Error = FString::Printf(TEXT("Can't listen for the broadcast stream on port %d"), BroadcastStreamPort);
+			return false;
+		}
+		return true;
+	}
+
+	virtual void TickDispatch(float DeltaTime) override
+	{
+		Super::TickDispatch(DeltaTime);
+
+		TArray<TSharedRef<const FBroadcastRecord>> NewRecords;
+		if (StreamReceiver.Receive(NewRecords))
+		{
+			RecordWindow.Reset();
+		}
+
+		for (const TSharedRef<const FBroadcastRecord>& Record : NewRecords)
+		{
+			RecordWindow.Add(Record);
+		}
+	}
+
+	virtual void TickFlushSubmit(float DeltaSeconds, FNetTaskScheduler& Scheduler) override
+	{
+		Super::TickFlushSubmit(DeltaSeconds, Scheduler);
+
+		for (auto It = Viewers.CreateIterator(); It; ++It)
+		{
+			if (!It->Key.IsValid())
+			{
+				It.RemoveCurrent();
+			}
+		}
+
+		// Viewers and RecordWindow don't change until TickFlushComplete sent the pieces, so the pointers hold
+		ViewerTasks.Reset();
+		for (UNetConnection* Connection : ClientConnections)
+		{
+			if (FBroadcastViewer* Viewer = Viewers.Find(Connection))
+			{
+				ViewerTasks.Emplace(Connection, Viewer);
+			}
+		}
+
+		Scheduler.AddTasks(NetTaskPriority, ViewerTasks.Num(), [this](int32 Index)
+		{
+			CutPiecesForViewer(ViewerTasks[Index].Key, *ViewerTasks[Index].Value);
+		});
+	}
+
+	/** Sending goes through the connection's send buffer, packet handler and the driver's socket: one viewer at a time */
+	virtual void TickFlushComplete(float DeltaSeconds) override
+	{
+		for (const TPair<UNetConnection*, FBroadcastViewer*>& ViewerTask : ViewerTasks)
+		{
+			SendToViewer(ViewerTask.Key, *ViewerTask.Value);
+		}
+		ViewerTasks.Reset();
+
+		Super::TickFlushComplete(DeltaSeconds);
+	}
+
+	virtual EAcceptConnection::Type NotifyAcceptingConnection() override
+	{
+		return EAcceptConnection::Accept;
+	}
+
+	virtual void NotifyAcceptedConnection(UNetConnection* Connection) override
+	{
+	}
+
+	/** Viewers only ever talk on the control channel */
+	virtual bool NotifyAcceptingChannel(UChannel* Channel) override
+	{
+		return Channel->ChName == NAME_Control;
+	}
+
+	/** The UWorld login steps a viewer goes through, without PreLogin or a PlayerController: all it gets is records */
+	virtual void NotifyControlMessage(UNetConnection* Connection, uint8 MessageType, class FInBunch& Bunch) override
+	{
+		switch (MessageType)
+		{
+			case NMT_Hello:
+			{
+				uint8 IsLittleEndian = 0;
+				uint32 RemoteNetworkVersion = 0;
+				FString EncryptionToken;
+				EEngineNetworkRuntimeFeatures RemoteNetworkFeatures = EEngineNetworkRuntimeFeatures::None;
+				if (!FNetControlMessage<NMT_Hello>::Receive(Bunch, IsLittleEndian, RemoteNetworkVersion, EncryptionToken, RemoteNetworkFeatures))
+				{
+					Connection->Close(ENetCloseResult::CorruptData);
+					break;
+				}
+
+				uint32 LocalNetworkVersion = FNetworkVersion::GetLocalNetworkVersion();
+				if (!FNetworkVersion::IsNetworkCompatible(LocalNetworkVersion, RemoteNetworkVersion))
+				{
+					EEngineNetworkRuntimeFeatures LocalNetworkFeatures = GetNetworkRuntimeFeatures();
+					FNetControlMessage<NMT_Upgrade>::Send(Connection, LocalNetworkVersion, LocalNetworkFeatures);
+					Connection->FlushNet(true);
+					Connection->Close(ENetCloseResult::Upgrade);
+					break;
+				}
+
+				Connection->SendChallengeControlMessage();
+				break;
+			}
+
+			case NMT_Login:
+			{
+				FString ClientResponse;
+				FString RequestURL;
+				FUniqueNetIdRepl UniqueIdRepl;
+				FString OnlinePlatformName;
+				if (!FNetControlMessage<NMT_Login>::Receive(Bunch, ClientResponse, RequestURL, UniqueIdRepl, OnlinePlatformName))
+				{
+					Connection->Close(ENetCloseResult::CorruptData);
+					break;
+				}
+
+				Connection->PlayerId = UniqueIdRepl;
+
+				FString GameName;
+				FString RedirectURL;
+				FNetControlMessage<NMT_Welcome>::Send(Connection, BroadcastMap, GameName, RedirectURL);
+				Connection->FlushNet();
+				Connection->SetClientLoginState(EClientLoginState::Welcomed);
+				break;
+			}
+
+			case NMT_Netspeed:
+			{
+				int32 Rate;
+				if (FNetControlMessage<NMT_Netspeed>::Receive(Bunch, Rate))
+				{
+					Connection->SetNegotiatedNetSpeed(FMath::Clamp(Rate, 1800, MaxClientRate));
+				}
+				break;
+			}
+
+			case NMT_Join:
+			{
+				// Sent once the viewer's map is loaded: records sent before would find no world to play them in.
+				// The viewer starts on the latest keyframe.
+				Viewers.FindOrAdd(Connection);
+				break;
+			}
+		}
+	}
+
+private:
+
+	/**
+	 * Task: tops the viewer's PendingPieces up to what it may have in flight, copying the bytes out of the window.
+	 * Reads the control channel, but only the game thread changes it, and not while the tasks run.
+	 */
+	void CutPiecesForViewer(UNetConnection* Connection, FBroadcastViewer& Viewer)
+	{
+		if (RecordWindow.GetLatestKeyframe() == INDEX_NONE)
+		{
+			return;
+		}
+
+		// Joining, or so far behind that the records it needs are gone. Pieces already cut are of records it skips.
+		if (Viewer.NextRecord < RecordWindow.GetFirstIndex())
+		{
+			NumViewerSkips += Viewer.NextRecord != INDEX_NONE ? 1 : 0;
+			Viewer.NextRecord = RecordWindow.GetLatestKeyframe();
+			Viewer.NextOffset = 0;
+			Viewer.bResync = true;
+			Viewer.PendingPieces.Reset();
+		}
+
+		const UControlChannel* ControlChannel = Cast<UControlChannel>(Connection->Channels[0]);
+		if (!ControlChannel)
+		{
+			return;
+		}
+
+		while (Viewer.NextRecord < RecordWindow.GetEndIndex() && ControlChannel->GetNumBroadcastPiecesInFlight() + Viewer.PendingPieces.Num() < MaxViewerPiecesInFlight)
+		{
+			const FBroadcastRecord& Record = RecordWindow.Get(Viewer.NextRecord);
+
+			FBroadcastPiece& Piece = Viewer.PendingPieces.AddDefaulted_GetRef();
+			Piece.Type = uint8(Viewer.bResync ? EReplayRecordType::ResyncKeyframe : Record.Type);
+			Piece.Time = Record.Time;
+			Piece.RecordSize = Record.Data.Num();
+			Piece.Offset = Viewer.NextOffset;
+			Piece.Data.Append(Record.Data.GetData() + Piece.Offset, FMath::Min(BroadcastPieceSize, Piece.RecordSize - Piece.Offset));
+
+			Viewer.NextOffset += Piece.Data.Num();
+			if (Viewer.NextOffset == Piece.RecordSize)
+			{
+				Viewer.NextRecord++;
+				Viewer.NextOffset = 0;
+				Viewer.bResync = false;
+			}
+		}
+	}
+
+	/** Game thread: sends the viewer's pending pieces, as far as its connection takes them this frame */
+	void SendToViewer(UNetConnection* Connection, FBroadcastViewer& Viewer)
+	{
+		UControlChannel* ControlChannel = Cast<UControlChannel>(Connection->Channels[0]);
+		if (!ControlChannel)
+		{
+			return;
+		}
+
+		int32 NumSent = 0;
+		while (NumSent < Viewer.PendingPieces.Num() && Connection->IsNetReady(false))
+		{
+			FBroadcastPiece& Piece = Viewer.PendingPieces[NumSent++];
+			ControlChannel->SendBroadcastPiece(Piece.Type, Piece.Time, Piece.RecordSize, Piece.Offset, Piece.Data);
+		}
+		Viewer.PendingPieces.RemoveAt(0, NumSent, false);
+	}
 };
\ No newline at end of file
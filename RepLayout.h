@@ -0,0 +1,58 @@
+
+enum class ERepLayoutCmdFlags : uint8
+{
+	None						= 0,
+	IsSharedSerialization		= (1 << 0),
+	IsStruct					= (1 << 1),
+	IsEmptyArrayStruct			= (1 << 2),
+
+	/** Declared with DOREPLIFETIME_QUANTIZED_*, serialized through FNetQuantizationRegistry. See FNetQuantization.h. */
+	IsQuantized					= (1 << 3),
+};
+
+ENUM_CLASS_FLAGS(ERepLayoutCmdFlags)
+
+/**
+ * Describes the replicated properties of a class: the flattened list of commands FObjectReplicator compares and
+ * serializes, built once per class and shared by every replicator of it.
+ */
+class FRepLayout : public FGCObject, public TSharedFromThis<FRepLayout>
+{
+	void InitFromClass(UClass* InObjectClass, const UNetConnection* ServerConnection, const ECreateRepLayoutFlags CreateFlags)
+	{
+		// ... build Parents and Cmds ...
+
+		TArray<FLifetimeProperty> LifetimeProps;
+		UObject* Object = InObjectClass->GetDefaultObject();
+		Object->GetLifetimeReplicatedProps(LifetimeProps);
+
+		// GetLifetimeReplicatedProps just filled the registry for this class, only the flag is looked at while serializing
+		const FNetQuantizationRegistry& QuantizationRegistry = FNetQuantizationRegistry::Get();
+		for (FRepLayoutCmd& Cmd : Cmds)
+		{
+			if (Cmd.Type != ERepLayoutCmdType::DynamicArray && Cmd.Type != ERepLayoutCmdType::Return && QuantizationRegistry.Find(Cmd.Property))
+			{
+				Cmd.Flags |= ERepLayoutCmdFlags::IsQuantized;
+			}
+		}
+
+		// ...
+	}
+
+	/** Writes or reads one command's value, used by SendProperties_r and ReceiveProperties_r alike */
+	bool NetSerializeItem(const FRepLayoutCmd& Cmd, FArchive& Ar, UPackageMap* Map, void* Data) const
+	{
+		if (EnumHasAnyFlags(Cmd.Flags, ERepLayoutCmdFlags::IsQuantized))
+		{
+			bool bSuccess = true;
+			if (FNetQuantizationRegistry::Get().NetSerializeQuantized(Ar, Cmd.Property, Data, bSuccess))
+			{
+				return bSuccess;
+			}
+		}
+
+		return Cmd.Property->NetSerializeItem(Ar, Map, Data);
+	}
+
+	// ...
+};
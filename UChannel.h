@@ -13,6 +13,570 @@ class ENGINE_API UChannel
 	UPROPERTY()
 	TObjectPtr<class UNetConnection>	Connection;		// Owner connection.
 
+	int32				ChIndex;			// Index of this channel.
+
+	int32				OpenChannelIndex;	// Slot in Connection->OpenChannels, INDEX_NONE when not open.
+
+	/** Cleans up channel structures and removes the channel from the connection */
+	virtual bool CleanUp(const bool bForDestroy, EChannelCloseReason CloseReason)
+	{
+		// Un-ACKed reliable bunches hold slices of the connection's FNetBufferPool, which may go away before this channel
+		ResetOutRec();
+		OutFragmentedBunches.Reset();
+
+		if (Connection)
+		{
+			Connection->RemoveChannel(this);
+		}
+
+		Connection = nullptr;
+		return true;
+	}
+
+	/** Fragmented reliable bunches sent on this channel that still have unACKed fragments, by transfer id */
+	TMap<uint16, FOutgoingFragmentedBunch> OutFragmentedBunches;
+
+	/** Fragmented bunches being reassembled, by transfer id */
+	TMap<uint16, FIncomingFragmentedBunch> InFragmentedBunches;
+
+	uint16 NextFragmentTransferId = 0;
+
+	/** Fragmented bunches a channel may have in flight in each direction. Past it, senders use partial bunches and receivers close. */
+	static constexpr int32 MaxFragmentedBunchesInFlight = 8;
+
+	/** A transfer that got no new fragment for this long is given up on; the sender resends NAKed fragments well before that */
+	static constexpr double FragmentedBunchTimeoutSeconds = 30.0;
+
+	/** Sends a bunch, splitting it when it doesn't fit in one packet. Returns the range of packets it went out in. */
+	FPacketIdRange SendBunch(FOutBunch* Bunch, bool Merge)
+	{
+		// ...
+
+		if (ChName == NAME_Actor)
+		{
+			Connection->CompressBunch(*Bunch);
+		}
+
+		// A compressed bunch is decoded as a whole, nothing may be appended to it or it to anything
+		Merge = Merge && !Bunch->bCompressed && !Connection->LastOut.bCompressed;
+
+		const bool bFitsInOnePacket = Bunch->GetNumBits() <= Connection->GetMaxSingleBunchSizeBits();
+		if (!bFitsInOnePacket && Bunch->bReliable && !Bunch->bReliableUnordered && Connection->bSelectiveFragmentRetransmit
+			&& OutFragmentedBunches.Num() < MaxFragmentedBunchesInFlight)
+		{
+			return SendFragmentedBunch(Bunch);
+		}
+
+		if (bFitsInOnePacket && Bunch->bReliable)
+		{
+			return FPacketIdRange(SendReliableBunch(Bunch));
+		}
+
+		// ... PartialInitial / Partial / PartialFinal bunches, OutRec ...
+	}
+
+	/**
+	 * Sends a reliable bunch too large for one packet as individually tracked fragments (see FFragmentedBunch.h).
+	 * Fragments go out as unreliable bunches: their retransmission is handled here, per fragment, not by OutRec.
+	 */
+	FPacketIdRange SendFragmentedBunch(FOutBunch* Bunch)
+	{
+		const int32 FragmentBytes = MAX_PARTIAL_BUNCH_SIZE_BYTES;
+
+		FOutgoingFragmentedBunch& Transfer = OutFragmentedBunches.Add(NextFragmentTransferId);
+		Transfer.Header.TransferId = NextFragmentTransferId++;
+		Transfer.Header.TotalBits = uint32(Bunch->GetNumBits());
+		Transfer.Header.FragmentCount = FMath::DivideAndRoundUp<int32>(Bunch->GetNumBytes(), FragmentBytes);
+		Transfer.ChSequence = ++Connection->OutReliable[ChIndex];
+		Transfer.Payload = MoveTemp(*Bunch->GetBuffer());
+		Transfer.Payload.SetNum(Transfer.Header.GetTotalBytes());
+		Transfer.FragmentPacketIds.Init(INDEX_NONE, Transfer.Header.FragmentCount);
+		Transfer.AckedFragments.Init(false, Transfer.Header.FragmentCount);
+
+		for (uint32 FragmentIndex = 0; FragmentIndex < Transfer.Header.FragmentCount; FragmentIndex++)
+		{
+			SendFragment(Transfer, FragmentIndex);
+		}
+
+		return FPacketIdRange(Transfer.FragmentPacketIds[0], Transfer.FragmentPacketIds.Last());
+	}
+
+	void SendFragment(FOutgoingFragmentedBunch& Transfer, uint32 FragmentIndex)
+	{
+		const int32 FragmentBytes = MAX_PARTIAL_BUNCH_SIZE_BYTES;
+
+		FOutBunch Fragment(this, false);
+		Fragment.bFragment = true;
+		Fragment.ChSequence = Transfer.ChSequence;
+
+		FBunchFragmentHeader FragmentHeader = Transfer.Header;
+		FragmentHeader.FragmentIndex = FragmentIndex;
+		FragmentHeader.Serialize(Fragment);
+		Fragment.Serialize(Transfer.Payload.GetData() + Transfer.GetFragmentOffset(FragmentIndex, FragmentBytes), Transfer.GetFragmentSize(FragmentIndex, FragmentBytes));
+
+		Transfer.FragmentPacketIds[FragmentIndex] = Connection->SendRawBunch(Fragment, true).First;
+	}
+
+	/** A packet was NAKed: resend the reliable bunches it carried, and only the lost fragments of fragmented ones */
+	virtual void ReceivedNak(int32 NakPacketId)
+	{
+		ResendNakedReliableBunches(NakPacketId);
+
+		const int32 FragmentBytes = MAX_PARTIAL_BUNCH_SIZE_BYTES;
+
+		for (TPair<uint16, FOutgoingFragmentedBunch>& Pair : OutFragmentedBunches)
+		{
+			FOutgoingFragmentedBunch& Transfer = Pair.Value;
+			bool bBunchHitByLoss = false;
+
+			for (uint32 FragmentIndex = 0; FragmentIndex < Transfer.Header.FragmentCount; FragmentIndex++)
+			{
+				if (!Transfer.AckedFragments[FragmentIndex] && Transfer.FragmentPacketIds[FragmentIndex] == NakPacketId)
+				{
+					Connection->FragmentRetransmitStats.FragmentBytesResent += Transfer.GetFragmentSize(FragmentIndex, FragmentBytes);
+					bBunchHitByLoss = true;
+					SendFragment(Transfer, FragmentIndex);
+				}
+			}
+
+			if (bBunchHitByLoss)
+			{
+				Connection->FragmentRetransmitStats.WholeBunchBytesEquivalent += Transfer.Payload.Num();
+			}
+		}
+	}
+
+	virtual void ReceivedAck(int32 AckPacketId)
+	{
+		ReleaseAckedReliableBunches(AckPacketId);
+
+		for (auto It = OutFragmentedBunches.CreateIterator(); It; ++It)
+		{
+			FOutgoingFragmentedBunch& Transfer = It.Value();
+			for (uint32 FragmentIndex = 0; FragmentIndex < Transfer.Header.FragmentCount; FragmentIndex++)
+			{
+				if (!Transfer.AckedFragments[FragmentIndex] && Transfer.FragmentPacketIds[FragmentIndex] == AckPacketId)
+				{
+					Transfer.AckedFragments[FragmentIndex] = true;
+					Transfer.NumAcked++;
+				}
+			}
+
+			if (Transfer.IsComplete())
+			{
+				It.RemoveCurrent();
+			}
+		}
+	}
+
+	/** Copies a fragment into its reassembly buffer, and processes the bunch as a regular reliable bunch once complete */
+	void ReceivedFragment(FInBunch& Bunch, bool& bOutSkipAck)
+	{
+		FBunchFragmentHeader FragmentHeader;
+		FragmentHeader.Serialize(Bunch);
+		const bool bValidCount = FragmentHeader.FragmentCount == FMath::DivideAndRoundUp<uint32>(FragmentHeader.GetTotalBytes(), MAX_PARTIAL_BUNCH_SIZE_BYTES);
+		if (Bunch.IsError() || !bValidCount || FragmentHeader.GetTotalBytes() > uint32(NetMaxConstructedPartialBunchSizeBytes))
+		{
+			Connection->Close(ENetCloseResult::PartialBunchSize);
+			return;
+		}
+
+		// A late copy of a fragment whose bunch was already delivered, don't start a transfer that can never complete
+		if (Bunch.ChSequence <= Connection->InReliable[ChIndex])
+		{
+			return;
+		}
+
+		const double Now = Connection->Driver->GetElapsedTime();
+
+		FIncomingFragmentedBunch* Transfer = InFragmentedBunches.Find(FragmentHeader.TransferId);
+		if (!Transfer)
+		{
+			if (InFragmentedBunches.Num() >= MaxFragmentedBunchesInFlight)
+			{
+				for (auto It = InFragmentedBunches.CreateIterator(); It; ++It)
+				{
+					if (It.Value().ChSequence <= Connection->InReliable[ChIndex] || Now - It.Value().LastFragmentTime > FragmentedBunchTimeoutSeconds)
+					{
+						It.RemoveCurrent();
+					}
+				}
+
+				if (InFragmentedBunches.Num() >= MaxFragmentedBunchesInFlight)
+				{
+					Connection->Close(ENetCloseResult::PartialBunchSize);
+					return;
+				}
+			}
+
+			Transfer = &InFragmentedBunches.Add(FragmentHeader.TransferId);
+			Transfer->Init(FragmentHeader, Bunch.ChSequence, Now);
+		}
+
+		const int32 FragmentSize = Bunch.GetBytesLeft();
+		const FIncomingFragmentedBunch::EAddResult Result = Transfer->AddFragment(FragmentHeader, Bunch.ChSequence, Bunch.GetDataPosChecked(), FragmentSize, MAX_PARTIAL_BUNCH_SIZE_BYTES, Now);
+		if (Result == FIncomingFragmentedBunch::EAddResult::Invalid)
+		{
+			Connection->Close(ENetCloseResult::PartialBunchSize);
+			return;
+		}
+
+		if (Result == FIncomingFragmentedBunch::EAddResult::Complete)
+		{
+			FInBunch Reassembled(Bunch, false);
+			Reassembled.bReliable = true;
+			Reassembled.bFragment = false;
+			Reassembled.ChSequence = Transfer->ChSequence;
+			Reassembled.SetData(Transfer->Buffer.GetData(), int64(Transfer->Header.TotalBits));
+
+			InFragmentedBunches.Remove(FragmentHeader.TransferId);
+
+			// Goes through the normal reliable ordering (queued if an earlier reliable bunch is still missing)
+			ReceivedRawBunch(Reassembled, bOutSkipAck);
+		}
+	}
+
+	/** Incoming bunches waiting for a missing reliable bunch, sorted by ChSequence */
+	FInBunch* InRec;
+
+	/** Number of bunches in InRec */
+	int32 NumInRec;
+
+	/** Sequence numbers of reliable-unordered bunches, separate from Connection->OutReliable / InReliable */
+	int32 OutUnorderedSequence = 0;
+
+	/**
+	 * Reliable-unordered sequences the receiver tells apart. The sender never has a bunch in flight older than this
+	 * (it sends ordered instead), so the receiver can drop anything older as a protocol error. Power of two.
+	 */
+	static constexpr int32 UnorderedWindow = 1024;
+
+	/** Which reliable-unordered bunches we already took: highest sequence seen, plus a bit per sequence of the window, by sequence modulo the window */
+	int32 InUnorderedHighest = 0;
+	TBitArray<> InUnorderedReceived;
+
+	/** Set once the bunch opening the channel was delivered, reliable-unordered bunches wait in InRec until then */
+	uint32 bOpenBunchReceived:1;
+
+	/** Called from SendBunch for reliable bunches. Reliable-unordered bunches are resent like any reliable bunch, but don't take an ordered sequence. */
+	void AssignReliableSequence(FOutBunch* Bunch)
+	{
+		if (Bunch->bReliableUnordered && !CanSendUnordered())
+		{
+			// The receiver couldn't tell this sequence from the oldest one still in flight: ordered is always a valid fallback
+			Bunch->bReliableUnordered = false;
+		}
+
+		Bunch->ChSequence = Bunch->bReliableUnordered ? ++OutUnorderedSequence : ++Connection->OutReliable[ChIndex];
+	}
+
+	bool CanSendUnordered() const
+	{
+		for (const FOutReliableBunch& Record : OutRec)
+		{
+			if (Record.bUnordered && OutUnorderedSequence + 1 - Record.ChSequence >= UnorderedWindow)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/** A reliable bunch sent but not ACKed yet. Holds the same pooled bytes the packet was packed from, not a copy of the bunch. */
+	struct FOutReliableBunch
+	{
+		int32 ChSequence = 0;
+		bool bUnordered = false;
+
+		/** FNetBunchCompressor model the bunch was encoded with, so its slot isn't rebuilt while resends may still use it */
+		int32 CompressionModel = INDEX_NONE;
+
+		UNetConnection::FPooledBunch Bunch;
+	};
+
+	/** Unacknowledged reliable bunches, in send order */
+	TArray<FOutReliableBunch> OutRec;
+
+	/** Called from SendBunch for reliable bunches that fit in a packet. Returns the packet the bunch went out in. */
+	int32 SendReliableBunch(FOutBunch* Bunch)
+	{
+		AssignReliableSequence(Bunch);
+
+		FOutReliableBunch& Record = OutRec.AddDefaulted_GetRef();
+		Record.ChSequence = Bunch->ChSequence;
+		Record.bUnordered = Bunch->bReliableUnordered;
+		Record.Bunch = Connection->SendPooledBunch(*Bunch);
+
+		// A compressed payload starts with its model id
+		if (Bunch->bCompressed)
+		{
+			Record.CompressionModel = Bunch->GetData()[0];
+			Connection->BunchCompressor.AddSendModelRef(uint8(Record.CompressionModel));
+		}
+		return Record.Bunch.PacketId;
+	}
+
+	void ResendNakedReliableBunches(int32 NakPacketId)
+	{
+		for (FOutReliableBunch& Record : OutRec)
+		{
+			if (Record.Bunch.PacketId == NakPacketId)
+			{
+				Connection->ResendPooledBunch(Record.Bunch);
+			}
+		}
+	}
+
+	/** Dropping the record releases its slices; the pool recycles the slab once nothing else in it is referenced */
+	void ReleaseAckedReliableBunches(int32 AckPacketId)
+	{
+		OutRec.RemoveAll([this, AckPacketId](const FOutReliableBunch& Record)
+		{
+			if (Record.Bunch.PacketId != AckPacketId)
+			{
+				return false;
+			}
+
+			if (Record.CompressionModel != INDEX_NONE)
+			{
+				Connection->BunchCompressor.ReleaseSendModelRef(uint8(Record.CompressionModel));
+			}
+			return true;
+		});
+	}
+
+	/** Drops every un-ACKed reliable bunch, along with the compression models they were holding */
+	void ResetOutRec()
+	{
+		for (const FOutReliableBunch& Record : OutRec)
+		{
+			if (Connection && Record.CompressionModel != INDEX_NONE)
+			{
+				Connection->BunchCompressor.ReleaseSendModelRef(uint8(Record.CompressionModel));
+			}
+		}
+		OutRec.Reset();
+	}
+
+	/**
+	 * Processes a bunch coming off a packet.
+	 *
+	 * Reliable bunches are delivered in ChSequence order: one past a gap waits in InRec, the one filling it is delivered
+	 * and drains the queue. Unreliable bunches wait behind queued reliable ones. With Connection->bIndependentUnreliableBunches,
+	 * unreliable bunches on an open channel skip that queue and are delivered right away, so they don't stall behind a
+	 * lost reliable bunch.
+	 * Reliable-unordered bunches are delivered as soon as they arrive on an open channel, duplicates (resends) are dropped.
+	 * Before the channel's open bunch was delivered they wait in InRec behind it, like everything else.
+	 */
+	void ReceivedRawBunch(FInBunch& Bunch, bool& bOutSkipAck)
+	{
+		if (Bunch.bFragment)
+		{
+			ReceivedFragment(Bunch, bOutSkipAck);
+			return;
+		}
+
+		if (Bunch.bReliableUnordered ? !MarkUnorderedReceived(Bunch.ChSequence, bOutSkipAck)
+			: Bunch.bReliable && Bunch.ChSequence <= Connection->InReliable[ChIndex])
+		{
+			// A resend of something we already got (or, unordered, can't tell apart from one, see MarkUnorderedReceived)
+			return;
+		}
+
+		// Before the bunch can wait anywhere: the models it was encoded with may be replaced by the time it's delivered
+		if (Bunch.bCompressed && !Connection->DecompressBunch(Bunch))
+		{
+			UE_LOG(LogNetTraffic, Error, TEXT("Failed to decompress bunch on channel %d"), ChIndex);
+			Connection->Close(ENetCloseResult::CorruptData);
+			return;
+		}
+
+		if (Bunch.bReliableUnordered)
+		{
+			if (OpenedLocally || bOpenBunchReceived)
+			{
+				DispatchBunch(Bunch, Connection->ReliableBunchLatency, bOutSkipAck);
+			}
+			else
+			{
+				QueueBunch(Bunch);
+			}
+			return;
+		}
+
+		// The next reliable bunch is always delivered, whatever waits in InRec: that's what InRec waits for
+		if (Bunch.bReliable)
+		{
+			if (Bunch.ChSequence != Connection->InReliable[ChIndex] + 1)
+			{
+				QueueBunch(Bunch);
+				return;
+			}
+		}
+		else
+		{
+			// Bunches that open the channel must stay ordered with the reliable stream, or they'd arrive before the actor exists
+			const bool bBypassQueue = Connection->bIndependentUnreliableBunches && OpenAcked && !Bunch.bOpen;
+
+			// Reliable-unordered bunches waiting for the open bunch don't hold unreliable ones back, one may be that open bunch
+			if (!bBypassQueue && HasQueuedOrderedReliable())
+			{
+				QueueBunch(Bunch);
+				return;
+			}
+		}
+
+		if (Bunch.bReliable)
+		{
+			Connection->InReliable[ChIndex] = Bunch.ChSequence;
+		}
+		DispatchBunch(Bunch, Bunch.bReliable ? Connection->ReliableBunchLatency : Connection->UnreliableBunchLatency, bOutSkipAck);
+
+		// Deliver everything the queue now has in order. Reliable-unordered bunches still wait if the channel isn't open yet.
+		while (InRec && (IsOrderedReliable(*InRec) ? InRec->ChSequence == Connection->InReliable[ChIndex] + 1
+			: !InRec->bReliableUnordered || OpenedLocally || bOpenBunchReceived))
+		{
+			FInBunch* Release = InRec;
+			InRec = InRec->Next;
+			NumInRec--;
+
+			if (IsOrderedReliable(*Release))
+			{
+				Connection->InReliable[ChIndex] = Release->ChSequence;
+			}
+			DispatchBunch(*Release, Release->bReliable ? Connection->ReliableBunchLatency : Connection->UnreliableBunchLatency, bOutSkipAck);
+			delete Release;
+		}
+	}
+
+	void DispatchBunch(FInBunch& Bunch, FNetLatencyHistogram& LatencyHistogram, bool& bOutSkipAck)
+	{
+		// Time from the packet coming off the socket to the channel seeing the bunch, including any wait in InRec
+		LatencyHistogram.AddSample(FPlatformTime::Seconds() - Bunch.PacketReceiveTime);
+		bOpenBunchReceived |= Bunch.bOpen;
+		ReceivedNextBunch(Bunch, bOutSkipAck);
+	}
+
+	/** True while an ordered reliable bunch waits in InRec for a gap to fill */
+	bool HasQueuedOrderedReliable() const
+	{
+		for (const FInBunch* Queued = InRec; Queued; Queued = Queued->Next)
+		{
+			if (IsOrderedReliable(*Queued))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/** Reliable-unordered bunches have their own sequence space, they never take part in the ordered one */
+	static bool IsOrderedReliable(const FInBunch& Bunch)
+	{
+		return Bunch.bReliable && !Bunch.bReliableUnordered;
+	}
+
+	/**
+	 * Returns false if this reliable-unordered sequence was already taken, or can't be told apart from one that was.
+	 * The latter is a sender that broke UnorderedWindow: the packet is not ACKed, so nothing is silently lost.
+	 */
+	bool MarkUnorderedReceived(int32 Sequence, bool& bOutSkipAck)
+	{
+		if (InUnorderedReceived.Num() == 0)
+		{
+			InUnorderedReceived.Init(false, UnorderedWindow);
+		}
+
+		if (Sequence > InUnorderedHighest)
+		{
+			// Sequences the window slides over were never received (or are older than the window now), forget them
+			const int32 NumCleared = FMath::Min(Sequence - InUnorderedHighest, UnorderedWindow);
+			for (int32 Cleared = Sequence - NumCleared + 1; Cleared <= Sequence; Cleared++)
+			{
+				InUnorderedReceived[Cleared & (UnorderedWindow - 1)] = false;
+			}
+
+			InUnorderedHighest = Sequence;
+			InUnorderedReceived[Sequence & (UnorderedWindow - 1)] = true;
+			return true;
+		}
+
+		if (InUnorderedHighest - Sequence >= UnorderedWindow)
+		{
+			UE_LOG(LogNetTraffic, Warning, TEXT("Reliable-unordered bunch %d on channel %d is older than the window, not acknowledging it"), Sequence, ChIndex);
+			bOutSkipAck = true;
+			return false;
+		}
+
+		const int32 Slot = Sequence & (UnorderedWindow - 1);
+		if (InUnorderedReceived[Slot])
+		{
+			return false;
+		}
+		InUnorderedReceived[Slot] = true;
+		return true;
+	}
+
+	/** Inserts into InRec, ordered reliable bunches in ChSequence order, the others after everything already queued */
+	void QueueBunch(const FInBunch& Bunch)
+	{
+		FInBunch** InPtr = &InRec;
+		for (; *InPtr; InPtr = &(*InPtr)->Next)
+		{
+			if (IsOrderedReliable(Bunch) && IsOrderedReliable(**InPtr) && Bunch.ChSequence == (*InPtr)->ChSequence)
+			{
+				// Already queued
+				return;
+			}
+			if (IsOrderedReliable(Bunch) && IsOrderedReliable(**InPtr) && Bunch.ChSequence < (*InPtr)->ChSequence)
+			{
+				break;
+			}
+		}
+
+		FInBunch* New = new FInBunch(Bunch);
+		New->Next = *InPtr;
+		*InPtr = New;
+		NumInRec++;
+	}
+
+	/** Back to the state of a freshly constructed channel, so a pooled channel carries nothing over to its next connection */
+	void ResetChannelState()
+	{
+		while (InRec)
+		{
+			FInBunch* Next = InRec->Next;
+			delete InRec;
+			InRec = Next;
+		}
+		NumInRec = 0;
+
+		// Releases the pooled send buffer slices, which belong to the old connection's FNetBufferPool
+		ResetOutRec();
+
+		OutFragmentedBunches.Reset();
+		InFragmentedBunches.Reset();
+		NextFragmentTransferId = 0;
+
+		OutUnorderedSequence = 0;
+		InUnorderedHighest = 0;
+		InUnorderedReceived.Reset();
+		bOpenBunchReceived = false;
+
+		Connection = nullptr;
+		ChIndex = INDEX_NONE;
+		OpenChannelIndex = INDEX_NONE;
+		OpenPacketId = FPacketIdRange();
+		OpenAcked = false;
+		OpenedLocally = false;
+		OpenTemporary = false;
+		Closing = false;
+		Dying = false;
+		Broken = false;
+		bTornOff = false;
+		SentClosingBunch = false;
+	}
+
 	void SetChannelActor(AActor* InActor, ESetChannelActorFlags Flags)
 	{
 		Actor = InActor;
@@ -34,6 +598,94 @@ class ENGINE_API UChannel
 class ENGINE_API UActorChannel : public UChannel
 {
 	TMap<UObject*, TSharedRef<FObjectReplicator>> ReplicationMap;
+
+	TSharedRef<FObjectReplicator>& FindOrCreateReplicator(UObject* Obj)
+	{
+		if (TSharedRef<FObjectReplicator>* Existing = ReplicationMap.Find(Obj))
+		{
+			return *Existing;
+		}
+
+		// Pooled replicators only save the allocation, every object gets a fresh FRepState
+		TSharedRef<FObjectReplicator> NewReplicator = Connection->Driver->GetOrCreateReplicator();
+		NewReplicator->InitWithObject(Obj, Connection, true);
+		return ReplicationMap.Add(Obj, NewReplicator);
+	}
+
+	bool ReplicateActor()
+	{
+		// ... replicate the actor and its subobjects into Bunch ...
+
+		// Replicators left the history entries they added without a packet: the bunch may not fit in the current one,
+		// or be split across several, so only SendBunch knows
+		const FPacketIdRange PacketRange = SendBunch(&Bunch, true);
+		for (TPair<UObject*, TSharedRef<FObjectReplicator>>& Pair : ReplicationMap)
+		{
+			Pair.Value->PostSendBunch(PacketRange, Bunch.bReliable);
+		}
+
+		// ...
+	}
+
+	virtual bool CleanUp(const bool bForDestroy, EChannelCloseReason CloseReason) override
+	{
+		UNetDriver* Driver = Connection ? Connection->Driver : nullptr;
+
+		if (Connection && Actor)
+		{
+			Connection->RemoveActorChannel(Actor);
+		}
+
+		Super::CleanUp(bForDestroy, CloseReason);
+
+		if (Driver && !bForDestroy)
+		{
+			Driver->ReleaseToChannelPool(this);
+		}
+		return true;
+	}
+
+	/** Parked: open, but skipped by replication until UNetDriver::FlushActorDormancy */
+	uint32 bDormant:1;
+
+	/** Actor wants to be dormant: park as soon as everything sent so far is acknowledged */
+	uint32 bPendingDormancy:1;
+
+	bool ReadyForDormancy() const
+	{
+		// Reliable bunches (RPCs, the open bunch) still in flight could need a resend
+		if (OutRec.Num() > 0)
+		{
+			return false;
+		}
+
+		for (const TPair<UObject*, TSharedRef<FObjectReplicator>>& Pair : ReplicationMap)
+		{
+			if (!Pair.Value->ReadyForDormancy())
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/** Puts the channel back in the state GetOrCreateChannelByName expects, keeping ReplicationMap's allocation */
+	void ResetForPool(UNetDriver* Driver)
+	{
+		for (TPair<UObject*, TSharedRef<FObjectReplicator>>& Pair : ReplicationMap)
+		{
+			Driver->ReleaseReplicator(Pair.Value);
+		}
+		ReplicationMap.Reset();
+
+		ResetChannelState();
+
+		Actor = nullptr;
+		ActorNetGUID = FNetworkGUID();
+		bDormant = false;
+		bPendingDormancy = false;
+		bActorIsPendingKill = false;
+	}
 };
 
 /**
@@ -41,7 +693,158 @@ class ENGINE_API UActorChannel : public UChannel
  */
 class ENGINE_API UControlChannel : public UChannel 
 {
+	/** Relay side: a NMT_BroadcastRecord piece not ACKed yet, and the packet it (last) went out in */
+	struct FBroadcastPieceInFlight
+	{
+		int32 ChSequence = 0;
+		int32 PacketId = INDEX_NONE;
+	};
+
+	/** NMT_BroadcastRecord pieces sent with SendBroadcastPiece and not ACKed yet, what USpectatorRelayNetDriver paces viewers on */
+	TArray<FBroadcastPieceInFlight> BroadcastPiecesInFlight;
+
+	/** Sends a piece as a reliable bunch of its own, unmerged, so the packet it goes out in is known and its ACK can be counted */
+	void SendBroadcastPiece(uint8 Type, double Time, int32 RecordSize, int32 Offset, TArray<uint8>& Piece)
+	{
+		FOutBunch Bunch(this, false);
+		Bunch.bReliable = true;
+
+		uint8 MessageType = NMT_BroadcastRecord;
+		Bunch << MessageType << Type << Time << RecordSize << Offset << Piece;
+		const FPacketIdRange PacketIds = SendBunch(&Bunch, false);
 
+		FBroadcastPieceInFlight& InFlight = BroadcastPiecesInFlight.AddDefaulted_GetRef();
+		InFlight.ChSequence = Bunch.ChSequence;
+		InFlight.PacketId = PacketIds.Last;
+	}
+
+	int32 GetNumBroadcastPiecesInFlight() const
+	{
+		return BroadcastPiecesInFlight.Num();
+	}
+
+	virtual void ReceivedAck(int32 AckPacketId) override
+	{
+		Super::ReceivedAck(AckPacketId);
+
+		BroadcastPiecesInFlight.RemoveAll([AckPacketId](const FBroadcastPieceInFlight& InFlight)
+		{
+			return InFlight.PacketId == AckPacketId;
+		});
+	}
+
+	virtual void ReceivedNak(int32 NakPacketId) override
+	{
+		Super::ReceivedNak(NakPacketId);
+
+		// Super already resent the piece's reliable record: it's in flight in that packet now. A piece that was sent as
+		// fragments has no record, only its lost fragments are resent, so it stops being counted.
+		BroadcastPiecesInFlight.RemoveAll([this, NakPacketId](FBroadcastPieceInFlight& InFlight)
+		{
+			if (InFlight.PacketId != NakPacketId)
+			{
+				return false;
+			}
+
+			const FOutReliableBunch* Record = OutRec.FindByPredicate([&InFlight](const FOutReliableBunch& Record)
+			{
+				return Record.ChSequence == InFlight.ChSequence;
+			});
+			if (!Record)
+			{
+				return true;
+			}
+
+			InFlight.PacketId = Record->Bunch.PacketId;
+			return false;
+		});
+	}
+
+	virtual void ReceivedBunch(FInBunch& Bunch) override
+	{
+		// ...
+
+		while (!Bunch.AtEnd() && Connection != nullptr && Connection->State != USOCK_Closed)
+		{
+			uint8 MessageType = 0;
+			Bunch << MessageType;
+			if (Bunch.IsError())
+			{
+				break;
+			}
+
+			if (!ReceivedConnectionMessage(MessageType, Bunch) && Connection->Driver->Notify != nullptr)
+			{
+				Connection->Driver->Notify->NotifyControlMessage(Connection, MessageType, Bunch);
+			}
+
+			// ...
+		}
+	}
+
+	/** Messages the connection handles itself, checked before the driver's FNetworkNotify. Returns true if consumed. */
+	bool ReceivedConnectionMessage(uint8 MessageType, FInBunch& Bunch)
+	{
+		if (MessageType == NMT_BunchCompressionModel)
+		{
+			uint8 ModelId = 0;
+			TArray<uint16> Freqs;
+			if (!FNetControlMessage<NMT_BunchCompressionModel>::Receive(Bunch, ModelId, Freqs) || !Connection->BunchCompressor.ReceivedModel(ModelId, Freqs))
+			{
+				Connection->Close(ENetCloseResult::CorruptData);
+				return true;
+			}
+
+			// Installed: bunches encoded with it can be decoded from here on, the sender may switch
+			FNetControlMessage<NMT_BunchCompressionModelAck>::Send(Connection, ModelId);
+			return true;
+		}
+
+		if (MessageType == NMT_BunchCompressionModelAck)
+		{
+			uint8 ModelId = 0;
+			if (!FNetControlMessage<NMT_BunchCompressionModelAck>::Receive(Bunch, ModelId) || !Connection->BunchCompressor.ActivatePendingModel(ModelId))
+			{
+				Connection->Close(ENetCloseResult::CorruptData);
+			}
+			return true;
+		}
+
+		if (MessageType == NMT_BroadcastRecord)
+		{
+			uint8 Type = 0;
+			double Time = 0.0;
+			int32 RecordSize = 0;
+			int32 Offset = 0;
+			TArray<uint8> Piece;
+			if (!FNetControlMessage<NMT_BroadcastRecord>::Receive(Bunch, Type, Time, RecordSize, Offset, Piece))
+			{
+				Connection->Close(ENetCloseResult::CorruptData);
+				return true;
+			}
+
+			if (!Connection->BroadcastAssembler.AddPiece(Type, Time, RecordSize, Offset, Piece))
+			{
+				return true;
+			}
+
+			// Viewer of a USpectatorRelayNetDriver: the record is played by the world's demo driver, as a live replay
+			UWorld* World = Connection->Driver->World;
+			UDemoNetDriver* DemoNetDriver = World ? World->DemoNetDriver.Get() : nullptr;
+			if (World && !DemoNetDriver)
+			{
+				DemoNetDriver = UDemoNetDriver::CreateBroadcastPlayer(World);
+			}
+
+			if (DemoNetDriver)
+			{
+				DemoNetDriver->PlayBroadcastRecord(Connection->BroadcastAssembler.Record);
+			}
+			return true;
+		}
+
+		return false;
+	}
 };
 
 class ENGINE_API UVoiceChannel : public UChannel
@@ -49,7 +852,282 @@ class ENGINE_API UVoiceChannel : public UChannel
 
 };
 
+/**
+ * Bulk file transfers that use only the bandwidth actor replication leaves, see FDataStreamTransfer.h.
+ * Either side can send; one transfer goes out at a time, the others wait in OutTransfers.
+ */
 class ENGINE_API UDataStreamChannel final : public UChannel
 {
+	/** Outgoing transfers, the first one is being sent */
+	TArray<TUniquePtr<FDataStreamOutTransfer>> OutTransfers;
+
+	TUniquePtr<FDataStreamInTransfer> InTransfer;
+
+	FDataStreamTransferStats Stats;
+
+	/** Receiver: called with the content id and the path of the file once it's complete */
+	TFunction<void(const FGuid&, const FString&)> OnTransferReceived;
+
+	virtual void Init(UNetConnection* InConnection, int32 InChIndex, EChannelCreateFlags CreateFlags) override
+	{
+		Super::Init(InConnection, InChIndex, CreateFlags);
+		Connection->DataStreamChannel = this;
+	}
+
+	virtual bool CleanUp(const bool bForDestroy, EChannelCloseReason CloseReason) override
+	{
+		if (Connection && Connection->DataStreamChannel == this)
+		{
+			Connection->DataStreamChannel = nullptr;
+		}
+
+		// The partial file stays on disk, a later transfer of the same content resumes from it
+		InTransfer.Reset();
+		OutTransfers.Reset();
+		return Super::CleanUp(bForDestroy, CloseReason);
+	}
 
+	/** Queues Filename for sending. ContentId must identify the file's content: a transfer with the same id resumes. */
+	bool SendFile(const FString& Filename, const FGuid& ContentId)
+	{
+		TUniquePtr<FDataStreamOutTransfer> Transfer = MakeUnique<FDataStreamOutTransfer>();
+		if (!Transfer->Open(Filename, ContentId))
+		{
+			UE_LOG(LogNet, Warning, TEXT("UDataStreamChannel: can't map %s"), *Filename);
+			return false;
+		}
+
+		OutTransfers.Add(MoveTemp(Transfer));
+		if (OutTransfers.Num() == 1)
+		{
+			SendBegin(*OutTransfers[0]);
+		}
+		return true;
+	}
+
+	/**
+	 * Called by UNetDriver::TickFlushComplete after actors were replicated to the connection and before it's flushed.
+	 * Sends blocks for as long as the connection's rate allows, so only the bandwidth replication didn't use goes to the stream.
+	 */
+	void TickTransfers()
+	{
+		if (OutTransfers.Num() == 0)
+		{
+			return;
+		}
+
+		FDataStreamOutTransfer& Transfer = *OutTransfers[0];
+
+		while (Transfer.ResendQueue.Num() > 0 && Connection->IsNetReady(false))
+		{
+			const uint32 Block = Transfer.ResendQueue.Pop(false);
+			if (Block >= Transfer.BaseBlock && !Transfer.GetSlot(Block).bAcked && Transfer.GetSlot(Block).PacketId == INDEX_NONE)
+			{
+				Stats.BytesResent += Transfer.GetBlockSize(Block);
+				SendBlock(Transfer, Block);
+			}
+		}
+
+		while (Transfer.ResendQueue.Num() == 0 && Transfer.CanSendNewBlock() && Connection->IsNetReady(false))
+		{
+			Stats.BytesSent += Transfer.GetBlockSize(Transfer.NextBlock);
+			SendBlock(Transfer, Transfer.NextBlock++);
+		}
+	}
+
+	virtual void ReceivedAck(int32 AckPacketId) override
+	{
+		Super::ReceivedAck(AckPacketId);
+
+		if (OutTransfers.Num() > 0)
+		{
+			OutTransfers[0]->ReceivedAck(AckPacketId);
+			if (OutTransfers[0]->IsComplete())
+			{
+				Stats.NumTransfersCompleted++;
+				OutTransfers.RemoveAt(0);
+				if (OutTransfers.Num() > 0)
+				{
+					SendBegin(*OutTransfers[0]);
+				}
+			}
+		}
+	}
+
+	virtual void ReceivedNak(int32 NakPacketId) override
+	{
+		Super::ReceivedNak(NakPacketId);
+
+		// Resent from TickTransfers, within the frame's leftover bandwidth like everything else on the stream
+		if (OutTransfers.Num() > 0)
+		{
+			OutTransfers[0]->ReceivedNak(NakPacketId);
+		}
+	}
+
+	virtual void ReceivedBunch(FInBunch& Bunch) override
+	{
+		uint8 MessageType = 0;
+		Bunch << MessageType;
+
+		switch (EDataStreamMessage(MessageType))
+		{
+			case EDataStreamMessage::Begin:
+				ReceivedBegin(Bunch);
+				break;
+
+			case EDataStreamMessage::Resume:
+				ReceivedResume(Bunch);
+				break;
+
+			case EDataStreamMessage::Block:
+				ReceivedBlock(Bunch);
+				break;
+
+			default:
+				Connection->Close(ENetCloseResult::CorruptData);
+				break;
+		}
+	}
+
+private:
+
+	void SendBegin(FDataStreamOutTransfer& Transfer)
+	{
+		FOutBunch Bunch(this, false);
+		Bunch.bReliable = true;
+
+		uint8 MessageType = uint8(EDataStreamMessage::Begin);
+		Bunch << MessageType << Transfer.ContentId << Transfer.TotalSize << Transfer.Name;
+		SendBunch(&Bunch, false);
+	}
+
+	/** Straight from the mapped file into the bunch, which is the only copy the stream makes of the block */
+	void SendBlock(FDataStreamOutTransfer& Transfer, uint32 Block)
+	{
+		FOutBunch Bunch(this, false);
+
+		uint8 MessageType = uint8(EDataStreamMessage::Block);
+		Bunch << MessageType;
+		Bunch.SerializeIntPacked(Block);
+		Bunch.Serialize((void*)Transfer.GetBlockData(Block), Transfer.GetBlockSize(Block));
+
+		Transfer.GetSlot(Block).PacketId = Connection->SendRawBunch(Bunch, true).First;
+	}
+
+	void ReceivedBegin(FInBunch& Bunch)
+	{
+		const UNetDriver* Driver = Connection->Driver;
+
+		FGuid ContentId;
+		int64 TotalSize = 0;
+		FString Name;
+		Bunch << ContentId << TotalSize << Name;
+
+		if (Bunch.IsError() || TotalSize < 0 || TotalSize > Driver->MaxDataStreamTransferBytes)
+		{
+			UE_LOG(LogNet, Warning, TEXT("UDataStreamChannel: refusing transfer of %lld bytes"), TotalSize);
+			Connection->Close(ENetCloseResult::CorruptData);
+			return;
+		}
+
+		InTransfer = MakeUnique<FDataStreamInTransfer>();
+		if (!InTransfer->Begin(Driver->DataStreamDirectory, ContentId, TotalSize, Name, Driver->DataStreamWindowBlocks))
+		{
+			UE_LOG(LogNet, Warning, TEXT("UDataStreamChannel: can't write %s"), *InTransfer->PartialFilename);
+			Connection->Close(ENetCloseResult::CorruptData);
+			return;
+		}
+
+		Stats.BytesResumed += int64(InTransfer->WrittenBlocks) * DataStreamBlockBytes;
+
+		FOutBunch Reply(this, false);
+		Reply.bReliable = true;
+
+		uint8 MessageType = uint8(EDataStreamMessage::Resume);
+		int32 WindowBlocks = InTransfer->WindowBlocks;
+		Reply << MessageType << ContentId;
+		Reply.SerializeIntPacked(InTransfer->WrittenBlocks);
+		Reply << WindowBlocks;
+		SendBunch(&Reply, false);
+
+		// Nothing left to send, the sender still gets the Resume to know it's done
+		if (InTransfer->IsComplete())
+		{
+			FinishInTransfer();
+		}
+	}
+
+	void ReceivedResume(FInBunch& Bunch)
+	{
+		FGuid ContentId;
+		uint32 FirstBlock = 0;
+		int32 WindowBlocks = 0;
+		Bunch << ContentId;
+		Bunch.SerializeIntPacked(FirstBlock);
+		Bunch << WindowBlocks;
+
+		if (Bunch.IsError() || OutTransfers.Num() == 0 || OutTransfers[0]->ContentId != ContentId)
+		{
+			Connection->Close(ENetCloseResult::CorruptData);
+			return;
+		}
+
+		FDataStreamOutTransfer& Transfer = *OutTransfers[0];
+		Transfer.Resume(FirstBlock, WindowBlocks);
+
+		if (Transfer.IsComplete())
+		{
+			Stats.NumTransfersCompleted++;
+			OutTransfers.RemoveAt(0);
+			if (OutTransfers.Num() > 0)
+			{
+				SendBegin(*OutTransfers[0]);
+			}
+		}
+	}
+
+	void ReceivedBlock(FInBunch& Bunch)
+	{
+		uint32 Block = 0;
+		Bunch.SerializeIntPacked(Block);
+
+		if (!InTransfer)
+		{
+			// A late resend of the previous transfer
+			return;
+		}
+
+		const int32 Size = int32(Bunch.GetBytesLeft());
+		if (Bunch.IsError() || !InTransfer->ReceivedBlock(Block, Bunch.GetDataPosChecked(), Size))
+		{
+			Connection->Close(ENetCloseResult::CorruptData);
+			return;
+		}
+
+		Stats.BytesReceived += Size;
+		if (InTransfer->IsComplete())
+		{
+			FinishInTransfer();
+		}
+	}
+
+	void FinishInTransfer()
+	{
+		const FGuid ContentId = InTransfer->ContentId;
+		const FString Filename = InTransfer->Finish(Connection->Driver->DataStreamDirectory);
+		InTransfer.Reset();
+
+		if (Filename.IsEmpty())
+		{
+			UE_LOG(LogNet, Warning, TEXT("UDataStreamChannel: couldn't move %s into place"), *ContentId.ToString());
+			return;
+		}
+
+		Stats.NumTransfersCompleted++;
+		if (OnTransferReceived)
+		{
+			OnTransferReceived(ContentId, Filename);
+		}
+	}
 };
\ No newline at end of file
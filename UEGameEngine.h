@@ -1,4 +1,12 @@
 
+struct FWorldContext
+{
+	TArray<FNamedNetDriver> ActiveNetDrivers;
+
+	/** Runs the tasks of all of ActiveNetDrivers at once when UGameEngine::bShareNetTaskScheduler is set */
+	FNetTaskScheduler NetTaskScheduler;
+};
+
 class UGameEngine : public UEngine 
 {
 	TIndirectArray<FWorldContext> WorldList;
@@ -17,9 +25,73 @@ class UGameEngine : public UEngine
 
 		new(Context.ActiveNetDrivers) FNamedNetDriver(ReturnVal, Definition);
 
+		if (bShareNetTaskScheduler)
+		{
+			ReturnVal->SharedTaskScheduler = &Context.NetTaskScheduler;
+		}
+
 		return ReturnVal;
 	};
 
+	/** If true, the net drivers of a world context run their per-connection tasks together, see FNetTaskScheduler */
+	UPROPERTY(Config)
+	uint32 bShareNetTaskScheduler:1;
+
+	virtual void Tick(float DeltaSeconds, bool bIdleMode) override
+	{
+		// ...
+
+		for (int32 WorldIdx = 0; WorldIdx < WorldList.Num(); ++WorldIdx)
+		{
+			FWorldContext& Context = WorldList[WorldIdx];
+
+			// ...
+
+			// Drivers that don't share the scheduler flush from the world's OnTickFlush, at the end of its tick
+			if (Context.World() && Context.World()->ShouldTick())
+			{
+				Context.World()->Tick(LEVELTICK_All, DeltaSeconds);
+			}
+
+			// The ones that do returned from TickFlush without flushing. Same point in the frame, and without a world too.
+			if (bShareNetTaskScheduler)
+			{
+				TickFlushNetDrivers(Context, DeltaSeconds);
+			}
+
+			// ...
+		}
+	}
+
+	/** Flushes every driver of Context that shares its scheduler, in place of their own TickFlush. Called from Tick. */
+	void TickFlushNetDrivers(FWorldContext& Context, float DeltaSeconds)
+	{
+		TArray<UNetDriver*, TInlineAllocator<4>> Drivers;
+		for (const FNamedNetDriver& NamedDriver : Context.ActiveNetDrivers)
+		{
+			if (NamedDriver.NetDriver && NamedDriver.NetDriver->SharedTaskScheduler == &Context.NetTaskScheduler)
+			{
+				Drivers.Add(NamedDriver.NetDriver);
+			}
+		}
+
+		// The submit and complete halves touch the world, so drivers take turns there. Only the tasks overlap.
+		for (UNetDriver* Driver : Drivers)
+		{
+			Driver->TickFlushSubmit(DeltaSeconds, Context.NetTaskScheduler);
+		}
+
+		Context.NetTaskScheduler.Run();
+
+		for (UNetDriver* Driver : Drivers)
+		{
+			Driver->TickFlushComplete(DeltaSeconds);
+		}
+
+		SET_FLOAT_STAT(STAT_NetSharedTasksTime, Context.NetTaskScheduler.Stats.RunTime * 1000.0);
+		SET_DWORD_STAT(STAT_NetSharedTasksNum, Context.NetTaskScheduler.Stats.NumTasks);
+	}
+
 
 	// CALL ON CLIENT TO CONNECT
 	virtual EBrowseReturnVal::Type Browse( FWorldContext& WorldContext, FURL URL, FString& Error )
@@ -27,12 +99,16 @@ class UGameEngine : public UEngine
 		WorldContext.PendingNetGame = NewObject<UPendingNetGame>();
 		WorldContext.PendingNetGame->Initialize(WorldContext.LastURL);
 		WorldContext.PendingNetGame->InitNetDriver();
+
+		// Doesn't wait for the server: the join carries on in UPendingNetGame::Tick, from TickWorldTravel
 	}
 
 	// CALL ON SERVER TO START LISTEN 
 	// If has Listen option then starts listen
 	virtual bool LoadMap( FWorldContext& WorldContext, FURL URL, class UPendingNetGame* Pending, FString& Error )
 	{
+		// ... load the map, already in memory if Pending preloaded it ...
+
 		if (Pending == NULL && (!GIsClient || URL.HasOption(TEXT("Listen"))))
 		{
 			if (!WorldContext.World()->Listen(URL))
@@ -40,6 +116,11 @@ class UGameEngine : public UEngine
 				UE_LOG(LogNet, Error, TEXT("LoadMap: failed to Listen(%s)"), *URL.ToString());
 			}
 		}
+
+		if (Pending)
+		{
+			Pending->LogJoinTimings();
+		}
 	}
 
 
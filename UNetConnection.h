@@ -1,7 +1,4 @@
 
-typedef TMap<TWeakObjectPtr<AActor>, UActorChannel*, FDefaultSetAllocator, TWeakObjectPtrMapKeyFuncs<TWeakObjectPtr<AActor>, UActorChannel*>> FActorChannelMap;
-
-
 class UNetConnection : public UPlayer
 {
 	/** Owning net driver */
@@ -17,16 +14,438 @@ class UNetConnection : public UPlayer
 
 	TArray<UChannel*>	Channels;
 
+	/** Actor channels by actor, see FActorChannelMap */
 	FActorChannelMap ActorChannels;
 
-	FActorChannelMap ActorChannels;
 	TMap<int32, FNetworkGUID> IgnoringChannels;
 
 	/** Set of channels we may need to ignore when processing a delta checkpoint */
 	TSet<int32> IgnoredBunchChannels;
 	
-	/** Set of channel index values to reserve so GetFreeChannelIndex won't use them */
-	TSet<int32> ReservedChannels;
+	/** Free / used / reserved / ignored channel indices. Only unreserved, unignored dynamic indices are returned by GetFreeChannelIndex. */
+	FChannelIndexAllocator ChannelIndexAllocator;
+
+	/** Arrival jitter and time spent queued before processing, when the driver uses a receive thread */
+	FNetReceiveTimingStats ReceiveTimingStats;
+
+	/**
+	 * If > 0, packets that arrive up to this many sequence numbers past a gap are held in PacketReorderBuffer,
+	 * across frames, waiting for the missing packets. Otherwise the missing packets are treated as dropped right away.
+	 */
+	UPROPERTY(Config)
+	int32 PacketReorderWindow;
+
+	/** Longest a packet is held waiting for a gap to fill, in seconds */
+	UPROPERTY(Config)
+	float PacketReorderWindowTime;
+
+	FPacketReorderBuffer PacketReorderBuffer;
+
+	/** Last packet id processed (not just received). Grows by PacketSequenceDelta, so unlike Header.Seq it never wraps. */
+	int32 InPacketId;
+
+	virtual void InitBase(UNetDriver* InDriver, FSocket* InSocket, const FURL& InURL, EConnectionState InState, int32 InMaxPacket = 0, int32 InPacketOverhead = 0)
+	{
+		// ... CurrentNetSpeed = ConfiguredLANSpeed / ConfiguredInternetSpeed, clamped to MaxClientRate on servers ...
+
+		// Both sides start from the configured rate, NMT_NetSpeed only moves the ceiling later
+		if (bUseCongestionControl)
+		{
+			CongestionController.Init(CurrentNetSpeed, Driver->GetElapsedTime());
+		}
+
+		if (PacketReorderWindow > 0)
+		{
+			PacketReorderBuffer.Init(PacketReorderWindow, PacketReorderWindowTime);
+		}
+	}
+
+	/** bIsReinjectedPacket is set when the packet comes out of PacketReorderBuffer, which then must not hold it again */
+	void ReceivedPacket(FBitReader& Reader, bool bIsReinjectedPacket = false)
+	{
+		const int64 PacketStartPos = Reader.GetPosBits();
+
+		FNotificationHeader Header;
+		if (!PacketNotify.ReadHeader(Header, Reader))
+		{
+			return;
+		}
+
+		// Header.Seq is 14 bits and wraps; everything here works on ids extended from InPacketId
+		const int32 PacketSequenceDelta = PacketNotify.GetSequenceDelta(Header);
+		const int32 PacketId = InPacketId + PacketSequenceDelta;
+		if (PacketSequenceDelta <= 0)
+		{
+			// Old or duplicate. Packets we are waiting for can't get here: InPacketId doesn't move past a gap while we hold packets.
+			return;
+		}
+
+		if (PacketReorderWindow > 0 && !bIsReinjectedPacket)
+		{
+			if (PacketSequenceDelta > 1)
+			{
+				if (PacketSequenceDelta <= PacketReorderBuffer.GetWindowPackets())
+				{
+					PacketReorderBuffer.Add(PacketId, Reader.GetData(), Reader.GetNumBits(), Driver->GetElapsedTime());
+					return;
+				}
+
+				// Too far ahead to hold: give up on everything we were waiting for, then process this one normally
+				FlushPacketReorderBuffer();
+			}
+			else if (!PacketReorderBuffer.IsEmpty())
+			{
+				PacketReorderBuffer.Stats.NumRecovered++;
+			}
+		}
+
+		ProcessPacket(Header, Reader, PacketStartPos);
+		InPacketId = PacketId;
+
+		// The packet may have filled a gap, anything now in order can go
+		if (PacketReorderWindow > 0 && !bIsReinjectedPacket)
+		{
+			ReleaseInOrderPackets();
+		}
+	}
+
+	void ReleaseInOrderPackets()
+	{
+		while (const FPacketReorderBuffer::FSlot* Slot = PacketReorderBuffer.Find(InPacketId + 1))
+		{
+			FBitReader HeldReader(Slot->Data, Slot->NumBits);
+			const int32 HeldPacketId = Slot->PacketId;
+			PacketReorderBuffer.Release(HeldPacketId);
+
+			ReceivedPacket(HeldReader, true);
+		}
+
+		PacketReorderBuffer.UpdateOldestReceiveTime();
+	}
+
+	/** Gives up on every gap in PacketReorderBuffer, processing what it holds in sequence order */
+	void FlushPacketReorderBuffer()
+	{
+		for (int32 NextHeld = PacketReorderBuffer.FindNextHeld(InPacketId); NextHeld != INDEX_NONE; NextHeld = PacketReorderBuffer.FindNextHeld(InPacketId))
+		{
+			PacketReorderBuffer.Stats.NumDropped += NextHeld - InPacketId - 1;
+
+			const FPacketReorderBuffer::FSlot* Slot = PacketReorderBuffer.Find(NextHeld);
+			FBitReader HeldReader(Slot->Data, Slot->NumBits);
+			PacketReorderBuffer.Release(NextHeld);
+
+			// Processed as a packet following dropped ones, same as without the buffer
+			ReceivedPacket(HeldReader, true);
+			ReleaseInOrderPackets();
+		}
+	}
+
+	virtual void Tick(float DeltaSeconds)
+	{
+		if (PacketReorderBuffer.HasExpired(Driver->GetElapsedTime()))
+		{
+			FlushPacketReorderBuffer();
+		}
+
+		if (bCompressActorBunches)
+		{
+			TickBunchCompressionModel();
+		}
+
+		// QueuedBits drains at CurrentNetSpeed, which IsNetReady and so ServerReplicateActors_ProcessPrioritizedActors budget against
+		if (bUseCongestionControl && CongestionController.IsInitialized())
+		{
+			CurrentNetSpeed = CongestionController.GetRate();
+		}
+	}
+
+	/**
+	 * If true, CurrentNetSpeed follows FNetCongestionController instead of staying at the rate NMT_NetSpeed set,
+	 * which becomes the controller's ceiling.
+	 */
+	UPROPERTY(Config)
+	uint32 bUseCongestionControl:1;
+
+	FNetCongestionController CongestionController;
+
+	/**
+	 * Called by the server when NMT_NetSpeed is received, with the rate already clamped to the driver's MaxClientRate,
+	 * and by the client with the rate it sends. The controller keeps what it learned about the path, only the ceiling moves.
+	 */
+	void SetNegotiatedNetSpeed(int32 NetSpeed)
+	{
+		if (bUseCongestionControl)
+		{
+			if (CongestionController.IsInitialized())
+			{
+				CongestionController.SetMaxRate(NetSpeed);
+			}
+			else
+			{
+				CongestionController.Init(NetSpeed, Driver->GetElapsedTime());
+			}
+			CurrentNetSpeed = CongestionController.GetRate();
+		}
+		else
+		{
+			CurrentNetSpeed = NetSpeed;
+		}
+	}
+
+	/** Called from FlushNet once the packet went to LowLevelSend */
+	void NotifyPacketSent(int32 PacketId, int32 NumBytes)
+	{
+		if (bUseCongestionControl && CongestionController.IsInitialized())
+		{
+			CongestionController.OnPacketSent(PacketId, NumBytes, Driver->GetElapsedTime());
+		}
+	}
+
+	virtual void FlushNet(bool bIgnoreSimulation = false)
+	{
+		// ... PacketNotify header, termination bit, PacketHandler ...
+
+		const int32 NumBytes = SendBuffer.GetNumBytes();
+		LowLevelSend(SendBuffer.GetData(), SendBuffer.GetNumBits(), Traits);
+		NotifyPacketSent(OutPacketId, NumBytes);
+
+		// ... OutPacketId++, stats, InitSendBuffer ...
+	}
+
+	/** Packet delivery notifications from PacketNotify, passed on to the channels that had bunches in the packet */
+	void ReceivedAck(int32 AckPacketId)
+	{
+		if (bUseCongestionControl)
+		{
+			CongestionController.OnPacketAcked(AckPacketId, Driver->GetElapsedTime());
+		}
+
+		ForEachChannelInPacket(AckPacketId, [AckPacketId](UChannel* Channel)
+		{
+			Channel->ReceivedAck(AckPacketId);
+		});
+	}
+
+	void ReceivedNak(int32 NakPacketId)
+	{
+		if (bUseCongestionControl)
+		{
+			CongestionController.OnPacketNaked(NakPacketId, Driver->GetElapsedTime());
+		}
+
+		ForEachChannelInPacket(NakPacketId, [NakPacketId](UChannel* Channel)
+		{
+			Channel->ReceivedNak(NakPacketId);
+		});
+	}
+
+	/** Channels that wrote a bunch into a packet, so its ACK or NAK only visits those instead of every open channel */
+	struct FPacketChannelRecord
+	{
+		int32 PacketId = INDEX_NONE;
+		TArray<int32, TInlineAllocator<8>> ChIndices;
+	};
+
+	/** Power of two, and well above the packets PacketNotify lets be in flight, so a record is never reused before its packet is ACKed or NAKed */
+	static constexpr int32 PacketChannelRecordCapacity = 1024;
+
+	/** Indexed by packet id modulo PacketChannelRecordCapacity, allocated by InitChannelData */
+	TArray<FPacketChannelRecord> PacketChannelRecords;
+
+	/** Called for every bunch written into the send buffer */
+	void RecordPacketChannel(int32 PacketId, int32 ChIndex)
+	{
+		FPacketChannelRecord& Record = PacketChannelRecords[PacketId & (PacketChannelRecordCapacity - 1)];
+		if (Record.PacketId != PacketId)
+		{
+			Record.PacketId = PacketId;
+			Record.ChIndices.Reset();
+		}
+		Record.ChIndices.AddUnique(ChIndex);
+	}
+
+	template<typename FuncType>
+	void ForEachChannelInPacket(int32 PacketId, FuncType&& Func)
+	{
+		FPacketChannelRecord& Record = PacketChannelRecords[PacketId & (PacketChannelRecordCapacity - 1)];
+		if (Record.PacketId != PacketId)
+		{
+			return;
+		}
+
+		// A packet is only ever ACKed or NAKed once. Channels closed since don't get the notification; if the index was
+		// reused, the new channel has nothing recorded in this packet and ignores it.
+		Record.PacketId = INDEX_NONE;
+		for (int32 ChIndex : Record.ChIndices)
+		{
+			if (UChannel* Channel = Channels[ChIndex])
+			{
+				Func(Channel);
+			}
+		}
+	}
+
+	/**
+	 * If true, reliable bunches larger than a single partial bunch are sent as fragments that are ACKed and resent one by one,
+	 * instead of as PartialInitial / Partial / PartialFinal bunches that are resent as a whole.
+	 */
+	UPROPERTY(Config)
+	uint32 bSelectiveFragmentRetransmit:1;
+
+	FFragmentRetransmitStats FragmentRetransmitStats;
+
+	/**
+	 * If true, unreliable bunches on an open channel are delivered even while the channel waits for a missing reliable bunch,
+	 * instead of queuing behind it. Anything relying on unreliable data only arriving after earlier reliable data must not set this.
+	 */
+	UPROPERTY(Config)
+	uint32 bIndependentUnreliableBunches:1;
+
+	/** Packet receive to channel delivery time, for reliable (ordered and unordered) and unreliable bunches */
+	FNetLatencyHistogram ReliableBunchLatency;
+	FNetLatencyHistogram UnreliableBunchLatency;
+
+	/** If true, actor bunch payloads are entropy coded, see FNetBunchCompressor. Both sides must agree. */
+	UPROPERTY(Config)
+	uint32 bCompressActorBunches:1;
+
+	/** Symbol frequencies trained offline on recorded traffic, used as model 0. Must be identical on client and server. */
+	UPROPERTY(Config)
+	TArray<uint16> PretrainedBunchCompressionModel;
+
+	FNetBunchCompressor BunchCompressor;
+
+	TArray<uint8> CompressionScratch;
+
+	/** Bulk transfers to and from this connection, if a data stream channel is open. See FDataStreamTransfer.h. */
+	class UDataStreamChannel* DataStreamChannel = nullptr;
+
+	/** Spectators only: NMT_BroadcastRecord pieces of the record being received from the relay */
+	FBroadcastRecordAssembler BroadcastAssembler;
+
+	/**
+	 * Called from UChannel::SendBunch for actor channels, after the replicators wrote the bunch and before it is packed.
+	 * Only a bunch that then goes out whole is compressed: partial bunches and fragments are reassembled after reordering,
+	 * when the model they were encoded with may have been replaced. See FNetBunchCompressor.
+	 */
+	void CompressBunch(FOutBunch& Bunch)
+	{
+		if (!bCompressActorBunches || Bunch.bFragment || Bunch.bPartial)
+		{
+			return;
+		}
+
+		if (BunchCompressor.Compress(Bunch.GetData(), Bunch.GetNumBytes(), int32(GetMaxSingleBunchSizeBits() / 8), CompressionScratch))
+		{
+			// UncompressedBits goes in the bunch header, right after bCompressed
+			const int64 UncompressedBits = Bunch.GetNumBits();
+			Bunch.Reset();
+			Bunch.bCompressed = true;
+			Bunch.UncompressedBits = UncompressedBits;
+			Bunch.Serialize(CompressionScratch.GetData(), CompressionScratch.Num());
+		}
+	}
+
+	/** Called from UChannel::ReceivedRawBunch as the bunch comes off the packet, before it can wait in InRec */
+	bool DecompressBunch(FInBunch& Bunch)
+	{
+		const int64 NumBytes = FMath::DivideAndRoundUp<int64>(Bunch.UncompressedBits, 8);
+		if (Bunch.UncompressedBits <= 0 || NumBytes > NetMaxConstructedPartialBunchSizeBytes)
+		{
+			return false;
+		}
+
+		CompressionScratch.SetNumUninitialized(NumBytes, false);
+		if (!BunchCompressor.Decompress(Bunch.GetDataPosChecked(), Bunch.GetBytesLeft(), CompressionScratch.GetData(), NumBytes))
+		{
+			return false;
+		}
+
+		Bunch.SetData(CompressionScratch.GetData(), Bunch.UncompressedBits);
+		Bunch.bCompressed = false;
+		return true;
+	}
+
+	/** Sends the next adaptive model when one is due. It's switched to in UControlChannel, on the receiver's NMT_BunchCompressionModelAck. */
+	void TickBunchCompressionModel()
+	{
+		if (!Channels[0] || BunchCompressor.HasPendingModel() || !IsNetReady(false))
+		{
+			return;
+		}
+
+		uint8 ModelId = 0;
+		TArray<uint16> Freqs;
+		if (BunchCompressor.BuildPendingModel(ModelId, Freqs))
+		{
+			FNetControlMessage<NMT_BunchCompressionModel>::Send(this, ModelId, Freqs);
+		}
+	}
+
+	/** Outgoing bunch bytes of this tick, plus the reliable ones still waiting for an ACK. See FNetBufferPool. */
+	FNetBufferPool SendBufferPool;
+
+	/** A sent bunch's header and payload bits, both in SendBufferPool */
+	struct FPooledBunch
+	{
+		FNetBufferSlice Header;
+		int64 HeaderBits = 0;
+
+		FNetBufferSlice Payload;
+		int64 PayloadBits = 0;
+
+		/** Packet the bunch was last written to */
+		int32 PacketId = INDEX_NONE;
+
+		int32 ChIndex = INDEX_NONE;
+	};
+
+	/**
+	 * SendRawBunch for bunches that need their bytes after the send (reliable ones, for resends).
+	 * The bunch is copied out of its writer once, into SendBufferPool; the packet is packed from those slices and the caller
+	 * keeps them, so a resend is a ResendPooledBunch with no further copy or allocation.
+	 */
+	FPooledBunch SendPooledBunch(FOutBunch& Bunch)
+	{
+		SendBunchHeader.Reset();
+		WriteBunchHeader(SendBunchHeader, Bunch);
+
+		FPooledBunch Pooled;
+		Pooled.HeaderBits = SendBunchHeader.GetNumBits();
+		Pooled.Header = SendBufferPool.AllocateAndCopy(SendBunchHeader.GetData(), SendBunchHeader.GetNumBytes());
+		Pooled.PayloadBits = Bunch.GetNumBits();
+		Pooled.Payload = SendBufferPool.AllocateAndCopy(Bunch.GetData(), Bunch.GetNumBytes());
+		Pooled.ChIndex = Bunch.ChIndex;
+
+		ResendPooledBunch(Pooled);
+		return Pooled;
+	}
+
+	/** Writes a pooled bunch (header included, it doesn't depend on the packet) into the send buffer as is */
+	void ResendPooledBunch(FPooledBunch& Pooled)
+	{
+		Pooled.PacketId = WriteBitsToSendBuffer(Pooled.Header.GetData(), Pooled.HeaderBits, Pooled.Payload.GetData(), Pooled.PayloadBits);
+		RecordPacketChannel(Pooled.PacketId, Pooled.ChIndex);
+	}
+
+	/** Writes a bunch into the send buffer. Bunches that need their bytes after the send use SendPooledBunch instead. */
+	FPacketIdRange SendRawBunch(FOutBunch& Bunch, bool InAllowMerge)
+	{
+		SendBunchHeader.Reset();
+		WriteBunchHeader(SendBunchHeader, Bunch);
+
+		// ... merging with the previous bunch of the same channel ...
+
+		const int32 PacketId = WriteBitsToSendBuffer(SendBunchHeader.GetData(), SendBunchHeader.GetNumBits(), Bunch.GetData(), Bunch.GetNumBits());
+		RecordPacketChannel(PacketId, Bunch.ChIndex);
+		return FPacketIdRange(PacketId);
+	}
+
+	/** When to consider each replicated actor for this connection, used when UNetDriver::bUseIncrementalPriorityScheduler is set */
+	FNetPriorityScheduler PriorityScheduler;
+
+	/** Owner chain roots of this connection's viewers as of its last replication, see UNetDriver::OwnerOnlyActorsByRoot */
+	TArray<const AActor*, TInlineAllocator<4>> OwnerOnlyViewerRoots;
 
 	void AddActorChannel(AActor* Actor, UActorChannel* Channel)
 	{
@@ -37,13 +456,146 @@ class UNetConnection : public UPlayer
 		}
 	}
 
+	void InitChannelData()
+	{
+		Channels.AddDefaulted(MaxChannelSize);
+		PacketChannelRecords.SetNum(PacketChannelRecordCapacity);
+
+		// Dynamic channels start after the last static one, so they can never take the control or voice channel's index
+		int32 FirstDynamicIndex = 0;
+		for (const FChannelDefinition& ChannelDef : Driver->ChannelDefinitions)
+		{
+			FirstDynamicIndex = FMath::Max(FirstDynamicIndex, ChannelDef.StaticChannelIndex + 1);
+		}
+		ChannelIndexAllocator.Init(MaxChannelSize, FirstDynamicIndex);
+
+		// Before the first bunch, so both sides start from the same model
+		if (bCompressActorBunches)
+		{
+			BunchCompressor.InitPretrainedModel(PretrainedBunchCompressionModel);
+		}
+	}
+
+	/** Reserve a range of channel indices so GetFreeChannelIndex won't use them */
+	void ReserveChannelIndices(int32 FirstIndex, int32 Count)
+	{
+		ChannelIndexAllocator.SetReserved(FirstIndex, Count, true);
+	}
+
+	/** Channels being ignored for a delta checkpoint keep their index until StopIgnoringChannel */
+	void IgnoreChannel(int32 ChIndex, const FNetworkGUID& ActorGUID)
+	{
+		IgnoringChannels.Add(ChIndex, ActorGUID);
+		ChannelIndexAllocator.SetIgnored(ChIndex, true);
+	}
+
+	void StopIgnoringChannel(int32 ChIndex)
+	{
+		if (IgnoringChannels.Remove(ChIndex) > 0)
+		{
+			ChannelIndexAllocator.SetIgnored(ChIndex, false);
+		}
+	}
+
+	/** Returns an index that is now marked used, or INDEX_NONE */
+	int32 GetFreeChannelIndex(const FName& ChName)
+	{
+		// Static channels (control, voice) have fixed indices and never go through Allocate
+		const int32 StaticChannelIndex = Driver->ChannelDefinitionMap[ChName].StaticChannelIndex;
+		if (StaticChannelIndex != INDEX_NONE)
+		{
+			return ChannelIndexAllocator.Claim(StaticChannelIndex) ? StaticChannelIndex : INDEX_NONE;
+		}
+
+		return ChannelIndexAllocator.Allocate();
+	}
+
+	void RemoveActorChannel(AActor* Actor)
+	{
+		ActorChannels.Remove(Actor);
+		if (ReplicationConnectionDriver)
+		{
+			ReplicationConnectionDriver->NotifyActorChannelRemoved(Actor);
+		}
+	}
+
+	UActorChannel* FindActorChannelRef(const AActor* Actor) const
+	{
+		return ActorChannels.FindRef(Actor);
+	}
+
+	/** Slots of ActorChannels PurgeStaleActorChannels looks at per tick */
+	static constexpr uint32 StaleActorChannelSlotsPerTick = 64;
+
+	/** Once per tick. Drops the ActorChannels entries of actors destroyed without their channel being closed, a batch at a time. */
+	void PurgeStaleActorChannels()
+	{
+		ActorChannels.PurgeStaleEntries(StaleActorChannelSlotsPerTick);
+	}
+
 	ENGINE_API UChannel* CreateChannelByName( const FName& ChName, EChannelCreateFlags CreateFlags, int32 ChannelIndex=INDEX_NONE )
 	{
+		int32 ChIndex = ChannelIndex;
+		if (ChIndex == INDEX_NONE)
+		{
+			ChIndex = GetFreeChannelIndex(ChName);
+			if (ChIndex == INDEX_NONE)
+			{
+				UE_LOG(LogNetTraffic, Warning, TEXT("No free channel could be found in the channel list (current limit is %d channels)"), MaxChannelSize);
+				return nullptr;
+			}
+		}
+		else if (!ChannelIndexAllocator.Claim(ChIndex))
+		{
+			// Explicit index from the remote side: out of range, or a channel already lives there
+			UE_LOG(LogNetTraffic, Warning, TEXT("CreateChannelByName: channel index %d is invalid or already in use"), ChIndex);
+			return nullptr;
+		}
+
 		// Create channel.
 		UChannel* Channel = Driver->GetOrCreateChannelByName(ChName);
 		check(Channel);
 		Channel->Init( this, ChIndex, CreateFlags );
 		Channels[ChIndex] = Channel;
-		OpenChannels.Add(Channel);
+		AddOpenChannel(Channel);
+		return Channel;
+	}
+
+	/** Called from UChannel::CleanUp. Frees the channel's index and removes it from OpenChannels, both O(1). */
+	void RemoveChannel(UChannel* Channel)
+	{
+		const int32 ChIndex = Channel->ChIndex;
+		if (Channels[ChIndex] == Channel)
+		{
+			Channels[ChIndex] = nullptr;
+			ChannelIndexAllocator.Release(ChIndex);
+		}
+
+		RemoveOpenChannel(Channel);
+	}
+
+private:
+
+	/** OpenChannels is kept dense and unordered: each channel knows its slot, removal swaps the last channel into it */
+	void AddOpenChannel(UChannel* Channel)
+	{
+		Channel->OpenChannelIndex = OpenChannels.Add(Channel);
+	}
+
+	void RemoveOpenChannel(UChannel* Channel)
+	{
+		const int32 Slot = Channel->OpenChannelIndex;
+		if (Slot == INDEX_NONE)
+		{
+			return;
+		}
+
+		check(OpenChannels[Slot] == Channel);
+		OpenChannels.RemoveAtSwap(Slot, 1, false);
+		if (Slot < OpenChannels.Num())
+		{
+			OpenChannels[Slot]->OpenChannelIndex = Slot;
+		}
+		Channel->OpenChannelIndex = INDEX_NONE;
 	}
 };
@@ -3,19 +3,223 @@ class UPendingNetGame :
 	public UObject,
 	public FNetworkNotify
 {
+	/** Where a join is. InitNetDriver starts it and Tick advances it, so none of it blocks the game thread. */
+	enum class EJoinStep : uint8
+	{
+		/** Waiting for the server's address, resolved on a worker */
+		Resolve,
+
+		/** Stateless handshake with the server's packet handler */
+		Handshake,
+
+		/** NMT_Hello sent, waiting for NMT_Welcome */
+		Login,
+
+		/** Connected, UGameEngine loads the map */
+		Welcomed,
+
+		Failed,
+	};
+
+	EJoinStep JoinStep = EJoinStep::Resolve;
+
+	/** Filled in by the resolve callback on a worker, shared so it outlives us if we're gone first */
+	struct FResolveState
+	{
+		std::atomic<bool> bDone{false};
+		TSharedPtr<FInternetAddr> Addr;
+	};
+
+	TSharedPtr<FResolveState, ESPMode::ThreadSafe> ResolveState;
+
+	/** Map loading ahead of UGameEngine::LoadMap, from the URL and then from NMT_Welcome. Held so it isn't collected before. */
+	FName PreloadPackageName;
+	TStrongObjectPtr<UPackage> PreloadedPackage;
+
+	/** Join milestones in FPlatformTime::Seconds, logged by LogJoinTimings. Zero for the ones not reached (or not needed). */
+	struct FJoinTimings
+	{
+		double Start = 0.0;
+		double Resolved = 0.0;
+		double Handshaked = 0.0;
+		double Welcomed = 0.0;
+		double MapPreloaded = 0.0;
+		double Playable = 0.0;
+	};
+
+	FJoinTimings JoinTimings;
+
+	/** Creates the driver, then starts resolving the server's address and loading the URL's map side by side */
 	void InitNetDriver()
 	{
+		JoinTimings.Start = FPlatformTime::Seconds();
+
 		if (GEngine->CreateNamedNetDriver(this, NAME_PendingNetDriver, NAME_GameNetDriver))
 		{
 			NetDriver = GEngine->FindNamedNetDriver(this, NAME_PendingNetDriver);
 		}
 
-		if(NetDriver->InitConnect( this, URL, ConnectionError ))
+		if (!NetDriver)
+		{
+			ConnectionError = TEXT("Error creating network driver.");
+			JoinStep = EJoinStep::Failed;
+			return;
+		}
+
+		// A guess: if the server is running something else, NMT_Welcome replaces it
+		if (URL.Map != UGameMapsSettings::GetGameDefaultMap())
+		{
+			BeginPreloadMap(URL.Map);
+		}
+
+		ResolveState = MakeShared<FResolveState, ESPMode::ThreadSafe>();
+		NetDriver->GetSocketSubsystem()->GetAddressInfoAsync([State = ResolveState](FAddressInfoResult Result)
 		{
+			if (Result.ReturnCode == SE_NO_ERROR && Result.Results.Num() > 0)
+			{
+				State->Addr = Result.Results[0].Address;
+			}
+			State->bDone.store(true, std::memory_order_release);
+		}, *URL.Host, *FString::FromInt(URL.Port), EAddressInfoFlags::Default, NAME_None, SOCKTYPE_Datagram);
 
-			UNetConnection* ServerConn = NetDriver->ServerConnection;
+		JoinStep = EJoinStep::Resolve;
+	}
+
+	virtual void Tick(float DeltaTime)
+	{
+		if (JoinStep == EJoinStep::Resolve && ResolveState && ResolveState->bDone.load(std::memory_order_acquire))
+		{
+			BeginConnect();
 		}
 
+		// ... tick NetDriver ...
+	}
+
+	virtual void NotifyControlMessage(UNetConnection* Connection, uint8 MessageType, class FInBunch& Bunch) override
+	{
+		switch (MessageType)
+		{
+			// ...
+
+			case NMT_Welcome:
+			{
+				FString Map;
+				FString GameName;
+				FString RedirectURL;
+
+				if (FNetControlMessage<NMT_Welcome>::Receive(Bunch, Map, GameName, RedirectURL))
+				{
+					URL.Map = Map;
+					JoinTimings.Welcomed = FPlatformTime::Seconds();
+					JoinStep = EJoinStep::Welcomed;
+
+					// Nothing to do if the URL guessed right. Otherwise loading starts now instead of in LoadMap.
+					BeginPreloadMap(Map);
+
+					// The rate we ask the server for is our own ceiling too. Not CurrentNetSpeed, which may be the congestion controller's rate by now.
+					UNetConnection* ServerConn = NetDriver->ServerConnection;
+					const int32 NetSpeed = URL.HasOption(TEXT("LAN")) ? GetDefault<UPlayer>()->ConfiguredLanSpeed : GetDefault<UPlayer>()->ConfiguredInternetSpeed;
+					ServerConn->SetNegotiatedNetSpeed(NetSpeed);
+					FNetControlMessage<NMT_Netspeed>::Send(ServerConn, NetSpeed);
+
+					// ... bSuccessfullyConnected = true ...
+				}
+				break;
+			}
+		}
+	}
+
+	/** Called by UGameEngine::LoadMap once the world is up. Logs how long each step of the join took. */
+	void LogJoinTimings()
+	{
+		JoinTimings.Playable = FPlatformTime::Seconds();
+
+		auto Since = [this](double Time) { return Time > 0.0 ? (Time - JoinTimings.Start) * 1000.0 : 0.0; };
+
+		UE_LOG(LogNet, Log, TEXT("Joined %s in %.1f ms: resolved %.1f, handshaked %.1f, welcomed %.1f, map preloaded %.1f (%s)"),
+			*URL.ToString(), Since(JoinTimings.Playable), Since(JoinTimings.Resolved), Since(JoinTimings.Handshaked),
+			Since(JoinTimings.Welcomed), Since(JoinTimings.MapPreloaded), *PreloadPackageName.ToString());
+
+		PreloadedPackage.Reset();
+	}
+
+private:
+
+	/** Connects to the resolved address, so InitConnect doesn't resolve it again on the game thread */
+	void BeginConnect()
+	{
+		JoinTimings.Resolved = FPlatformTime::Seconds();
+
+		if (!ResolveState->Addr)
+		{
+			ConnectionError = FString::Printf(TEXT("Couldn't resolve %s"), *URL.Host);
+			JoinStep = EJoinStep::Failed;
+			return;
+		}
+
+		FURL ConnectURL = URL;
+		ConnectURL.Host = ResolveState->Addr->ToString(false);
+
+		if (!NetDriver->InitConnect(this, ConnectURL, ConnectionError))
+		{
+			JoinStep = EJoinStep::Failed;
+			return;
+		}
+
+		// The handshake packets go out with the driver's ticks, and NMT_Hello once the server accepted them
+		JoinStep = EJoinStep::Handshake;
+
+		UNetConnection* ServerConn = NetDriver->ServerConnection;
+		UIpNetDriver* IpDriver = Cast<UIpNetDriver>(NetDriver);
+		if (IpDriver && IpDriver->IsUsingHandshakeFastPath())
+		{
+			IpDriver->BeginClientFastPathHandshake(FSimpleDelegate::CreateUObject(this, &UPendingNetGame::HandshakeComplete));
+		}
+		else if (ServerConn->Handler.IsValid())
+		{
+			ServerConn->Handler->BeginHandshaking(FPacketHandlerHandshakeComplete::CreateUObject(this, &UPendingNetGame::HandshakeComplete));
+		}
+		else
+		{
+			HandshakeComplete();
+		}
+	}
+
+	void HandshakeComplete()
+	{
+		JoinTimings.Handshaked = FPlatformTime::Seconds();
+		JoinStep = EJoinStep::Login;
+
 		SendInitialJoin();
 	}
+
+	/** Starts loading the map's package, unless it already is */
+	void BeginPreloadMap(const FString& MapName)
+	{
+		if (!FPackageName::IsValidLongPackageName(MapName))
+		{
+			return;
+		}
+
+		const FName PackageName(*MapName);
+		if (PackageName == PreloadPackageName)
+		{
+			return;
+		}
+
+		// If the URL's guess was wrong, it's let go of and collected with the old world
+		PreloadPackageName = PackageName;
+		PreloadedPackage.Reset();
+
+		TWeakObjectPtr<UPendingNetGame> WeakThis(this);
+		LoadPackageAsync(MapName, FLoadPackageAsyncDelegate::CreateLambda([WeakThis, PackageName](const FName&, UPackage* Package, EAsyncLoadingResult::Type Result)
+		{
+			UPendingNetGame* This = WeakThis.Get();
+			if (This && This->PreloadPackageName == PackageName && Result == EAsyncLoadingResult::Succeeded)
+			{
+				This->PreloadedPackage.Reset(Package);
+				This->JoinTimings.MapPreloaded = FPlatformTime::Seconds();
+			}
+		}), 0, PKG_ContainsMap);
+	}
 };
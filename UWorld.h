@@ -7,6 +7,31 @@ class ENGINE_API UWorld final : public UObject, public FNetworkNotify
 	UPROPERTY(Transient)
 	TObjectPtr<class UNetDriver> NetDriver;
 
+	/** Recording or playing a replay, or playing a spectator broadcast */
+	UPROPERTY(Transient)
+	TObjectPtr<class UDemoNetDriver> DemoNetDriver;
+
+	virtual void NotifyControlMessage(UNetConnection* Connection, uint8 MessageType, class FInBunch& Bunch) override
+	{
+		switch (MessageType)
+		{
+			// ...
+
+			case NMT_Netspeed:
+			{
+				int32 Rate;
+				if (FNetControlMessage<NMT_Netspeed>::Receive(Bunch, Rate))
+				{
+					Connection->SetNegotiatedNetSpeed(FMath::Clamp(Rate, 1800, NetDriver->MaxClientRate));
+					UE_LOG(LogNet, Log, TEXT("Client netspeed is %i"), Connection->CurrentNetSpeed);
+				}
+				break;
+			}
+
+			// ...
+		}
+	}
+
 	bool UWorld::Listen(FURL& InURL)
 	{
 #if WITH_SERVER_CODE